@@ -0,0 +1,515 @@
+/*************************************************************************/
+/*  File Name: fsm_bench.c                                               */
+/*  Purpose: Throughput and latency benchmark for event dispatch. Built  */
+/*           by Bench/fsm_bench.py against a generated state table,      */
+/*           prints one JSON object with the results.                    */
+/*                                                                       */
+/*           fsm_bench <mode> <events> [producers] [workers]             */
+/*             mode single:    one instance, register + serve.           */
+/*             mode threads:   producer threads post to their own        */
+/*                             instances, one thread serves all.         */
+/*             mode instances: FSM_NUM_INSTANCES instances stepped in    */
+/*                             turn from one thread.                     */
+/*             mode exec:      producer threads post through the         */
+/*                             executor, served by worker threads.       */
+/*             mode batch:     FSM_NUM_INSTANCES instances stepped       */
+/*                             together by u4_fsm_instBatchStep().       */
+/*           Latency is measured in a second pass, from registration of  */
+/*           an event to the entry callback of its transition.           */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "fsm.h"
+#include "fsm_exec.h"
+#include "fsm_batch.h"
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define BENCH_MAX_SAMPLES      (1 << 20)
+#define BENCH_MAX_PRODUCERS    64
+#define BENCH_STAMP_LENGTH     (2 * FSM_EVT_QUEUE_LENGTH)
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+typedef struct BenchProducer
+{
+  pthread_t thread;
+  FSM_INST  firstInst;
+  FSM_INST  numInst;
+}
+BenchProducer;
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static FSM_EVT* evt_sp_walk;
+static U4       u4_s_walkLength;
+
+static atomic_ulong u8_s_transitions;
+
+/* Latency pass: send time per in-flight event, indexed by sequence. */
+static U1            u1_s_measureLatency;
+static unsigned long u8_sa_stamp[FSM_NUM_INSTANCES][BENCH_STAMP_LENGTH];
+static atomic_ulong  u8_sa_sent[FSM_NUM_INSTANCES];
+static unsigned long u8_sa_received[FSM_NUM_INSTANCES];
+static unsigned long* u8_sp_samples;
+static atomic_ulong   u8_s_numSamples;
+static unsigned long  u8_s_sampleEvery;
+
+static atomic_int s4_s_producersDone;
+static U1         u1_s_useExec;
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+static unsigned long u8_bench_nowNs(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((unsigned long)ts.tv_sec * 1000000000ul + (unsigned long)ts.tv_nsec);
+}
+
+/* Entry callback installed for every state, counts transitions and in the
+   latency pass matches the event to its send time. */
+static void vd_bench_entry(FSM_INST inst, U1 reentrySts)
+{
+  unsigned long u8_t_seq;
+  unsigned long u8_t_sample;
+
+  (void)reentrySts;
+
+  atomic_fetch_add_explicit(&u8_s_transitions, 1, memory_order_relaxed);
+
+  if(u1_s_measureLatency == FSM_TRUE)
+  {
+    u8_t_seq = u8_sa_received[inst]++;
+
+    /* Executor workers run callbacks concurrently, claim the slot. */
+    if(((u8_t_seq % u8_s_sampleEvery) == 0) &&
+       ((u8_t_sample = atomic_fetch_add_explicit(&u8_s_numSamples, 1, memory_order_relaxed)) < BENCH_MAX_SAMPLES))
+    {
+      u8_sp_samples[u8_t_sample] = u8_bench_nowNs() - u8_sa_stamp[inst][u8_t_seq % BENCH_STAMP_LENGTH];
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+}
+
+/* Random walk from the initial state over active transitions only, so the
+   machine takes a transition on every event. */
+static void vd_bench_buildWalk(U4 length)
+{
+  U4 u4_t_state;
+  U4 u4_t_step;
+  U4 u4_t_evt;
+  U4 u4_t_numActive;
+  FSM_EVT evt_ta_active[FSM_NUM_EVENTS];
+
+  evt_sp_walk     = malloc(sizeof(FSM_EVT) * length);
+  u4_s_walkLength = length;
+  u4_t_state      = FSM_STATE_INITIAL;
+  srand(1);
+
+  for(u4_t_step = 0; u4_t_step < length; u4_t_step++)
+  {
+    u4_t_numActive = 0;
+
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      if(u4_fsm_getTransition(u4_t_state, (FSM_EVT)u4_t_evt) != FSM_STATE_INACTIVE)
+      {
+        evt_ta_active[u4_t_numActive++] = (FSM_EVT)u4_t_evt;
+      }
+      else
+      {
+
+      }
+    }
+
+    if(u4_t_numActive == 0)
+    {
+      fprintf(stderr, "fsm_bench: state %d has no active transition\n", u4_t_state);
+      exit(1);
+    }
+    else
+    {
+
+    }
+
+    evt_sp_walk[u4_t_step] = evt_ta_active[(U4)rand() % u4_t_numActive];
+    u4_t_state             = u4_fsm_getTransition(u4_t_state, evt_sp_walk[u4_t_step]);
+  }
+}
+
+static int s4_bench_cmpSample(const void* a, const void* b)
+{
+  unsigned long u8_t_a = *(const unsigned long*)a;
+  unsigned long u8_t_b = *(const unsigned long*)b;
+
+  return (u8_t_a > u8_t_b) - (u8_t_a < u8_t_b);
+}
+
+static unsigned long u8_bench_percentile(double pct)
+{
+  unsigned long u8_t_rtn;
+  unsigned long u8_t_numSamples;
+
+  u8_t_rtn        = 0;
+  u8_t_numSamples = atomic_load(&u8_s_numSamples);
+
+  if(u8_t_numSamples != 0)
+  {
+    u8_t_rtn = u8_sp_samples[(unsigned long)(pct / 100.0 * (double)(u8_t_numSamples - 1) + 0.5)];
+  }
+  else
+  {
+
+  }
+
+  return (u8_t_rtn);
+}
+
+static void vd_bench_reset(U4 numInst)
+{
+  U4 u4_t_inst;
+
+  vd_fsm_init();
+
+  for(u4_t_inst = 1; u4_t_inst < numInst; u4_t_inst++)
+  {
+    (void)inst_fsm_create();
+  }
+
+  for(u4_t_inst = 0; u4_t_inst < FSM_NUM_INSTANCES; u4_t_inst++)
+  {
+    atomic_store(&u8_sa_sent[u4_t_inst], 0);
+    u8_sa_received[u4_t_inst] = 0;
+  }
+
+  atomic_store(&u8_s_transitions, 0);
+  atomic_store(&u8_s_numSamples, 0);
+}
+
+static void vd_bench_stamp(FSM_INST inst)
+{
+  unsigned long u8_t_seq;
+
+  if(u1_s_measureLatency == FSM_TRUE)
+  {
+    u8_t_seq = atomic_load_explicit(&u8_sa_sent[inst], memory_order_relaxed);
+    u8_sa_stamp[inst][u8_t_seq % BENCH_STAMP_LENGTH] = u8_bench_nowNs();
+    atomic_store_explicit(&u8_sa_sent[inst], u8_t_seq + 1, memory_order_relaxed);
+  }
+  else
+  {
+
+  }
+}
+
+static void vd_bench_post(FSM_INST inst, FSM_EVT evt)
+{
+  vd_bench_stamp(inst);
+
+#ifdef FSM_CFG_EXECUTOR
+  while(((u1_s_useExec == FSM_TRUE) ? u1_fsm_execPostEvt(inst, evt) : u1_fsm_instRegisterEvt(inst, evt)) !=
+        FSM_EVT_REGISTERED)
+#else
+  while(u1_fsm_instRegisterEvt(inst, evt) != FSM_EVT_REGISTERED)
+#endif
+  {
+    sched_yield();
+  }
+}
+
+/*************************************************************************/
+/*  Modes                                                                */
+/*************************************************************************/
+static void vd_bench_runSingle(void)
+{
+  U4 u4_t_step;
+
+  vd_bench_reset(1);
+
+  for(u4_t_step = 0; u4_t_step < u4_s_walkLength; u4_t_step++)
+  {
+    vd_bench_post(FSM_INST_DEFAULT, evt_sp_walk[u4_t_step]);
+
+    /* Serve in batches of a full queue in the throughput pass, per event
+       in the latency pass. */
+    if((u1_s_measureLatency == FSM_TRUE) || (((u4_t_step + 1) % FSM_EVT_QUEUE_LENGTH) == 0))
+    {
+      (void)u1_fsm_instServeEvtQueueBudget(FSM_INST_DEFAULT, FSM_SERVE_NO_LIMIT, FSM_SERVE_NO_LIMIT);
+    }
+    else
+    {
+
+    }
+  }
+
+  (void)u1_fsm_instServeEvtQueueBudget(FSM_INST_DEFAULT, FSM_SERVE_NO_LIMIT, FSM_SERVE_NO_LIMIT);
+}
+
+static void vd_bench_runInstances(void)
+{
+  U4 u4_t_step;
+  FSM_INST inst_t_inst;
+
+  vd_bench_reset(FSM_NUM_INSTANCES);
+
+  for(u4_t_step = 0; u4_t_step < u4_s_walkLength; u4_t_step++)
+  {
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      vd_bench_post(inst_t_inst, evt_sp_walk[u4_t_step]);
+    }
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      (void)u1_fsm_instServeEvtQueueBudget(inst_t_inst, FSM_SERVE_NO_LIMIT, FSM_SERVE_NO_LIMIT);
+    }
+  }
+}
+
+#ifdef FSM_CFG_BATCH
+static void vd_bench_runBatch(void)
+{
+  static FSM_EVT evt_sa_lanes[FSM_NUM_INSTANCES];
+  U4 u4_t_step;
+  FSM_INST inst_t_inst;
+
+  vd_bench_reset(FSM_NUM_INSTANCES);
+
+  for(u4_t_step = 0; u4_t_step < u4_s_walkLength; u4_t_step++)
+  {
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      vd_bench_stamp(inst_t_inst);
+      evt_sa_lanes[inst_t_inst] = evt_sp_walk[u4_t_step];
+    }
+
+    (void)u4_fsm_instBatchStep(FSM_INST_DEFAULT, FSM_NUM_INSTANCES, evt_sa_lanes);
+  }
+}
+#endif
+
+static void* vd_bench_producer(void* arg)
+{
+  BenchProducer* bench_t_prod = arg;
+  U4 u4_t_step;
+  FSM_INST inst_t_inst;
+
+  for(u4_t_step = 0; u4_t_step < u4_s_walkLength; u4_t_step++)
+  {
+    for(inst_t_inst = bench_t_prod->firstInst;
+        inst_t_inst < (bench_t_prod->firstInst + bench_t_prod->numInst); inst_t_inst++)
+    {
+      vd_bench_post(inst_t_inst, evt_sp_walk[u4_t_step]);
+    }
+  }
+
+  atomic_fetch_add(&s4_s_producersDone, 1);
+
+  return (NULL);
+}
+
+static void vd_bench_runThreads(U4 numProducers, U4 numWorkers)
+{
+  BenchProducer bench_ta_prod[BENCH_MAX_PRODUCERS];
+  U4 u4_t_idx;
+  FSM_INST inst_t_inst;
+  FSM_INST inst_t_perProducer;
+  unsigned long u8_t_expected;
+
+  vd_bench_reset(FSM_NUM_INSTANCES);
+  atomic_store(&s4_s_producersDone, 0);
+
+#ifdef FSM_CFG_EXECUTOR
+  if(u1_s_useExec == FSM_TRUE)
+  {
+    (void)u1_fsm_execStart(numWorkers);
+  }
+  else
+  {
+
+  }
+#else
+  (void)numWorkers;
+#endif
+
+  inst_t_perProducer = FSM_NUM_INSTANCES / numProducers;
+  u8_t_expected      = (unsigned long)inst_t_perProducer * numProducers * u4_s_walkLength;
+
+  for(u4_t_idx = 0; u4_t_idx < numProducers; u4_t_idx++)
+  {
+    bench_ta_prod[u4_t_idx].firstInst = u4_t_idx * inst_t_perProducer;
+    bench_ta_prod[u4_t_idx].numInst   = inst_t_perProducer;
+    pthread_create(&bench_ta_prod[u4_t_idx].thread, NULL, vd_bench_producer, &bench_ta_prod[u4_t_idx]);
+  }
+
+  /* This thread is the consumer, unless the executor serves. */
+  while(atomic_load_explicit(&u8_s_transitions, memory_order_relaxed) < u8_t_expected)
+  {
+    for(inst_t_inst = 0; (u1_s_useExec == FSM_FALSE) && (inst_t_inst < (inst_t_perProducer * numProducers));
+        inst_t_inst++)
+    {
+      (void)u1_fsm_instServeEvtQueueBudget(inst_t_inst, FSM_SERVE_NO_LIMIT, FSM_SERVE_NO_LIMIT);
+    }
+
+    sched_yield();
+  }
+
+  for(u4_t_idx = 0; u4_t_idx < numProducers; u4_t_idx++)
+  {
+    pthread_join(bench_ta_prod[u4_t_idx].thread, NULL);
+  }
+
+#ifdef FSM_CFG_EXECUTOR
+  vd_fsm_execStop();
+#endif
+}
+
+static void vd_bench_run(const char* mode, U4 numProducers, U4 numWorkers)
+{
+  if(strcmp(mode, "single") == 0)
+  {
+    vd_bench_runSingle();
+  }
+  else if(strcmp(mode, "instances") == 0)
+  {
+    vd_bench_runInstances();
+  }
+#ifdef FSM_CFG_BATCH
+  else if(strcmp(mode, "batch") == 0)
+  {
+    vd_bench_runBatch();
+  }
+#endif
+  else
+  {
+    vd_bench_runThreads(numProducers, numWorkers);
+  }
+}
+
+/*************************************************************************/
+/*************************************************************************/
+int main(int argc, char** argv)
+{
+  const char* mode;
+  unsigned long u8_t_events;
+  unsigned long u8_t_start;
+  unsigned long u8_t_elapsed;
+  unsigned long u8_t_transitions;
+  U4 u4_t_producers;
+  U4 u4_t_workers;
+  U4 u4_t_instances;
+  U4 u4_t_state;
+
+  if(argc < 3)
+  {
+    fprintf(stderr, "usage: %s single|threads|instances|exec|batch <events> [producers] [workers]\n", argv[0]);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  mode           = argv[1];
+  u8_t_events    = strtoul(argv[2], NULL, 10);
+  u4_t_producers = (argc > 3) ? (U4)strtoul(argv[3], NULL, 10) : 1;
+  u4_t_workers   = (argc > 4) ? (U4)strtoul(argv[4], NULL, 10) : 1;
+  u1_s_useExec   = (strcmp(mode, "exec") == 0) ? FSM_TRUE : FSM_FALSE;
+
+#ifndef FSM_CFG_EXECUTOR
+  if(u1_s_useExec == FSM_TRUE)
+  {
+    fprintf(stderr, "fsm_bench: exec mode needs FSM_CFG_EXECUTOR\n");
+    return (2);
+  }
+  else
+  {
+
+  }
+#endif
+
+  if((u4_t_producers < 1) || (u4_t_producers > BENCH_MAX_PRODUCERS) || (u4_t_producers > FSM_NUM_INSTANCES))
+  {
+    fprintf(stderr, "fsm_bench: producers must be 1..%d and at most FSM_NUM_INSTANCES\n", BENCH_MAX_PRODUCERS);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  u4_t_instances = (strcmp(mode, "single") == 0) ? 1 : FSM_NUM_INSTANCES;
+  if((strcmp(mode, "threads") == 0) || (u1_s_useExec == FSM_TRUE))
+  {
+    u4_t_instances = (FSM_NUM_INSTANCES / u4_t_producers) * u4_t_producers;
+  }
+  else
+  {
+
+  }
+
+  vd_bench_buildWalk((U4)((u8_t_events + u4_t_instances - 1) / u4_t_instances));
+
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    (void)u1_fsm_setStateFp(u4_t_state, FSM_STATE_SET_ENTRY_FUNC, vd_bench_entry);
+  }
+
+  u8_sp_samples = malloc(sizeof(unsigned long) * BENCH_MAX_SAMPLES);
+
+  /* Throughput pass. */
+  u1_s_measureLatency = FSM_FALSE;
+  u8_t_start          = u8_bench_nowNs();
+  vd_bench_run(mode, u4_t_producers, u4_t_workers);
+  u8_t_elapsed        = u8_bench_nowNs() - u8_t_start;
+  u8_t_transitions    = atomic_load(&u8_s_transitions);
+
+  /* Latency pass, every event stamped at registration. */
+  u1_s_measureLatency = FSM_TRUE;
+  u8_s_sampleEvery    = (u8_t_transitions / BENCH_MAX_SAMPLES) + 1;
+  vd_bench_run(mode, u4_t_producers, u4_t_workers);
+  if(atomic_load(&u8_s_numSamples) > BENCH_MAX_SAMPLES)
+  {
+    atomic_store(&u8_s_numSamples, BENCH_MAX_SAMPLES);
+  }
+  else
+  {
+
+  }
+
+  qsort(u8_sp_samples, atomic_load(&u8_s_numSamples), sizeof(unsigned long), s4_bench_cmpSample);
+
+  printf("{\"mode\": \"%s\", \"instances\": %d, \"producers\": %d, \"workers\": %d, \"transitions\": %lu, "
+         "\"seconds\": %.6f, \"events_per_sec\": %.0f, "
+         "\"latency_ns_p50\": %lu, \"latency_ns_p99\": %lu, \"latency_ns_p999\": %lu}\n",
+         mode, u4_t_instances, ((strcmp(mode, "threads") == 0) || (u1_s_useExec == FSM_TRUE)) ? u4_t_producers : 0,
+         (u1_s_useExec == FSM_TRUE) ? u4_t_workers : 0, u8_t_transitions,
+         (double)u8_t_elapsed / 1e9, (double)u8_t_transitions * 1e9 / (double)(u8_t_elapsed ? u8_t_elapsed : 1),
+         u8_bench_percentile(50.0), u8_bench_percentile(99.0), u8_bench_percentile(99.9));
+
+  return (0);
+}
@@ -0,0 +1,165 @@
+#!/usr/bin/env python3
+"""Benchmark driver for the FSM module.
+
+For every configuration in the requested matrix this script generates a
+synthetic automaton, runs Tools/fsm_gen.py on it, builds Source/fsm.c, the
+stub queue and Bench/fsm_bench.c in a scratch directory and runs the result.
+Results are written as a JSON array or CSV, one record per run, so they can
+be compared across releases, table formats and queue modes.
+
+Example::
+
+    python3 Bench/fsm_bench.py --states 2,256,10000 --events 2,64,1000 \\
+        --density 1.0,0.05 --formats dense,sparse,switch \\
+        --modes single,threads,instances,exec,batch --workers 1,2,4,8 --out results.json
+"""
+
+import argparse
+import csv
+import json
+import os
+import random
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+QUEUE_MODES = {"spsc": 0, "mpsc": 1}
+
+
+def csv_list(kind):
+    return lambda text: [kind(x) for x in text.split(",") if x]
+
+
+def write_automaton(path, states, events, density, seed):
+    """Random automaton in UMDES format where every state is reachable.
+
+    Event 0 of state s always leads to s + 1 (mod states), the other
+    transitions are drawn with probability ``density``.
+    """
+    rng = random.Random(seed)
+    with open(path, "w") as f:
+        f.write("%d\n\n" % states)
+        for s in range(states):
+            row = [(0, (s + 1) % states)]
+            for e in range(1, events):
+                if rng.random() < density:
+                    row.append((e, rng.randrange(states)))
+            f.write("%d %d %d\n" % (s, int(s == 0), len(row)))
+            for e, t in row:
+                f.write("e%d %d c o\n" % (e, t))
+            f.write("\n")
+
+
+def table_entries(fmt, states, events, density):
+    if fmt == "dense":
+        return states * events
+    return int(states * (1 + (events - 1) * density))
+
+
+def build(workdir, cfg, cc, cflags):
+    """Generate the table and compile the benchmark, return binary path."""
+    for rel in ("Header/fsm.h", "Header/fsm_instr.h", "Header/fsm_exec.h", "Header/fsm_payload.h",
+                "Header/fsm_timer.h", "Header/fsm_batch.h", "Header/fsm_trace.h", "Header/fsm_snapshot.h",
+                "Header/fsm_async.h", "Header/fsm_coalesce.h", "Header/fsm_wait.h", "Source/fsm.c",
+                "Source/fsm_exec.c", "Source/fsm_batch.c", "Stub/fsm_stub.c", "Stub/fsm_stub.h",
+                "Bench/fsm_bench.c"):
+        shutil.copy(os.path.join(ROOT, rel), workdir)
+    fsm_path = os.path.join(workdir, "bench.fsm")
+    write_automaton(fsm_path, cfg["states"], cfg["events"], cfg["density"], cfg["seed"])
+    subprocess.check_call([sys.executable, os.path.join(ROOT, "Tools", "fsm_gen.py"), fsm_path,
+                           "--no-minimize", "--format", cfg["format"],
+                           "--header", os.path.join(workdir, "fsm_table.h"),
+                           "--source", os.path.join(workdir, "fsm_table.c")],
+                          stdout=subprocess.DEVNULL)
+    binary = os.path.join(workdir, "fsm_bench")
+    cmd = [cc] + cflags + ["-std=c11", "-pthread", "-I" + workdir,
+                           "-DFSM_NUM_INSTANCES=%d" % cfg["instances"],
+                           "-DFSM_QUEUE_MODE=%d" % QUEUE_MODES[cfg["queue"]],
+                           "-DFSM_EVT_QUEUE_LENGTH=%d" % cfg["queue_length"],
+                           "-DFSM_CFG_EXECUTOR", "-DFSM_CFG_BATCH",
+                           "-DFSM_BATCH_MAX_ENTRIES=%d" % (cfg["states"] * cfg["events"]), "-o", binary] + \
+        [os.path.join(workdir, f) for f in ("fsm.c", "fsm_table.c", "fsm_stub.c", "fsm_exec.c",
+                                            "fsm_batch.c", "fsm_bench.c")]
+    subprocess.check_call(cmd)
+    return binary
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--states", type=csv_list(int), default=[2, 256, 4096])
+    ap.add_argument("--events", type=csv_list(int), default=[2, 64])
+    ap.add_argument("--density", type=csv_list(float), default=[1.0, 0.05])
+    ap.add_argument("--formats", type=csv_list(str), default=["dense", "sparse", "switch"])
+    ap.add_argument("--modes", type=csv_list(str), default=["single", "threads", "instances", "exec", "batch"])
+    ap.add_argument("--queues", type=csv_list(str), default=["mpsc"])
+    ap.add_argument("--queue-length", type=int, default=64)
+    ap.add_argument("--instances", type=int, default=1024,
+                    help="instances for the threads, instances and batch modes")
+    ap.add_argument("--producers", type=int, default=2, help="producer threads in threads and exec mode")
+    ap.add_argument("--workers", type=csv_list(int), default=[1, 2, 4],
+                    help="executor worker threads in exec mode")
+    ap.add_argument("--num-events", type=int, default=2000000, help="events per run")
+    ap.add_argument("--max-entries", type=int, default=4000000,
+                    help="skip tables with more entries, large dense tables build slowly")
+    ap.add_argument("--seed", type=int, default=1)
+    ap.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    ap.add_argument("--cflags", default="-O2", help="compiler flags, space separated")
+    ap.add_argument("--out", help="result file, .csv for CSV, JSON otherwise (default stdout)")
+    args = ap.parse_args(argv)
+
+    results = []
+    workroot = tempfile.mkdtemp(prefix="fsm_bench_")
+    try:
+        for states in args.states:
+            for events in args.events:
+                for density in args.density:
+                    for fmt in args.formats:
+                        entries = table_entries(fmt, states, events, density)
+                        if entries > args.max_entries:
+                            sys.stderr.write("skip %s %dx%d density %.2f: %d entries\n"
+                                             % (fmt, states, events, density, entries))
+                            continue
+                        for queue in args.queues:
+                            for mode in args.modes:
+                                cfg = {"states": states, "events": events, "density": density,
+                                       "format": fmt, "queue": queue,
+                                       "queue_length": args.queue_length,
+                                       "instances": 1 if mode == "single" else args.instances,
+                                       "seed": args.seed}
+                                workdir = tempfile.mkdtemp(dir=workroot)
+                                binary = build(workdir, cfg, args.cc, args.cflags.split())
+                                for workers in (args.workers if mode == "exec" else [0]):
+                                    cmd = [binary, mode, str(args.num_events)]
+                                    if mode in ("threads", "exec"):
+                                        cmd.append(str(args.producers))
+                                    if mode == "exec":
+                                        cmd.append(str(workers))
+                                    out = subprocess.check_output(cmd)
+                                    record = dict(cfg)
+                                    record.update(json.loads(out.decode()))
+                                    results.append(record)
+                                    sys.stderr.write("%s\n" % json.dumps(record))
+                                shutil.rmtree(workdir)
+    finally:
+        shutil.rmtree(workroot, ignore_errors=True)
+
+    if args.out and args.out.endswith(".csv"):
+        with open(args.out, "w", newline="") as f:
+            writer = csv.DictWriter(f, fieldnames=list(results[0].keys()) if results else [])
+            writer.writeheader()
+            writer.writerows(results)
+    else:
+        text = json.dumps(results, indent=2) + "\n"
+        if args.out:
+            with open(args.out, "w") as f:
+                f.write(text)
+        else:
+            sys.stdout.write(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
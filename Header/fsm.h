@@ -1,138 +1,537 @@
-/*************************************************************************/
-/*  File Name: fsm.h                                                     */
-/*  Purpose: Header file for FSM module. Module designed to be integrated*/
-/*           with any RTOS or used bare metal, only handlers and queue   */
-/*           functions need to be defined in fsm.h.                      */
-/*  Created by: Garrett Sculthorpe on 10/20/20.                          */
-/*  Copyright © 2020 Garrett Sculthorpe.                                 */
-/*              All rights reserved.                                     */
-/*************************************************************************/
-
-#ifndef fsm_h
-#define fsm_h
-
-
-/*************************************************************************/
-/*  Definitions                                                          */
-/*************************************************************************/
-/* Replace function on right with API to get single event from an event queue,
-   or return FSM_EVT_NULL if empty */
-#define evt_fsm_evtQueueGet()            evt_fsm_evtQueueGetStub()
-
-/* Replace function on right with API to put single event into an event queue,
-   with an argument that can take FSM_EVT */
-#define u1_fsm_evtQueuePut(evt)          u1_fsm_evtQueuePutStub(evt)
-
-/* Replace function on left with API for mutual exclusion, lock()   */
-#define fsm_enterCritical()              (0)
-
-/* Replace function on left with API for mutual exclusion, unlock() */
-#define fsm_exitCritical()               (0)
-
-
-
-#define FSM_TRUE                         1
-#define FSM_FALSE                        0
-
-#define FSM_EVT_REGISTERED               0
-#define FSM_EVT_NOT_REGISTERED           1
-
-#define FSM_STATE_REENTRY                1
-#define FSM_STATE_FIRST_ENTRY            0
-
-#define FSM_STATE_SET_ENTRY_FUNC         0
-#define FSM_STATE_SET_EXIT_FUNC          1
-
-#define FSM_STATE_SET_FUNC_SUCCESS       0
-#define FSM_STATE_SET_FUNC_INV_STATE     1
-#define FSM_STATE_SET_FUNC_INV_SET       2
-
-#define FSM_EVT_QUEUE_ALL_EVT_PROCESSED  0
-#define FSM_EVT_QUEUE_INVALID_EVT        1
-
-/*************************************************************************/
-/*  Public Data Types                                                    */
-/*************************************************************************/
-#ifndef U1
-typedef unsigned char U1;
-#endif
-#ifndef U4
-typedef int U4;
-#endif
-
-typedef enum FSM_EVT
-{
-  FSM_EVT_0 = 0,
-  FSM_EVT_1,
-
-  FSM_NUM_EVENTS,
-  FSM_EVT_INACTIVE,
-  FSM_EVT_NULL
-}
-FSM_EVT;
-
-typedef enum FSM_STATE
-{
-  FSM_STATE_0 = 0,
-  FSM_STATE_1,
-
-  FSM_NUM_STATES
-}
-FSM_STATE;
-
-/*************************************************************************/
-/*  Public Functions                                                     */
-/*************************************************************************/
-/*************************************************************************/
-/*  Function Name: vd_fsm_init                                           */
-/*  Purpose:       Initialize module variables.                          */
-/*  Arguments:     N/A                                                   */
-/*  Return:        N/A                                                   */
-/*************************************************************************/
-void vd_fsm_init(void);
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_setStateFp                                     */
-/*  Purpose:       Set function pointers for state entry/exit.           */
-/*  Arguments:     U4 state:                                             */
-/*                    State for which functions will be defined.         */
-/*                 U1 entryOrExit:                                       */
-/*                    FSM_STATE_SET_ENTRY_FUNC   OR                      */
-/*                    FSM_STATE_SET_EXIT_FUNC                            */
-/*                 void (*fp):                                           */
-/*                    Pointer to routine. Entry() has U1 argument.       */
-/*  Return:        FSM_STATE_SET_FUNC_INV_SET       OR                   */
-/*                 FSM_STATE_SET_FUNC_INV_STATE     OR                   */
-/*                 FSM_STATE_SET_FUNC_SUCCESS                            */
-/*************************************************************************/
-U1 u1_fsm_setStateFp(U4 state, U1 entryOrExit, void (*fp));
-
-/*************************************************************************/
-/*  Function Name: state_fsm_getCurrentState                             */
-/*  Purpose:       Return current state of FSM.                          */
-/*  Arguments:     N/A                                                   */
-/*  Return:        enum FSM_STATE                                        */
-/*************************************************************************/
-FSM_STATE state_fsm_getCurrentState(void);
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_registerEvt                                    */
-/*  Purpose:       Register an event. Wraps event queue API.             */
-/*  Arguments:     FSM_EVT evt:                                          */
-/*                    Event number defined in enum FSM_EVT.              */
-/*  Return:        Return value from wrapped queue API.                  */
-/*************************************************************************/
-U1 u1_fsm_registerEvt(FSM_EVT evt);
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_serveEvtQueue                                  */
-/*  Purpose:       Serve waiting events in event queue. Will run until   */
-/*                 error or empty. Calls vd_fsm_invalidEvtHandler() hook */
-/*                 if event is invalid at current state.                 */
-/*  Arguments:     N/A                                                   */
-/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
-/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
-/*************************************************************************/
-U1 u1_fsm_serveEvtQueue(void);
-
-#endif
+/*************************************************************************/
+/*  File Name: fsm.h                                                     */
+/*  Purpose: Header file for FSM module. Module designed to be integrated*/
+/*           with any RTOS or used bare metal, only handlers and queue   */
+/*           functions need to be defined in fsm.h.                      */
+/*  Created by: Garrett Sculthorpe on 10/20/20.                          */
+/*  Copyright © 2020 Garrett Sculthorpe.                                 */
+/*              All rights reserved.                                     */
+/*************************************************************************/
+
+#ifndef fsm_h
+#define fsm_h
+
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Number of FSM instances held in the instance pool. Instance
+   FSM_INST_DEFAULT is reserved for the single-machine API. */
+#ifndef FSM_NUM_INSTANCES
+#define FSM_NUM_INSTANCES                1
+#endif
+
+/* Replace function on right with API to get single event from the event queue
+   of instance inst as FSM_QUEUE_ITEM, or return FSM_QUEUE_ITEM_NULL if empty */
+#define evt_fsm_evtQueueGet(inst)        evt_fsm_evtQueueGetStub(inst)
+
+/* Replace function on right with API to put single event into the event queue
+   of instance inst, with an argument that can take FSM_QUEUE_ITEM */
+#define u1_fsm_evtQueuePut(inst, evt)    u1_fsm_evtQueuePutStub(inst, evt)
+
+/* Replace function on right with API to discard all events in the event queue
+   of instance inst */
+#define vd_fsm_evtQueueReset(inst)       vd_fsm_evtQueueResetStub(inst)
+
+/* Replace function on right with API returning the number of events waiting
+   in the event queue of instance inst */
+#define u4_fsm_evtQueueDepth(inst)       u4_fsm_evtQueueDepthStub(inst)
+
+/* Replace function on left with API for mutual exclusion, lock()   */
+#define fsm_enterCritical()              (0)
+
+/* Replace function on left with API for mutual exclusion, unlock() */
+#define fsm_exitCritical()               (0)
+
+/* Replace function on right with API returning a free running tick count,
+   used for the time budget of u1_fsm_instServeEvtQueueBudget() */
+#define u4_fsm_getTicks()                (0)
+
+/* Max events copied out of the queue per lock in
+   u1_fsm_instServeEvtQueueBudget() */
+#ifndef FSM_SERVE_BATCH_LENGTH
+#define FSM_SERVE_BATCH_LENGTH           16
+#endif
+
+/* Max events parked per instance with FSM_CFG_DEFER, at most 255. A
+   deferred event that finds the list full is handled as invalid. */
+#ifndef FSM_DEFER_LENGTH
+#define FSM_DEFER_LENGTH                 4
+#endif
+
+/* Layouts of the state table, FSM_TABLE_FORMAT is set in fsm_table.h.
+   FSM_TABLE_DENSE stores every (state, event) pair, FSM_TABLE_SPARSE
+   stores only active transitions row by row and suits tables that are
+   mostly FSM_EVT_INACTIVE, FSM_TABLE_SWITCH dispatches through a
+   generated switch statement. */
+#define FSM_TABLE_DENSE                  0
+#define FSM_TABLE_SPARSE                 1
+#define FSM_TABLE_SWITCH                 2
+
+/* Data written by different threads is kept on separate lines of this
+   size. */
+#ifndef FSM_CACHE_LINE_SIZE
+#define FSM_CACHE_LINE_SIZE              64
+#endif
+
+/* Optional hooks, define to enable:
+   #define u1_fsm_invalidEvtHandler(inst)        returns FSM_TRUE to continue,
+                                                 (inst, payload) with
+                                                 FSM_CFG_PAYLOAD
+   #define fsm_markedStateHandler(inst, state)                               */
+
+/* Optional features, define to compile in:
+   #define FSM_CFG_INSTRUMENT       transition statistics, see fsm_instr.h
+   #define FSM_CFG_EXECUTOR         worker threads serving all instances,
+                                    see fsm_exec.h
+   #define FSM_CFG_PAYLOAD          events carry a buffer from a fixed pool,
+                                    see fsm_payload.h
+   #define FSM_CFG_TIMER            state timeouts from fsm_sas_fsmTimeout,
+                                    see fsm_timer.h
+   #define FSM_CFG_HIERARCHY        nested states, transitions walk the
+                                    exit/entry chains in fsm_sas_fsmChain
+   #define FSM_CFG_PRIORITY         stub queue serves events by
+                                    fsm_sa_evtPriority, highest first
+   #define FSM_CFG_DEFER            events in fsm_sa_fsmDeferSet of the
+                                    current state are parked and replayed
+                                    after the next state change
+   #define FSM_CFG_BATCH            vectorized stepping of many instances,
+                                    see fsm_batch.h
+   #define FSM_CFG_TRACE            binary record of every served event in
+                                    a memory mapped file, see fsm_trace.h
+   #define FSM_CFG_SNAPSHOT         checkpoint and restore of all instances,
+                                    see fsm_snapshot.h
+   #define FSM_CFG_ASYNC            entry actions on a worker pool that
+                                    return a completion event, see
+                                    fsm_async.h
+   #define FSM_CFG_COALESCE         events in fsm_sa_evtCoalesce merge into
+                                    the same event still queued, see
+                                    fsm_coalesce.h
+   #define FSM_CFG_WAIT             blocking wait for events on an eventfd
+                                    per instance, see fsm_wait.h
+   #define FSM_CFG_FILTER           accepted event bitsets per state, invalid
+                                    events skip the search of a sparse or
+                                    switch table and can be rejected when
+                                    registered, see vd_fsm_setEvtFilter()    */
+
+
+
+#define FSM_TRUE                         1
+#define FSM_FALSE                        0
+
+#define FSM_EVT_REGISTERED               0
+#define FSM_EVT_NOT_REGISTERED           1
+#define FSM_EVT_REJECTED                 2
+
+/* Modes of vd_fsm_setEvtFilter() with FSM_CFG_FILTER. */
+#define FSM_FILTER_OFF                   0
+#define FSM_FILTER_ANY_STATE             1
+#define FSM_FILTER_CURRENT_STATE         2
+
+#define FSM_STATE_REENTRY                1
+#define FSM_STATE_FIRST_ENTRY            0
+
+#define FSM_STATE_SET_ENTRY_FUNC         0
+#define FSM_STATE_SET_EXIT_FUNC          1
+#define FSM_STATE_SET_ASYNC_FUNC         2
+
+#define FSM_STATE_SET_FUNC_SUCCESS       0
+#define FSM_STATE_SET_FUNC_INV_STATE     1
+#define FSM_STATE_SET_FUNC_INV_SET       2
+
+#define FSM_EVT_QUEUE_ALL_EVT_PROCESSED  0
+#define FSM_EVT_QUEUE_INVALID_EVT        1
+#define FSM_EVT_QUEUE_BUDGET_EXPIRED     2
+
+#define FSM_SERVE_NO_LIMIT               0
+
+#define FSM_STATE_INACTIVE               (-1)
+
+#define FSM_INST_DEFAULT                 0
+#define FSM_INST_INVALID                 (-1)
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+#ifndef U1
+typedef unsigned char U1;
+#endif
+#ifndef U2
+typedef unsigned short U2;
+#endif
+#ifndef U4
+typedef int U4;
+#endif
+#ifndef U8
+typedef unsigned long long U8;
+#endif
+
+/* Handle to an FSM instance, index into the instance pool. */
+typedef U4 FSM_INST;
+
+/* FSM_EVT and FSM_STATE enums, generated by Tools/fsm_gen.py. */
+#include "fsm_table.h"
+
+/* Smallest type that holds every state plus FSM_STATE_IDX_INACTIVE, used
+   for table entries and per-instance state. */
+#if (FSM_STATE_COUNT < 0xFF)
+typedef U1 FSM_STATE_IDX;
+#define FSM_STATE_IDX_INACTIVE           0xFFu
+#elif (FSM_STATE_COUNT < 0xFFFF)
+typedef U2 FSM_STATE_IDX;
+#define FSM_STATE_IDX_INACTIVE           0xFFFFu
+#else
+typedef U4 FSM_STATE_IDX;
+#define FSM_STATE_IDX_INACTIVE           0x7FFFFFFF
+#endif
+
+#if (FSM_EVT_COUNT <= 0xFF)
+typedef U1 FSM_EVT_IDX;
+#else
+typedef U2 FSM_EVT_IDX;
+#endif
+
+#if (FSM_TABLE_NNZ < 0xFFFF)
+typedef U2 FSM_TABLE_ROW_IDX;
+#else
+typedef U4 FSM_TABLE_ROW_IDX;
+#endif
+
+/* Event as stored in the event queue. With FSM_CFG_PAYLOAD the low 16 bits
+   hold the event and the high 16 bits a payload handle, so the payload
+   travels through the queue by handle and is never copied. */
+#ifdef FSM_CFG_PAYLOAD
+typedef U2 FSM_PAYLOAD;
+#define FSM_PAYLOAD_NONE                 0xFFFFu
+
+typedef unsigned int FSM_QUEUE_ITEM;
+#define FSM_QUEUE_ITEM_MAKE(evt, payload) ((FSM_QUEUE_ITEM)(evt) | ((FSM_QUEUE_ITEM)(payload) << 16))
+#define FSM_QUEUE_ITEM_EVT(item)         ((FSM_EVT)((item) & 0xFFFFu))
+#define FSM_QUEUE_ITEM_PAYLOAD(item)     ((FSM_PAYLOAD)((item) >> 16))
+
+/* Extra parameter of entry/exit callbacks, points to the payload or is
+   NULL for an event registered without one. */
+#define FSM_PAYLOAD_PARAM                , void* payload
+#else
+typedef FSM_EVT FSM_QUEUE_ITEM;
+#define FSM_QUEUE_ITEM_MAKE(evt, payload) (evt)
+#define FSM_QUEUE_ITEM_EVT(item)         (item)
+
+#define FSM_PAYLOAD_PARAM
+#endif
+
+#define FSM_QUEUE_ITEM_NULL              FSM_QUEUE_ITEM_MAKE(FSM_EVT_NULL, FSM_PAYLOAD_NONE)
+
+/* Index into the exit/entry chains. With FSM_CFG_HIERARCHY the table
+   lookup also yields the chain of the transition through FSM_CHAIN_PARAM. */
+#ifdef FSM_CFG_HIERARCHY
+#if (FSM_CHAIN_LENGTH < 0xFFFF)
+typedef U2 FSM_CHAIN_IDX;
+#else
+typedef U4 FSM_CHAIN_IDX;
+#endif
+
+#define FSM_CHAIN_PARAM                  , FSM_CHAIN_IDX* chain
+#define FSM_CHAIN_SET(idx)               (*chain = (FSM_CHAIN_IDX)(idx))
+#else
+#define FSM_CHAIN_PARAM
+#define FSM_CHAIN_SET(idx)
+#endif
+
+/* Marked state bitset, one bit per state. */
+#define FSM_STATE_SET_LENGTH             ((FSM_STATE_COUNT + 7) / 8)
+#define FSM_STATE_SET_BIT(state)         (1u << ((state) & 7))
+#define FSM_STATE_SET_BYTE(state)        ((state) >> 3)
+
+/* Event bitset, one bit per event. */
+#define FSM_EVT_SET_LENGTH               ((FSM_EVT_COUNT + 7) / 8)
+#define FSM_EVT_SET_BIT(evt)             (1u << ((evt) & 7))
+#define FSM_EVT_SET_BYTE(evt)            ((evt) >> 3)
+
+/* Read-only part of the state machine, shared by all instances. Defined in
+   the generated fsm_table.c. */
+typedef struct FSMTable
+{
+#if (FSM_TABLE_FORMAT == FSM_TABLE_SPARSE)
+  /* Row of state s is [rowStart[s], rowStart[s + 1]), events ascending. */
+  FSM_TABLE_ROW_IDX rowStart[FSM_STATE_COUNT + 1];
+  FSM_EVT_IDX       evtList[FSM_TABLE_NNZ];
+  FSM_STATE_IDX     nextState[FSM_TABLE_NNZ];
+#ifdef FSM_CFG_HIERARCHY
+  FSM_CHAIN_IDX     chain[FSM_TABLE_NNZ];
+#endif
+#elif (FSM_TABLE_FORMAT == FSM_TABLE_DENSE)
+  FSM_STATE_IDX     nextState[FSM_STATE_COUNT][FSM_EVT_COUNT];
+#ifdef FSM_CFG_HIERARCHY
+  FSM_CHAIN_IDX     chain[FSM_STATE_COUNT][FSM_EVT_COUNT];
+#endif
+#endif
+  U1                markedSet[FSM_STATE_SET_LENGTH];
+#ifdef FSM_CFG_FILTER
+  /* Events with a transition, per state and in any state. */
+  U1                acceptSet[FSM_STATE_COUNT][FSM_EVT_SET_LENGTH];
+  U1                acceptAnySet[FSM_EVT_SET_LENGTH];
+#endif
+}
+FSMTable;
+
+extern const FSMTable fsm_sas_fsmTable;
+
+#ifdef FSM_CFG_TIMER
+/* Timeout of a state, generated with --timeouts. ticks 0 for none. */
+typedef struct FSMTimeout
+{
+  U4      ticks;
+  FSM_EVT evt;
+}
+FSMTimeout;
+
+extern const FSMTimeout fsm_sas_fsmTimeout[FSM_STATE_COUNT];
+#endif
+
+#ifdef FSM_CFG_HIERARCHY
+/* States a transition exits, innermost first, followed by the states it
+   enters, outermost first, starting at fsm_sa_fsmChainState[start]. Bit i
+   of reentrySet is set when entry i was also exited. */
+typedef struct FSMChain
+{
+  FSM_CHAIN_IDX start;
+  U1            exitCount;
+  U1            entryCount;
+  unsigned int  reentrySet;
+}
+FSMChain;
+
+extern const FSM_STATE_IDX fsm_sa_fsmChainState[FSM_CHAIN_LENGTH];
+extern const FSMChain      fsm_sas_fsmChain[FSM_CHAIN_COUNT];
+#endif
+
+#ifdef FSM_CFG_PRIORITY
+/* Queue priority per event, generated with --priorities. */
+extern const U1 fsm_sa_evtPriority[FSM_EVT_COUNT];
+#endif
+
+#ifdef FSM_CFG_COALESCE
+/* Coalescing policy per event, generated with --coalesce. */
+#define FSM_COALESCE_NONE                0
+#define FSM_COALESCE_COLLAPSE            1
+#define FSM_COALESCE_LATEST              2
+#define FSM_COALESCE_COUNT               3
+
+extern const U1 fsm_sa_evtCoalesce[FSM_EVT_COUNT];
+#endif
+
+#ifdef FSM_CFG_DEFER
+/* Deferred events per state, generated with --defer. */
+extern const U1 fsm_sa_fsmDeferSet[FSM_STATE_COUNT][FSM_EVT_SET_LENGTH];
+#endif
+
+#if (FSM_TABLE_FORMAT == FSM_TABLE_SWITCH)
+FSM_STATE_IDX state_fsm_tableDispatch(FSM_STATE_IDX state, FSM_EVT evt FSM_CHAIN_PARAM);
+#endif
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_init                                           */
+/*  Purpose:       Initialize module variables. Releases all instances   */
+/*                 and resets FSM_INST_DEFAULT to the initial state.     */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_init(void);
+
+/*************************************************************************/
+/*  Function Name: inst_fsm_create                                       */
+/*  Purpose:       Take an instance from the pool and reset it to the    */
+/*                 initial state with an empty event queue.              */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSM_INST handle    OR                                 */
+/*                 FSM_INST_INVALID if the pool is exhausted             */
+/*************************************************************************/
+FSM_INST inst_fsm_create(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_destroy                                        */
+/*  Purpose:       Return an instance to the pool. Pending events are    */
+/*                 discarded.                                            */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Handle returned by inst_fsm_create().              */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_destroy(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_setStateFp                                     */
+/*  Purpose:       Set function pointers for state entry/exit. Shared by */
+/*                 all instances.                                        */
+/*  Arguments:     U4 state:                                             */
+/*                    State for which functions will be defined.         */
+/*                 U1 entryOrExit:                                       */
+/*                    FSM_STATE_SET_ENTRY_FUNC   OR                      */
+/*                    FSM_STATE_SET_EXIT_FUNC    OR                      */
+/*                    FSM_STATE_SET_ASYNC_FUNC with FSM_CFG_ASYNC        */
+/*                 void (*fp):                                           */
+/*                    Pointer to routine. Entry() has FSM_INST and U1    */
+/*                    arguments, Exit() has FSM_INST argument. Both take */
+/*                    a void* payload last with FSM_CFG_PAYLOAD. An      */
+/*                    async action is an FSMAsyncFp, see fsm_async.h.    */
+/*  Return:        FSM_STATE_SET_FUNC_INV_SET       OR                   */
+/*                 FSM_STATE_SET_FUNC_INV_STATE     OR                   */
+/*                 FSM_STATE_SET_FUNC_SUCCESS                            */
+/*************************************************************************/
+U1 u1_fsm_setStateFp(U4 state, U1 entryOrExit, void (*fp));
+
+/*************************************************************************/
+/*  Function Name: state_fsm_getCurrentState                             */
+/*  Purpose:       Return current state of FSM_INST_DEFAULT.             */
+/*  Arguments:     N/A                                                   */
+/*  Return:        enum FSM_STATE                                        */
+/*************************************************************************/
+FSM_STATE state_fsm_getCurrentState(void);
+
+/*************************************************************************/
+/*  Function Name: state_fsm_instGetCurrentState                         */
+/*  Purpose:       Return current state of an instance.                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        enum FSM_STATE    OR                                  */
+/*                 FSM_STATE_INACTIVE if inst is out of range            */
+/*************************************************************************/
+FSM_STATE state_fsm_instGetCurrentState(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_getTransition                                  */
+/*  Purpose:       Look up the state table without changing any          */
+/*                 instance.                                             */
+/*  Arguments:     U4 state:                                             */
+/*                    Current state.                                     */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        U4 next state    OR                                   */
+/*                    FSM_STATE_INACTIVE if the event is not accepted or */
+/*                    an argument is out of range                        */
+/*************************************************************************/
+U4 u4_fsm_getTransition(U4 state, FSM_EVT evt);
+
+/*************************************************************************/
+/*  Function Name: u8_fsm_tableFingerprint                               */
+/*  Purpose:       Hash the next state of every (state, event) pair with */
+/*                 64 bit FNV-1a. Two builds with the same fingerprint   */
+/*                 take the same transitions, whatever the table format. */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U8 fingerprint                                        */
+/*************************************************************************/
+U8 u8_fsm_tableFingerprint(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_registerEvt                                    */
+/*  Purpose:       Register an event for FSM_INST_DEFAULT.               */
+/*  Arguments:     FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_REJECTED if dropped by vd_fsm_setEvtFilter()  */
+/*************************************************************************/
+U1 u1_fsm_registerEvt(FSM_EVT evt);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instRegisterEvt                                */
+/*  Purpose:       Register an event for an instance. Wraps event queue  */
+/*                 API.                                                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_NOT_REGISTERED if inst or evt is out of range */
+/*                 OR FSM_EVT_REJECTED if dropped by                     */
+/*                 vd_fsm_setEvtFilter()                                 */
+/*************************************************************************/
+U1 u1_fsm_instRegisterEvt(FSM_INST inst, FSM_EVT evt);
+
+#ifdef FSM_CFG_PAYLOAD
+/*************************************************************************/
+/*  Function Name: u1_fsm_instRegisterEvtPayload                         */
+/*  Purpose:       Register an event with a payload for an instance. On  */
+/*                 success the payload belongs to the FSM module until   */
+/*                 the event is processed or discarded, then it goes     */
+/*                 back to the pool. On failure the caller keeps it.     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*                 FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc().                */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_NOT_REGISTERED if an argument is out of range */
+/*                 OR FSM_EVT_REJECTED if dropped by                     */
+/*                 vd_fsm_setEvtFilter()                                 */
+/*************************************************************************/
+U1 u1_fsm_instRegisterEvtPayload(FSM_INST inst, FSM_EVT evt, FSM_PAYLOAD payload);
+#endif
+
+#ifdef FSM_CFG_FILTER
+/*************************************************************************/
+/*  Function Name: vd_fsm_setEvtFilter                                   */
+/*  Purpose:       Select which events registering rejects before they   */
+/*                 take a queue slot. Rejected events never reach        */
+/*                 u1_fsm_invalidEvtHandler(). Set before producers      */
+/*                 start, vd_fsm_init() sets FSM_FILTER_OFF.             */
+/*  Arguments:     U1 mode:                                              */
+/*                    FSM_FILTER_OFF             OR                      */
+/*                    FSM_FILTER_ANY_STATE, events no state accepts  OR  */
+/*                    FSM_FILTER_CURRENT_STATE, events the current state */
+/*                    neither accepts nor defers. Events still queued    */
+/*                    may change the state first, so this only suits     */
+/*                    producers that know the instance is idle.          */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_setEvtFilter(U1 mode);
+#endif
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_serveEvtQueue                                  */
+/*  Purpose:       Serve waiting events of FSM_INST_DEFAULT.             */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_serveEvtQueue(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instServeEvtQueue                              */
+/*  Purpose:       Serve waiting events in event queue of an instance.   */
+/*                 Will run until error or empty. Calls                  */
+/*                 u1_fsm_invalidEvtHandler() hook if event is invalid   */
+/*                 at current state.                                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_instServeEvtQueue(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instServeEvtQueueBudget                        */
+/*  Purpose:       Serve waiting events of an instance in batches. The   */
+/*                 critical section is only held while up to             */
+/*                 FSM_SERVE_BATCH_LENGTH events are copied out of the   */
+/*                 queue, transitions and callbacks run without it. A    */
+/*                 stop request from u1_fsm_invalidEvtHandler() takes    */
+/*                 effect once the current batch is served.              */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 maxEvts:                                           */
+/*                    Max events served by this call, or                 */
+/*                    FSM_SERVE_NO_LIMIT.                                */
+/*                 U4 maxTicks:                                          */
+/*                    Max u4_fsm_getTicks() ticks spent, checked         */
+/*                    between batches, or FSM_SERVE_NO_LIMIT.            */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_BUDGET_EXPIRED      OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_instServeEvtQueueBudget(FSM_INST inst, U4 maxEvts, U4 maxTicks);
+
+#endif
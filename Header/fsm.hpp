@@ -0,0 +1,320 @@
+/*************************************************************************/
+/*  File Name: fsm.hpp                                                   */
+/*  Purpose: Header-only C++17 front end for the FSM module. States,     */
+/*           events and transitions are template arguments, the table    */
+/*           is built and checked at compile time and dispatch calls the */
+/*           entry/exit actions directly, so the compiler can inline     */
+/*           them. Uses the FSM_STATE/FSM_EVT enums of fsm_table.h by    */
+/*           default, so a machine can move between the C and C++ paths  */
+/*           one at a time and be compared against fsm_sas_fsmTable.     */
+/*                                                                       */
+/*           struct Actions : fsm::NoActions                             */
+/*           {                                                           */
+/*             using fsm::NoActions::onEntry;                            */
+/*             void onEntry(fsm::StateTag<FSM_STATE_1>, U1 reentrySts);  */
+/*           };                                                          */
+/*                                                                       */
+/*           using Table = fsm::Table<FSM_STATE_0,                       */
+/*                           fsm::Row<FSM_STATE_0, FSM_EVT_0,            */
+/*                                    FSM_STATE_1>,                      */
+/*                           fsm::Row<FSM_STATE_1, FSM_EVT_1,            */
+/*                                    FSM_STATE_0>>;                     */
+/*           fsm::Machine<Table, Actions> machine;                       */
+/*           machine.dispatch(FSM_EVT_0);                                */
+/*************************************************************************/
+
+#ifndef fsm_hpp
+#define fsm_hpp
+
+#include <array>
+#include <cstddef>
+#include <type_traits>
+
+extern "C"
+{
+#include "fsm.h"
+}
+
+namespace fsm
+{
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+/* Names one state in an action overload.                                */
+template <auto S>
+struct StateTag
+{
+  static constexpr decltype(S) value = S;
+};
+
+/* One transition: event Evt in state From goes to state To. */
+template <auto From, auto Evt, auto To>
+struct Row
+{
+  static_assert(std::is_same_v<decltype(From), decltype(To)>, "fsm::Row: From and To must have the state type");
+
+  static constexpr decltype(From) from = From;
+  static constexpr decltype(Evt)  evt  = Evt;
+  static constexpr decltype(To)   to   = To;
+};
+
+template <typename... Rows>
+struct RowList
+{
+};
+
+/* Actions a machine calls, all empty. Derive from it, bring the base
+   templates in with using declarations and overload the ones needed,
+   a non-template overload wins over the base template. */
+struct NoActions
+{
+  template <auto S>
+  void onEntry(StateTag<S>, U1 reentrySts)
+  {
+    (void)reentrySts;
+  }
+
+  template <auto S>
+  void onExit(StateTag<S>)
+  {
+  }
+
+  template <typename StateT, typename EvtT>
+  void onInvalid(StateT state, EvtT evt)
+  {
+    (void)state;
+    (void)evt;
+  }
+};
+
+namespace detail
+{
+
+template <typename T>
+constexpr std::size_t u8_index(T value)
+{
+  return static_cast<std::size_t>(value);
+}
+
+/* Next state per (state, event) at state * NumEvents + event, or
+   FSM_STATE_INACTIVE. */
+template <std::size_t NumStates, std::size_t NumEvents, typename... Rows>
+constexpr std::array<int, NumStates * NumEvents> sa_buildNext()
+{
+  std::array<int, NumStates * NumEvents> a_t_next{};
+  constexpr std::array<std::size_t, sizeof...(Rows)> a_t_key = {
+    ((u8_index(Rows::from) * NumEvents) + u8_index(Rows::evt))...};
+  constexpr std::array<int, sizeof...(Rows)> a_t_to = {static_cast<int>(Rows::to)...};
+
+  for(std::size_t u8_t_idx = 0; u8_t_idx < a_t_next.size(); u8_t_idx++)
+  {
+    a_t_next[u8_t_idx] = FSM_STATE_INACTIVE;
+  }
+
+  for(std::size_t u8_t_row = 0; u8_t_row < a_t_key.size(); u8_t_row++)
+  {
+    a_t_next[a_t_key[u8_t_row]] = a_t_to[u8_t_row];
+  }
+
+  return (a_t_next);
+}
+
+template <std::size_t NumEvents, typename... Rows>
+constexpr bool u1_uniqueKeys()
+{
+  constexpr std::array<std::size_t, sizeof...(Rows)> a_t_key = {
+    ((u8_index(Rows::from) * NumEvents) + u8_index(Rows::evt))...};
+  bool u1_t_unique = true;
+
+  for(std::size_t u8_t_row = 0; u8_t_row < a_t_key.size(); u8_t_row++)
+  {
+    for(std::size_t u8_t_other = u8_t_row + 1; u8_t_other < a_t_key.size(); u8_t_other++)
+    {
+      u1_t_unique = u1_t_unique && (a_t_key[u8_t_row] != a_t_key[u8_t_other]);
+    }
+  }
+
+  return (u1_t_unique);
+}
+
+/* Every state reached from the initial one, breadth first. */
+template <std::size_t NumStates, std::size_t NumEvents>
+constexpr bool u1_allReachable(const std::array<int, NumStates * NumEvents>& next, std::size_t initial)
+{
+  std::array<bool, NumStates> a_t_seen{};
+  std::array<std::size_t, NumStates> a_t_queue{};
+  std::size_t u8_t_head = 0;
+  std::size_t u8_t_tail = 0;
+  bool u1_t_all = true;
+
+  a_t_seen[initial]      = true;
+  a_t_queue[u8_t_tail++] = initial;
+
+  while(u8_t_head != u8_t_tail)
+  {
+    std::size_t u8_t_state = a_t_queue[u8_t_head++];
+
+    for(std::size_t u8_t_evt = 0; u8_t_evt < NumEvents; u8_t_evt++)
+    {
+      int s4_t_next = next[(u8_t_state * NumEvents) + u8_t_evt];
+
+      if((s4_t_next != FSM_STATE_INACTIVE) && (a_t_seen[static_cast<std::size_t>(s4_t_next)] == false))
+      {
+        a_t_seen[static_cast<std::size_t>(s4_t_next)] = true;
+        a_t_queue[u8_t_tail++]                        = static_cast<std::size_t>(s4_t_next);
+      }
+      else
+      {
+      }
+    }
+  }
+
+  for(std::size_t u8_t_state = 0; u8_t_state < NumStates; u8_t_state++)
+  {
+    u1_t_all = u1_t_all && a_t_seen[u8_t_state];
+  }
+
+  return (u1_t_all);
+}
+
+}
+
+/* Compile-time state table. Rejects rows with a state or event out of
+   range, two rows for the same (state, event) and states that cannot be
+   reached from Initial. */
+template <typename StateT, typename EvtT, std::size_t NumStates, std::size_t NumEvents, StateT Initial,
+          typename... Rows>
+struct BasicTable
+{
+  using State = StateT;
+  using Evt   = EvtT;
+  using List  = RowList<Rows...>;
+
+  static constexpr std::size_t numStates = NumStates;
+  static constexpr std::size_t numEvents = NumEvents;
+  static constexpr StateT      initial   = Initial;
+
+  static_assert((std::is_same_v<std::remove_const_t<decltype(Rows::from)>, StateT> && ...),
+                "fsm::BasicTable: row state of the wrong type");
+  static_assert((std::is_same_v<std::remove_const_t<decltype(Rows::evt)>, EvtT> && ...),
+                "fsm::BasicTable: row event of the wrong type");
+  static_assert(detail::u8_index(Initial) < NumStates, "fsm::BasicTable: initial state out of range");
+  static_assert(((detail::u8_index(Rows::from) < NumStates) && ...), "fsm::BasicTable: source state out of range");
+  static_assert(((detail::u8_index(Rows::to) < NumStates) && ...), "fsm::BasicTable: target state out of range");
+  static_assert(((detail::u8_index(Rows::evt) < NumEvents) && ...), "fsm::BasicTable: event out of range");
+  static_assert(detail::u1_uniqueKeys<NumEvents, Rows...>(), "fsm::BasicTable: two rows for one (state, event)");
+
+  static constexpr std::array<int, NumStates * NumEvents> next =
+    detail::sa_buildNext<NumStates, NumEvents, Rows...>();
+
+  static_assert(detail::u1_allReachable<NumStates, NumEvents>(next, detail::u8_index(Initial)),
+                "fsm::BasicTable: state not reachable from the initial state");
+
+  /* Next state, or FSM_STATE_INACTIVE. */
+  static constexpr int lookup(StateT state, EvtT evt)
+  {
+    return (next[(detail::u8_index(state) * NumEvents) + detail::u8_index(evt)]);
+  }
+};
+
+/* Table over the enums of the generated fsm_table.h. */
+template <FSM_STATE Initial, typename... Rows>
+using Table = BasicTable<FSM_STATE, FSM_EVT, FSM_NUM_STATES, FSM_NUM_EVENTS, Initial, Rows...>;
+
+/*************************************************************************/
+/*  Machine                                                              */
+/*************************************************************************/
+/* One state machine instance. dispatch() compares (state, event) against
+   the rows in a fold, which GCC and Clang turn into a jump table, and
+   calls exit, transition and entry as the C module does. */
+template <typename TableT, typename ActionsT = NoActions>
+class Machine
+{
+public:
+  using State = typename TableT::State;
+  using Evt   = typename TableT::Evt;
+
+  explicit Machine(ActionsT actions = ActionsT{}) : m_actions(actions), m_state(TableT::initial)
+  {
+  }
+
+  State state() const
+  {
+    return (m_state);
+  }
+
+  ActionsT& actions()
+  {
+    return (m_actions);
+  }
+
+  /* Back to the initial state without calling any action, like
+     inst_fsm_create(). */
+  void reset()
+  {
+    m_state = TableT::initial;
+  }
+
+  /* Run one event. Returns true if it had a transition, otherwise calls
+     onInvalid() and stays. */
+  bool dispatch(Evt evt)
+  {
+    return (u1_dispatchRows(evt, typename TableT::List{}));
+  }
+
+  /* True if this table takes the same transitions as fsm_sas_fsmTable,
+     checked at runtime through u4_fsm_getTransition(). */
+  static bool matchesCTable()
+  {
+    bool u1_t_match = std::is_same_v<State, FSM_STATE> && std::is_same_v<Evt, FSM_EVT> &&
+                      (TableT::numStates == FSM_NUM_STATES) && (TableT::numEvents == FSM_NUM_EVENTS);
+
+    for(std::size_t u8_t_state = 0; u1_t_match && (u8_t_state < TableT::numStates); u8_t_state++)
+    {
+      for(std::size_t u8_t_evt = 0; u1_t_match && (u8_t_evt < TableT::numEvents); u8_t_evt++)
+      {
+        u1_t_match = (TableT::next[(u8_t_state * TableT::numEvents) + u8_t_evt] ==
+                      u4_fsm_getTransition(static_cast<U4>(u8_t_state), static_cast<FSM_EVT>(u8_t_evt)));
+      }
+    }
+
+    return (u1_t_match);
+  }
+
+private:
+  template <typename... Rows>
+  bool u1_dispatchRows(Evt evt, RowList<Rows...>)
+  {
+    const std::size_t u8_t_key = (detail::u8_index(m_state) * TableT::numEvents) + detail::u8_index(evt);
+    bool u1_t_taken;
+
+    u1_t_taken = ((u8_t_key == ((detail::u8_index(Rows::from) * TableT::numEvents) + detail::u8_index(Rows::evt)) &&
+                   (vd_take<Rows>(), true)) || ...);
+
+    if(u1_t_taken == false)
+    {
+      m_actions.onInvalid(m_state, evt);
+    }
+    else
+    {
+    }
+
+    return (u1_t_taken);
+  }
+
+  template <typename R>
+  void vd_take()
+  {
+    m_actions.onExit(StateTag<R::from>{});
+    m_state = R::to;
+    m_actions.onEntry(StateTag<R::to>{}, (R::from == R::to) ? FSM_STATE_REENTRY : FSM_STATE_FIRST_ENTRY);
+  }
+
+  ActionsT m_actions;
+  State    m_state;
+};
+
+}
+
+#endif
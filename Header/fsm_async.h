@@ -0,0 +1,156 @@
+/*************************************************************************/
+/*  File Name: fsm_async.h                                               */
+/*  Purpose: Optional asynchronous entry actions for the FSM module,     */
+/*           compiled in with FSM_CFG_ASYNC. A state registered with     */
+/*           FSM_STATE_SET_ASYNC_FUNC runs its action on a bounded pool  */
+/*           of worker threads after its entry callback. The event the   */
+/*           action returns is put in a completion slot of the instance, */
+/*           served before its queue. The instance keeps serving events  */
+/*           in between, a transition out of the state drops the         */
+/*           completion of the action still running.                     */
+/*************************************************************************/
+
+#ifndef fsm_async_h
+#define fsm_async_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_ASYNC
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Max worker threads.                                                   */
+#ifndef FSM_ASYNC_MAX_WORKERS
+#define FSM_ASYNC_MAX_WORKERS            16
+#endif
+
+/* Actions waiting for a worker, a power of 2. An action that finds the
+   pool stopped or full runs in the serving thread instead. */
+#ifndef FSM_ASYNC_QUEUE_LENGTH
+#define FSM_ASYNC_QUEUE_LENGTH           256
+#endif
+
+/* Called after a completion is put in the slot of an instance.
+   vd_fsm_execNotify(inst) with FSM_CFG_EXECUTOR, vd_fsm_waitNotify(inst)
+   with FSM_CFG_WAIT. */
+#ifndef vd_fsm_asyncNotify
+#ifdef FSM_CFG_EXECUTOR
+#define vd_fsm_asyncNotify(inst)         vd_fsm_execNotify(inst)
+#elif defined(FSM_CFG_WAIT)
+#define vd_fsm_asyncNotify(inst)         vd_fsm_waitNotify(inst)
+#else
+#define vd_fsm_asyncNotify(inst)
+#endif
+#endif
+
+#define FSM_ASYNC_STARTED                0
+#define FSM_ASYNC_START_FAILED           1
+
+/* Completion slot: FSM_ASYNC_DONE, the ticket of the action in bits 32 to
+   62 and the returned FSM_QUEUE_ITEM below, 0 when empty. */
+#define FSM_ASYNC_DONE                   0x8000000000000000ull
+#define FSM_ASYNC_TICKET_MASK            0x7FFFFFFFu
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+/* Asynchronous action of a state. Returns the completion event,
+   FSM_QUEUE_ITEM_MAKE(evt, payload) with FSM_CFG_PAYLOAD, or
+   FSM_QUEUE_ITEM_NULL for none. */
+typedef FSM_QUEUE_ITEM (*FSMAsyncFp)(FSM_INST inst, U1 reentrySts);
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern atomic_ullong u8_sa_asyncDone[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u1_fsm_asyncStart                                     */
+/*  Purpose:       Start worker threads for asynchronous actions.        */
+/*  Arguments:     U4 numWorkers:                                        */
+/*                    1 to FSM_ASYNC_MAX_WORKERS.                        */
+/*  Return:        U1 FSM_ASYNC_STARTED         OR                       */
+/*                    FSM_ASYNC_START_FAILED                             */
+/*************************************************************************/
+U1 u1_fsm_asyncStart(U4 numWorkers);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncStop                                      */
+/*  Purpose:       Run the actions still waiting, then stop and join the */
+/*                 worker threads.                                       */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncStop(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_asyncPending                                   */
+/*  Purpose:       Check if an instance waits for the completion of an   */
+/*                 asynchronous action.                                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+U1 u1_fsm_asyncPending(FSM_INST inst);
+
+/*************************************************************************/
+/*  Called from fsm.c                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncDispatch                                  */
+/*  Purpose:       Start the action of a state just entered, dropping    */
+/*                 the completion of an earlier one.                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSMAsyncFp fp:                                        */
+/*                    Action of the state.                               */
+/*                 U1 reentrySts:                                        */
+/*                    FSM_STATE_REENTRY if the state was just exited.    */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncDispatch(FSM_INST inst, FSMAsyncFp fp, U1 reentrySts);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncCancel                                    */
+/*  Purpose:       Drop the completion of the running action of an       */
+/*                 instance, if any. The action itself runs to the end.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncCancel(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_asyncTakeSlot                                 */
+/*  Purpose:       Empty the completion slot of an instance.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        FSM_QUEUE_ITEM completion event    OR                 */
+/*                 FSM_QUEUE_ITEM_NULL if dropped                        */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_asyncTakeSlot(FSM_INST inst);
+
+/* Completion event of an instance, or FSM_QUEUE_ITEM_NULL. One load when
+   the slot is empty. */
+static inline FSM_QUEUE_ITEM evt_fsm_asyncTake(FSM_INST inst)
+{
+  return ((atomic_load_explicit(&u8_sa_asyncDone[inst], memory_order_relaxed) != 0) ?
+          evt_fsm_asyncTakeSlot(inst) : FSM_QUEUE_ITEM_NULL);
+}
+
+/* Completion waiting in the slot of an instance. */
+static inline U1 u1_fsm_asyncReady(FSM_INST inst)
+{
+  return ((atomic_load_explicit(&u8_sa_asyncDone[inst], memory_order_acquire) != 0) ? FSM_TRUE : FSM_FALSE);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+/*************************************************************************/
+/*  File Name: fsm_batch.h                                               */
+/*  Purpose: Optional batch stepping for the FSM module, compiled in     */
+/*           with FSM_CFG_BATCH. Evaluates the state table for arrays of */
+/*           (state, event) lanes at once with gathers from a flattened  */
+/*           copy of fsm_sas_fsmTable. The kernel, AVX-512, AVX2 or      */
+/*           scalar, is picked by vd_fsm_batchInit() from the CPU.       */
+/*************************************************************************/
+
+#ifndef fsm_batch_h
+#define fsm_batch_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_BATCH
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Entries of the flattened table. It holds a 4 byte next state for every
+   (state, event) pair whatever the table format, plus a chain index with
+   FSM_CFG_HIERARCHY, so a sparse table of many states costs as much as a
+   dense one here. Builds above the limit fail, raise it if that memory is
+   acceptable. */
+#ifndef FSM_BATCH_MAX_ENTRIES
+#define FSM_BATCH_MAX_ENTRIES            (1u << 20)
+#endif
+
+/* Lanes per step of u4_fsm_instBatchStep(), bounds its stack use.       */
+#ifndef FSM_BATCH_CHUNK_LENGTH
+#define FSM_BATCH_CHUNK_LENGTH           256
+#endif
+
+/* Words of the lane mask for count lanes, lane n is bit n % 32 of word
+   n / 32. */
+#define FSM_BATCH_MASK_LENGTH(count)     (((count) + 31) / 32)
+
+/* Replace with the count trailing zeros instruction of the target,
+   argument is never 0. */
+#ifndef fsm_ctz
+#define fsm_ctz(mask)                    __builtin_ctz(mask)
+#endif
+
+#define FSM_BATCH_KERNEL_SCALAR          0
+#define FSM_BATCH_KERNEL_AVX2            1
+#define FSM_BATCH_KERNEL_AVX512          2
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_batchInit                                      */
+/*  Purpose:       Flatten the state table and select the fastest kernel */
+/*                 the CPU supports. Called by vd_fsm_init().            */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_batchInit(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_batchSetKernel                                 */
+/*  Purpose:       Select a kernel, falls back to the next slower one    */
+/*                 the CPU supports.                                     */
+/*  Arguments:     U1 kernel:                                            */
+/*                    FSM_BATCH_KERNEL_AVX512    OR                      */
+/*                    FSM_BATCH_KERNEL_AVX2      OR                      */
+/*                    FSM_BATCH_KERNEL_SCALAR                            */
+/*  Return:        U1 kernel selected                                    */
+/*************************************************************************/
+U1 u1_fsm_batchSetKernel(U1 kernel);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_batchStep                                      */
+/*  Purpose:       Step count lanes through the state table. Lanes whose */
+/*                 event has a transition take it and get their bit set  */
+/*                 in transMask, self-loops included since they run      */
+/*                 exit and re-entry callbacks. Other lanes are left     */
+/*                 alone with their bit clear. No instance is touched.   */
+/*  Arguments:     U4* state:                                            */
+/*                    Current states in, next states out. Each must be   */
+/*                    below FSM_NUM_STATES.                              */
+/*                 const FSM_EVT* evt:                                   */
+/*                    Event per lane, each below FSM_NUM_EVENTS.         */
+/*                 U4 count:                                             */
+/*                    Number of lanes.                                   */
+/*                 unsigned int* transMask:                              */
+/*                    FSM_BATCH_MASK_LENGTH(count) words, written.       */
+/*  Return:        U4 number of lanes that took a transition             */
+/*************************************************************************/
+U4 u4_fsm_batchStep(U4* state, const FSM_EVT* evt, U4 count, unsigned int* transMask);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_instBatchStep                                  */
+/*  Purpose:       Run one event each through count consecutive          */
+/*                 instances, bypassing their queues. Lanes are          */
+/*                 evaluated with u4_fsm_batchStep() and only those that */
+/*                 take a transition run callbacks, timers and deferred  */
+/*                 events as u1_fsm_instServeEvtQueue() would. Events    */
+/*                 without a transition are dropped without calling      */
+/*                 u1_fsm_invalidEvtHandler() or being deferred. Call    */
+/*                 only from the thread serving these instances.         */
+/*  Arguments:     FSM_INST first:                                       */
+/*                    First instance handle, all count must be created.  */
+/*                 U4 count:                                             */
+/*                    Number of instances.                               */
+/*                 const FSM_EVT* evt:                                   */
+/*                    Event per instance, each below FSM_NUM_EVENTS.     */
+/*  Return:        U4 number of instances that took a transition         */
+/*************************************************************************/
+U4 u4_fsm_instBatchStep(FSM_INST first, U4 count, const FSM_EVT* evt);
+
+#endif
+
+#endif
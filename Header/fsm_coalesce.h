@@ -0,0 +1,173 @@
+/*************************************************************************/
+/*  File Name: fsm_coalesce.h                                            */
+/*  Purpose: Optional event coalescing for the FSM module, compiled in   */
+/*           with FSM_CFG_COALESCE. An event with a policy in            */
+/*           fsm_sa_evtCoalesce that is registered while the same event  */
+/*           is still queued for the instance merges into it instead of  */
+/*           taking a queue slot:                                        */
+/*           FSM_COALESCE_COLLAPSE  the new event is dropped             */
+/*           FSM_COALESCE_LATEST    the queued event is served with the  */
+/*                                  payload of the newest one            */
+/*           FSM_COALESCE_COUNT     the queued event is served once,     */
+/*                                  u4_fsm_coalesceCount() returns how   */
+/*                                  many were merged                     */
+/*           Collapsed events are tracked in a pending bitset per        */
+/*           instance, latest and counted ones in one word per instance  */
+/*           and event, so registering stays O(1) and takes no lock. A   */
+/*           producer that finds the first event of a burst still being  */
+/*           put into the queue yields until it is there.                */
+/*************************************************************************/
+
+#ifndef fsm_coalesce_h
+#define fsm_coalesce_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_COALESCE
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Pending bitset words per instance, a pending and a commit bit per
+   event. */
+#define FSM_COALESCE_WORDS               ((FSM_EVT_COUNT + 15) / 16)
+
+/* Slot arrays need at least one entry.                                  */
+#define FSM_COALESCE_SLOTS               ((FSM_COALESCE_SLOT_COUNT > 0) ? FSM_COALESCE_SLOT_COUNT : 1)
+
+/* Slot word of a latest or counted event: pending, set while the first
+   event is put into the queue, and the newest payload or the count. */
+#define FSM_COALESCE_PENDING             0x80000000u
+#define FSM_COALESCE_COMMIT              0x40000000u
+#define FSM_COALESCE_VALUE_MASK          0x3FFFFFFFu
+
+/* Put an event into the queue of an instance, merging it per its
+   policy. Used for every event registered through the FSM module. */
+#define u1_fsm_evtPut(inst, item)        u1_fsm_coalescePut((inst), (item))
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern U4 u4_sa_coalesceServed[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceInit                                   */
+/*  Purpose:       Give every latest or counted event its slot. Called   */
+/*                 from vd_fsm_init().                                   */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceInit(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_coalescePutEvt                                 */
+/*  Purpose:       Merge an event into the same one still queued, or     */
+/*                 queue it. Safe from any thread.                       */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event with a policy other than FSM_COALESCE_NONE.  */
+/*  Return:        U1 FSM_EVT_REGISTERED if queued or merged    OR       */
+/*                    return value from the queue API                    */
+/*************************************************************************/
+U1 u1_fsm_coalescePutEvt(FSM_INST inst, FSM_QUEUE_ITEM item);
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_coalesceTakeEvt                               */
+/*  Purpose:       Clear the pending state of an event taken from the    */
+/*                 queue. Only the thread serving the instance.          */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event with a policy other than FSM_COALESCE_NONE.  */
+/*  Return:        FSM_QUEUE_ITEM event to serve    OR                   */
+/*                 FSM_QUEUE_ITEM_NULL if it was merged into an earlier  */
+/*                 one not served yet                                    */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_coalesceTakeEvt(FSM_INST inst, FSM_QUEUE_ITEM item);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceServeCount                             */
+/*  Purpose:       Move the count of a counted event into                */
+/*                 u4_fsm_coalesceCount() before it is served.           */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event with FSM_COALESCE_COUNT.                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceServeCount(FSM_INST inst, FSM_EVT evt);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_coalesceCount                                  */
+/*  Purpose:       Return how many events the event being served stands  */
+/*                 for, for use in entry, exit and marked state          */
+/*                 callbacks. 1 unless it has FSM_COALESCE_COUNT.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 count                                              */
+/*************************************************************************/
+U4 u4_fsm_coalesceCount(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_coalescePeek                                  */
+/*  Purpose:       Return a queued event with the payload it will be     */
+/*                 served with, without clearing anything.               */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event taken from the queue.                        */
+/*  Return:        FSM_QUEUE_ITEM event                                  */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_coalescePeek(FSM_INST inst, FSM_QUEUE_ITEM item);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceReset                                  */
+/*  Purpose:       Forget all pending events of an instance whose queue  */
+/*                 is emptied, returning kept payloads to the pool.      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceReset(FSM_INST inst);
+
+/* Queue an event, with one table load for events without a policy. */
+static inline U1 u1_fsm_coalescePut(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  return ((fsm_sa_evtCoalesce[FSM_QUEUE_ITEM_EVT(item)] == FSM_COALESCE_NONE) ?
+          u1_fsm_evtQueuePut(inst, item) : u1_fsm_coalescePutEvt(inst, item));
+}
+
+/* Event taken from the queue as it will be served, or
+   FSM_QUEUE_ITEM_NULL. */
+static inline FSM_QUEUE_ITEM evt_fsm_coalesceTake(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  return ((fsm_sa_evtCoalesce[FSM_QUEUE_ITEM_EVT(item)] == FSM_COALESCE_NONE) ?
+          item : evt_fsm_coalesceTakeEvt(inst, item));
+}
+
+/* Set the count of an event about to be served. */
+static inline void vd_fsm_coalesceServe(FSM_INST inst, FSM_EVT evt)
+{
+  if(fsm_sa_evtCoalesce[evt] == FSM_COALESCE_COUNT)
+  {
+    vd_fsm_coalesceServeCount(inst, evt);
+  }
+  else
+  {
+    u4_sa_coalesceServed[inst] = 1;
+  }
+}
+
+#else
+
+#define u1_fsm_evtPut(inst, item)        u1_fsm_evtQueuePut((inst), (item))
+
+#endif
+
+#endif
@@ -0,0 +1,110 @@
+/*************************************************************************/
+/*  File Name: fsm_exec.h                                                */
+/*  Purpose: Optional executor for the FSM module, compiled in with      */
+/*           FSM_CFG_EXECUTOR. Worker threads serve the event queues of  */
+/*           all instances. Instances are split into one contiguous      */
+/*           shard per worker, an instance with waiting events is put on */
+/*           the ready queue of its shard and served by one thread at a  */
+/*           time. Workers with an empty shard take ready instances from */
+/*           other shards. Serving takes no lock when the event queue is */
+/*           lock-free.                                                  */
+/*************************************************************************/
+
+#ifndef fsm_exec_h
+#define fsm_exec_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_EXECUTOR
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Max worker threads, one shard each.                                   */
+#ifndef FSM_EXEC_MAX_WORKERS
+#define FSM_EXEC_MAX_WORKERS             64
+#endif
+
+/* Events served per instance before it goes back on the ready queue, so
+   that a busy instance cannot starve the rest of its shard. */
+#ifndef FSM_EXEC_SERVE_BUDGET
+#define FSM_EXEC_SERVE_BUDGET            64
+#endif
+
+/* Empty polls of all shards before a worker sleeps. */
+#ifndef FSM_EXEC_SPIN_COUNT
+#define FSM_EXEC_SPIN_COUNT              64
+#endif
+
+/* Define on the compiler command line to pin worker n to CPU n (Linux).
+   #define FSM_EXEC_PIN_WORKERS                                              */
+
+#define FSM_EXEC_STARTED                 0
+#define FSM_EXEC_START_FAILED            1
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u1_fsm_execStart                                      */
+/*  Purpose:       Start worker threads. Instances that already have     */
+/*                 events waiting are scheduled right away.              */
+/*  Arguments:     U4 numWorkers:                                        */
+/*                    1 to FSM_EXEC_MAX_WORKERS.                         */
+/*  Return:        U1 FSM_EXEC_STARTED         OR                        */
+/*                    FSM_EXEC_START_FAILED                              */
+/*************************************************************************/
+U1 u1_fsm_execStart(U4 numWorkers);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execStop                                       */
+/*  Purpose:       Stop and join the worker threads. Events not served   */
+/*                 yet stay in the event queues.                         */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_execStop(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_execPostEvt                                    */
+/*  Purpose:       Register an event for an instance and schedule the    */
+/*                 instance on its shard. Safe from any thread.          */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from u1_fsm_instRegisterEvt().           */
+/*************************************************************************/
+U1 u1_fsm_execPostEvt(FSM_INST inst, FSM_EVT evt);
+
+#ifdef FSM_CFG_PAYLOAD
+/*************************************************************************/
+/*  Function Name: u1_fsm_execPostEvtPayload                             */
+/*  Purpose:       Register an event with a payload for an instance and  */
+/*                 schedule the instance on its shard. Safe from any     */
+/*                 thread. On failure the caller keeps the payload.      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*                 FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc().                */
+/*  Return:        Return value from u1_fsm_instRegisterEvtPayload().    */
+/*************************************************************************/
+U1 u1_fsm_execPostEvtPayload(FSM_INST inst, FSM_EVT evt, FSM_PAYLOAD payload);
+#endif
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execNotify                                     */
+/*  Purpose:       Schedule an instance whose queue was filled without   */
+/*                 u1_fsm_execPostEvt(). Does nothing if the instance is */
+/*                 already scheduled or the executor is stopped.         */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_execNotify(FSM_INST inst);
+
+#endif
+
+#endif
@@ -0,0 +1,188 @@
+/*************************************************************************/
+/*  File Name: fsm_instr.h                                               */
+/*  Purpose: Optional transition statistics for the FSM module, compiled */
+/*           in with FSM_CFG_INSTRUMENT. Counters are kept per serving   */
+/*           thread in cache line aligned blocks and written only by     */
+/*           their thread, except the last block which is shared by all  */
+/*           threads beyond FSM_INSTR_MAX_THREADS and added to           */
+/*           atomically. An exiting thread adds its counters to the      */
+/*           shared block and gives its block back. Snapshots read them  */
+/*           while the machines run. Times are in u4_fsm_getTicks()      */
+/*           ticks. Needs POSIX threads.                                 */
+/*************************************************************************/
+
+#ifndef fsm_instr_h
+#define fsm_instr_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_INSTRUMENT
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Number of counter blocks. Each thread serving events takes a free one on
+   first use until it exits, threads finding none share the last block at
+   the cost of a locked add per count. */
+#ifndef FSM_INSTR_MAX_THREADS
+#define FSM_INSTR_MAX_THREADS            8
+#endif
+
+/* Callback duration histogram, bucket b counts durations in
+   [2^(b-1), 2^b) ticks, bucket 0 counts zero. */
+#define FSM_INSTR_HIST_LENGTH            33
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+typedef struct FSMInstrBlock
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint transitionCount[FSM_NUM_STATES][FSM_NUM_EVENTS];
+  atomic_uint                               invalidCount[FSM_NUM_STATES];
+  atomic_ullong                             timeInState[FSM_NUM_STATES];
+  atomic_ullong                             entryHist[FSM_INSTR_HIST_LENGTH];
+  atomic_ullong                             exitHist[FSM_INSTR_HIST_LENGTH];
+}
+FSMInstrBlock;
+
+typedef struct FSMInstrSnapshot
+{
+  U8 transitionCount[FSM_NUM_STATES][FSM_NUM_EVENTS];
+  U8 invalidCount[FSM_NUM_STATES];
+  U8 timeInState[FSM_NUM_STATES];
+  U8 entryHist[FSM_INSTR_HIST_LENGTH];
+  U8 exitHist[FSM_INSTR_HIST_LENGTH];
+  U4 queueHighWater;
+}
+FSMInstrSnapshot;
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern _Thread_local FSMInstrBlock* fsm_tp_instrBlock;
+extern _Thread_local U1 u1_tp_instrShared;
+extern atomic_uint u4_sa_instrEntryTicks[FSM_NUM_INSTANCES];
+extern atomic_uint u4_sa_instrQueueHighWater[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: instr_fsm_claimBlock                                  */
+/*  Purpose:       Assign a free counter block to the calling thread     */
+/*                 until it exits, or the shared block if none is free.  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSMInstrBlock* of the calling thread                  */
+/*************************************************************************/
+FSMInstrBlock* instr_fsm_claimBlock(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_instrSnapshot                                  */
+/*  Purpose:       Sum the counters of all threads. Does not stop the    */
+/*                 machines, each counter is read atomically but the     */
+/*                 snapshot as a whole is not.                           */
+/*  Arguments:     FSMInstrSnapshot* snapshot:                           */
+/*                    Filled with the totals.                            */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_instrSnapshot(FSMInstrSnapshot* snapshot);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_instrQueueHighWater                            */
+/*  Purpose:       Return the deepest queue seen after registering an    */
+/*                 event for an instance.                                */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 events                                             */
+/*************************************************************************/
+U4 u4_fsm_instrQueueHighWater(FSM_INST inst);
+
+/*************************************************************************/
+/*  Recorders called from fsm.c                                          */
+/*************************************************************************/
+/* Counters of an own block have a single writer, so a relaxed load and
+   store is enough and avoids a locked read-modify-write. The shared last
+   block has several writers and needs the atomic add. */
+#define FSM_INSTR_ADD(counter, value) \
+  ((u1_tp_instrShared == FSM_FALSE) ? \
+   atomic_store_explicit(&(counter), atomic_load_explicit(&(counter), memory_order_relaxed) + (value), \
+                         memory_order_relaxed) : \
+   (void)atomic_fetch_add_explicit(&(counter), (value), memory_order_relaxed))
+
+static inline FSMInstrBlock* instr_fsm_block(void)
+{
+  return ((fsm_tp_instrBlock != NULL) ? fsm_tp_instrBlock : instr_fsm_claimBlock());
+}
+
+static inline U4 u4_fsm_instrHistBucket(unsigned int ticks)
+{
+#if defined(__GNUC__)
+  return ((ticks == 0) ? 0 : (U4)(32 - __builtin_clz(ticks)));
+#else
+  U4 u4_t_bucket;
+
+  for(u4_t_bucket = 0; ticks != 0; u4_t_bucket++)
+  {
+    ticks >>= 1;
+  }
+
+  return (u4_t_bucket);
+#endif
+}
+
+static inline void vd_fsm_instrInvalid(FSM_STATE_IDX state)
+{
+  FSM_INSTR_ADD(instr_fsm_block()->invalidCount[state], 1);
+}
+
+static inline void vd_fsm_instrTransition(FSM_INST inst, FSM_STATE_IDX prevState, FSM_EVT evt, U4 ticks)
+{
+  FSMInstrBlock* fsm_t_block;
+  unsigned int u4_t_entryTicks;
+
+  fsm_t_block     = instr_fsm_block();
+  u4_t_entryTicks = atomic_load_explicit(&u4_sa_instrEntryTicks[inst], memory_order_relaxed);
+
+  FSM_INSTR_ADD(fsm_t_block->transitionCount[prevState][evt], 1);
+  FSM_INSTR_ADD(fsm_t_block->timeInState[prevState], (unsigned int)ticks - u4_t_entryTicks);
+  atomic_store_explicit(&u4_sa_instrEntryTicks[inst], (unsigned int)ticks, memory_order_relaxed);
+}
+
+static inline void vd_fsm_instrExit(U4 startTicks, U4 endTicks)
+{
+  FSM_INSTR_ADD(instr_fsm_block()->exitHist[u4_fsm_instrHistBucket((unsigned int)(endTicks - startTicks))], 1);
+}
+
+static inline void vd_fsm_instrEntry(U4 startTicks, U4 endTicks)
+{
+  FSM_INSTR_ADD(instr_fsm_block()->entryHist[u4_fsm_instrHistBucket((unsigned int)(endTicks - startTicks))], 1);
+}
+
+/* Called by every producer after a put, so the maximum is raised with a
+   compare and swap. */
+static inline void vd_fsm_instrQueueDepth(FSM_INST inst, U4 depth)
+{
+  unsigned int u4_t_highWater;
+
+  u4_t_highWater = atomic_load_explicit(&u4_sa_instrQueueHighWater[inst], memory_order_relaxed);
+
+  while(((unsigned int)depth > u4_t_highWater) &&
+        (atomic_compare_exchange_weak_explicit(&u4_sa_instrQueueHighWater[inst], &u4_t_highWater,
+                                               (unsigned int)depth, memory_order_relaxed,
+                                               memory_order_relaxed) == 0))
+  {
+
+  }
+}
+
+static inline void vd_fsm_instrResetInst(FSM_INST inst)
+{
+  atomic_store_explicit(&u4_sa_instrEntryTicks[inst], (unsigned int)u4_fsm_getTicks(), memory_order_relaxed);
+  atomic_store_explicit(&u4_sa_instrQueueHighWater[inst], 0, memory_order_relaxed);
+}
+
+#endif
+
+#endif
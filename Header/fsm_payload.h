@@ -0,0 +1,106 @@
+/*************************************************************************/
+/*  File Name: fsm_payload.h                                             */
+/*  Purpose: Optional event payloads for the FSM module, compiled in     */
+/*           with FSM_CFG_PAYLOAD. Payload buffers come from a fixed     */
+/*           pool with a lock-free free list, are queued by handle and   */
+/*           handed to the callbacks by pointer.                         */
+/*************************************************************************/
+
+#ifndef fsm_payload_h
+#define fsm_payload_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_PAYLOAD
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Number of payload buffers, at most 0xFFFF.                            */
+#ifndef FSM_PAYLOAD_COUNT
+#define FSM_PAYLOAD_COUNT                64
+#endif
+
+/* Bytes per payload buffer. Buffers are cache line aligned. */
+#ifndef FSM_PAYLOAD_SIZE
+#define FSM_PAYLOAD_SIZE                 64
+#endif
+
+/* Payload bitset, one bit per buffer. */
+#define FSM_PAYLOAD_SET_LENGTH           ((FSM_PAYLOAD_COUNT + 7) / 8)
+#define FSM_PAYLOAD_SET_BIT(payload)     (1u << ((payload) & 7))
+#define FSM_PAYLOAD_SET_BYTE(payload)    ((payload) >> 3)
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+typedef struct FSMPayloadBuf
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) U1 data[FSM_PAYLOAD_SIZE];
+}
+FSMPayloadBuf;
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern FSMPayloadBuf fsm_sas_payloadPool[FSM_PAYLOAD_COUNT];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadInit                                    */
+/*  Purpose:       Return all buffers to the pool. Called by             */
+/*                 vd_fsm_init().                                        */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadInit(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadReserve                                 */
+/*  Purpose:       Rebuild the pool with the buffers marked in usedSet   */
+/*                 taken and all others free, for a restored snapshot.   */
+/*                 Only while no thread allocates or frees.              */
+/*  Arguments:     const U1* usedSet:                                    */
+/*                    FSM_PAYLOAD_SET_LENGTH bytes, bit payload % 8 of   */
+/*                    byte payload / 8 set for a buffer in use.          */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadReserve(const U1* usedSet);
+
+/*************************************************************************/
+/*  Function Name: pld_fsm_payloadAlloc                                  */
+/*  Purpose:       Take a buffer from the pool. Safe from any thread.    */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSM_PAYLOAD handle    OR                              */
+/*                 FSM_PAYLOAD_NONE if the pool is empty                 */
+/*************************************************************************/
+FSM_PAYLOAD pld_fsm_payloadAlloc(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadFree                                    */
+/*  Purpose:       Return a buffer to the pool. Safe from any thread.    */
+/*  Arguments:     FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc(), or             */
+/*                    FSM_PAYLOAD_NONE which is ignored.                 */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadFree(FSM_PAYLOAD payload);
+
+/*************************************************************************/
+/*  Function Name: pv_fsm_payloadGet                                     */
+/*  Purpose:       Return the buffer of a handle.                        */
+/*  Arguments:     FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc().                */
+/*  Return:        void* FSM_PAYLOAD_SIZE bytes    OR                    */
+/*                       NULL for FSM_PAYLOAD_NONE                       */
+/*************************************************************************/
+static inline void* pv_fsm_payloadGet(FSM_PAYLOAD payload)
+{
+  return ((payload < FSM_PAYLOAD_COUNT) ? (void*)fsm_sas_payloadPool[payload].data : (void*)0);
+}
+
+#endif
+
+#endif
@@ -0,0 +1,233 @@
+/*************************************************************************/
+/*  File Name: fsm_snapshot.h                                            */
+/*  Purpose: Optional checkpoint of all FSM instances, compiled in with  */
+/*           FSM_CFG_SNAPSHOT. Current and previous state, the instance  */
+/*           pool, queued and deferred events, payload buffers and       */
+/*           timers are written into one versioned binary image, one     */
+/*           array per field. A restore checks the image against the     */
+/*           table and build, then copies it back without calling entry  */
+/*           or exit callbacks.                                          */
+/*           With FSM_CFG_COALESCE, counted events restore with a count  */
+/*           of 1.                                                       */
+/*************************************************************************/
+
+#ifndef fsm_snapshot_h
+#define fsm_snapshot_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_SNAPSHOT
+
+#include <string.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define FSM_SNAPSHOT_MAGIC               0x534D5346u
+#define FSM_SNAPSHOT_VERSION             1
+
+/* Size of the temporary file name u1_fsm_snapshotSave() builds from its
+   path. */
+#ifndef FSM_SNAPSHOT_PATH_LENGTH
+#define FSM_SNAPSHOT_PATH_LENGTH         256
+#endif
+
+/* Sections start at multiples of this, from the start of the image. */
+#define FSM_SNAPSHOT_ALIGN               64
+
+/* Index into FSMSnapshotHeader.section. */
+#define FSM_SNAPSHOT_SEC_CURRENT         0
+#define FSM_SNAPSHOT_SEC_PREV            1
+#define FSM_SNAPSHOT_SEC_NEXT_FREE       2
+#define FSM_SNAPSHOT_SEC_QUEUE_COUNT     3
+#define FSM_SNAPSHOT_SEC_DEFER_COUNT     4
+#define FSM_SNAPSHOT_SEC_DEFER_ITEM      5
+#define FSM_SNAPSHOT_SEC_TIMER           6
+#define FSM_SNAPSHOT_SEC_PAYLOAD         7
+#define FSM_SNAPSHOT_SEC_QUEUE_ITEM      8
+#define FSM_SNAPSHOT_SECTIONS            12
+
+/* FSMSnapshotHeader.features, optional features of the writing build
+   that change the image. */
+#define FSM_SNAPSHOT_FEATURE_PAYLOAD     0x01u
+#define FSM_SNAPSHOT_FEATURE_DEFER       0x02u
+#define FSM_SNAPSHOT_FEATURE_TIMER       0x04u
+
+#define FSM_SNAPSHOT_OK                  0
+#define FSM_SNAPSHOT_IO_ERROR            1
+#define FSM_SNAPSHOT_BAD_IMAGE           2
+#define FSM_SNAPSHOT_TABLE_MISMATCH      3
+#define FSM_SNAPSHOT_CONFIG_MISMATCH     4
+#define FSM_SNAPSHOT_NO_SPACE            5
+#define FSM_SNAPSHOT_ASYNC_PENDING       6
+
+/* Called for every restored instance with queued events, so an executor
+   picks them up. vd_fsm_execNotify(inst) with FSM_CFG_EXECUTOR,
+   vd_fsm_waitNotify(inst) with FSM_CFG_WAIT. */
+#ifndef vd_fsm_snapshotNotify
+#ifdef FSM_CFG_EXECUTOR
+#define vd_fsm_snapshotNotify(inst)      vd_fsm_execNotify(inst)
+#elif defined(FSM_CFG_WAIT)
+#define vd_fsm_snapshotNotify(inst)      vd_fsm_waitNotify(inst)
+#else
+#define vd_fsm_snapshotNotify(inst)
+#endif
+#endif
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+/* Image layout, native byte order: this header, then the sections at
+   section[] offsets, 0 for one this build does not have. Per instance
+   arrays hold numInstances entries:
+   CURRENT, PREV    FSM_STATE_IDX state
+   NEXT_FREE        FSM_INST pool link, the free list starts at freeHead
+   QUEUE_COUNT      U4 queued events
+   DEFER_COUNT      U1 deferred events
+   DEFER_ITEM       FSM_QUEUE_ITEM[deferLength] deferred events
+   TIMER            U4 ticks to expiry, 0 if expired and not served, or
+                    FSM_TIMER_NOT_ARMED
+   PAYLOAD          payloadCount buffers of payloadSize bytes
+   QUEUE_ITEM       numQueued FSM_QUEUE_ITEM, the queued events of each
+                    instance in serve order, instance by instance. Last,
+                    the image ends with it. */
+typedef struct FSMSnapshotHeader
+{
+  U4 magic;
+  U2 version;
+  U2 headerSize;
+  U8 fingerprint;
+  U8 imageSize;
+  U4 numInstances;
+  U4 numStates;
+  U4 numEvents;
+  U4 features;
+  U2 stateSize;
+  U2 instSize;
+  U2 itemSize;
+  U2 deferLength;
+  U4 payloadCount;
+  U4 payloadSize;
+  U4 freeHead;
+  U4 numQueued;
+  U8 section[FSM_SNAPSHOT_SECTIONS];
+}
+FSMSnapshotHeader;
+
+/* Pool arrays exchanged with fsm.c, each numInstances long. */
+typedef struct FSMSnapshotPool
+{
+  FSM_STATE_IDX*  currentState;
+  FSM_STATE_IDX*  prevState;
+  FSM_INST*       nextFree;
+  FSM_INST        freeHead;
+#ifdef FSM_CFG_DEFER
+  U1*             deferCount;
+  FSM_QUEUE_ITEM* deferItem;
+#endif
+}
+FSMSnapshotPool;
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u8_fsm_snapshotSize                                   */
+/*  Purpose:       Return the bytes an image of the current instances    */
+/*                 needs.                                                */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U8 image size                                         */
+/*************************************************************************/
+U8 u8_fsm_snapshotSize(void);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotWrite                                  */
+/*  Purpose:       Write an image of all instances into memory. Queued   */
+/*                 events are taken out and put back in order. Only      */
+/*                 while no thread serves, registers events or ticks     */
+/*                 timers.                                               */
+/*  Arguments:     void* image:                                          */
+/*                    Destination, 8 byte aligned.                       */
+/*                 U8 size:                                              */
+/*                    Bytes available, see u8_fsm_snapshotSize().        */
+/*                 U8* written:                                          */
+/*                    Image size out, may be NULL.                       */
+/*  Return:        U1 FSM_SNAPSHOT_OK              OR                    */
+/*                    FSM_SNAPSHOT_BAD_IMAGE       OR                    */
+/*                    FSM_SNAPSHOT_NO_SPACE        OR                    */
+/*                    FSM_SNAPSHOT_ASYNC_PENDING if an asynchronous      */
+/*                    action runs or its completion is not served yet    */
+/*************************************************************************/
+U1 u1_fsm_snapshotWrite(void* image, U8 size, U8* written);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotRead                                   */
+/*  Purpose:       Replace all instances with an image. The whole image  */
+/*                 is checked first, nothing changes if it is rejected.  */
+/*                 No entry or exit callback runs, timers continue with  */
+/*                 the ticks they had left. Same conditions as           */
+/*                 u1_fsm_snapshotWrite(), after vd_fsm_init().          */
+/*  Arguments:     const void* image:                                    */
+/*                    Image, 8 byte aligned.                             */
+/*                 U8 size:                                              */
+/*                    Bytes available.                                   */
+/*  Return:        U1 FSM_SNAPSHOT_OK                OR                  */
+/*                    FSM_SNAPSHOT_BAD_IMAGE         OR                  */
+/*                    FSM_SNAPSHOT_TABLE_MISMATCH    OR                  */
+/*                    FSM_SNAPSHOT_CONFIG_MISMATCH                       */
+/*************************************************************************/
+U1 u1_fsm_snapshotRead(const void* image, U8 size);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotSave                                   */
+/*  Purpose:       Write an image into a memory mapped temporary file    */
+/*                 next to path, flush it to disk and rename it to path. */
+/*                 A checkpoint already at path is replaced atomically   */
+/*                 and stays intact if saving fails.                     */
+/*  Arguments:     const char* path:                                     */
+/*                    File to create or replace, shorter than            */
+/*                    FSM_SNAPSHOT_PATH_LENGTH - 7 characters.           */
+/*  Return:        U1 FSM_SNAPSHOT_OK          OR                        */
+/*                    FSM_SNAPSHOT_IO_ERROR    OR                        */
+/*                    u1_fsm_snapshotWrite() status                      */
+/*************************************************************************/
+U1 u1_fsm_snapshotSave(const char* path);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotRestore                                */
+/*  Purpose:       Map an image file and restore it with                 */
+/*                 u1_fsm_snapshotRead().                                */
+/*  Arguments:     const char* path:                                     */
+/*                    File written by u1_fsm_snapshotSave().             */
+/*  Return:        U1 FSM_SNAPSHOT_OK          OR                        */
+/*                    FSM_SNAPSHOT_IO_ERROR    OR                        */
+/*                    u1_fsm_snapshotRead() status                       */
+/*************************************************************************/
+U1 u1_fsm_snapshotRestore(const char* path);
+
+/*************************************************************************/
+/*  Called by fsm_snapshot.c                                             */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_snapshotSavePool                               */
+/*  Purpose:       Copy the instance pool out of fsm.c.                  */
+/*  Arguments:     FSMSnapshotPool* pool:                                */
+/*                    Arrays to fill, freeHead is written.               */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_snapshotSavePool(FSMSnapshotPool* pool);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotLoadPool                               */
+/*  Purpose:       Check a saved instance pool and copy it into fsm.c.   */
+/*                 Event queues and timers are left to the caller.       */
+/*  Arguments:     const FSMSnapshotPool* pool:                          */
+/*                    Arrays to load.                                    */
+/*  Return:        U1 FSM_TRUE if loaded    OR                           */
+/*                    FSM_FALSE if invalid, nothing is changed           */
+/*************************************************************************/
+U1 u1_fsm_snapshotLoadPool(const FSMSnapshotPool* pool);
+
+#endif
+
+#endif
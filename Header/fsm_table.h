@@ -0,0 +1,53 @@
+/*************************************************************************/
+/*  File Name: fsm_table.h                                               */
+/*  Purpose: Auto-generated state table, do not modify.                  */
+/*           Generated by Tools/fsm_gen.py from                          */
+/*           fsm_example.fsm.                                            */
+/*************************************************************************/
+
+#ifndef fsm_table_h
+#define fsm_table_h
+
+/* State table dimensions, must match the enums below. FSM_TABLE_NNZ is
+   the number of transitions that are not FSM_EVT_INACTIVE. */
+#define FSM_STATE_COUNT                  2
+#define FSM_EVT_COUNT                    2
+#define FSM_TABLE_NNZ                    2
+
+/* Exit/entry chains of all transitions, FSM_CHAIN_LENGTH states in
+   total. */
+#define FSM_CHAIN_COUNT                  2
+#define FSM_CHAIN_LENGTH                 4
+
+/* Event priority levels, 0 is served last. */
+#define FSM_EVT_PRIORITY_COUNT           1
+
+/* Events coalesced as latest or count, one slot each per instance. */
+#define FSM_COALESCE_SLOT_COUNT          0
+
+/* Density 0.500 */
+#define FSM_TABLE_FORMAT                 FSM_TABLE_DENSE
+
+typedef enum FSM_EVT
+{
+  FSM_EVT_0 = 0,
+  FSM_EVT_1,
+
+  FSM_NUM_EVENTS,
+  FSM_EVT_INACTIVE,
+  FSM_EVT_NULL
+}
+FSM_EVT;
+
+typedef enum FSM_STATE
+{
+  FSM_STATE_0 = 0,
+  FSM_STATE_1,
+
+  FSM_NUM_STATES
+}
+FSM_STATE;
+
+#define FSM_STATE_INITIAL                FSM_STATE_0
+
+#endif
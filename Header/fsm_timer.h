@@ -0,0 +1,168 @@
+/*************************************************************************/
+/*  File Name: fsm_timer.h                                               */
+/*  Purpose: Optional state timeouts for the FSM module, compiled in     */
+/*           with FSM_CFG_TIMER. Entering a state with a timeout in      */
+/*           fsm_sas_fsmTimeout arms a timer for the instance, leaving   */
+/*           it cancels the timer. Timers are kept in a hierarchical     */
+/*           timing wheel driven by vd_fsm_timerTick(). An expired timer */
+/*           leaves the timeout event in a slot of the instance, served  */
+/*           once no queued event is waiting. Leaving the state empties  */
+/*           the slot, so a timeout is never served in another state.    */
+/*************************************************************************/
+
+#ifndef fsm_timer_h
+#define fsm_timer_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_TIMER
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Wheel geometry: FSM_TIMER_LEVELS levels of 2^FSM_TIMER_SLOT_BITS slots.
+   Level n slots are 2^(n * FSM_TIMER_SLOT_BITS) ticks wide. Timeouts past
+   the top level are parked in its last slot and re-sorted as it turns. */
+#define FSM_TIMER_SLOT_BITS              6
+#define FSM_TIMER_SLOTS                  (1 << FSM_TIMER_SLOT_BITS)
+#define FSM_TIMER_SLOT_MASK              (FSM_TIMER_SLOTS - 1)
+#define FSM_TIMER_LEVELS                 4
+
+/* Replace with API for mutual exclusion between the tick source and the
+   threads serving events, default is a spin lock. Kept apart from
+   fsm_enterCritical() because u1_fsm_instServeEvtQueue() already holds
+   that while arming timers. */
+#ifndef fsm_timerEnterCritical
+#define fsm_timerEnterCritical()         vd_fsm_timerSpinLock()
+#define fsm_timerExitCritical()          vd_fsm_timerSpinUnlock()
+#endif
+
+/* Replace with a hook that wakes whoever serves instance inst, called
+   after a timer expired, outside the timer lock. May block.
+   vd_fsm_execNotify(inst) with FSM_CFG_EXECUTOR, vd_fsm_waitNotify(inst)
+   with FSM_CFG_WAIT. */
+#ifndef vd_fsm_timerNotify
+#ifdef FSM_CFG_EXECUTOR
+#define vd_fsm_timerNotify(inst)         vd_fsm_execNotify(inst)
+#elif defined(FSM_CFG_WAIT)
+#define vd_fsm_timerNotify(inst)         vd_fsm_waitNotify(inst)
+#else
+#define vd_fsm_timerNotify(inst)
+#endif
+#endif
+
+#define FSM_TIMER_NOT_ARMED              (-1)
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern atomic_uchar u1_sa_timerExpired[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerInit                                      */
+/*  Purpose:       Cancel all timers and reset the wheel to tick 0.      */
+/*                 Called by vd_fsm_init().                              */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerInit(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerArm                                       */
+/*  Purpose:       Cancel the timer of an instance and arm it again for  */
+/*                 the timeout of a state, if it has one. Called by      */
+/*                 fsm.c on state entry.                                 */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_STATE_IDX state:                                  */
+/*                    State entered.                                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerArm(FSM_INST inst, FSM_STATE_IDX state);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerArmTicks                                  */
+/*  Purpose:       Cancel the timer of an instance and arm it again to   */
+/*                 expire with evt in ticks ticks, for a restored        */
+/*                 snapshot.                                             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 ticks:                                             */
+/*                    Ticks from now, 0 for a timeout that has expired   */
+/*                    and waits to be served.                            */
+/*                 FSM_EVT evt:                                          */
+/*                    Timeout event.                                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerArmTicks(FSM_INST inst, U4 ticks, FSM_EVT evt);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerCancel                                    */
+/*  Purpose:       Cancel the timer of an instance, if armed, and drop   */
+/*                 its timeout if it expired and was not served yet.     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerCancel(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerTick                                      */
+/*  Purpose:       Advance the wheel by one tick and expire every timer  */
+/*                 due. Call from a single tick source.                  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerTick(void);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_timerRemaining                                 */
+/*  Purpose:       Return ticks until the timer of an instance expires.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 ticks, 0 if expired and not served yet    OR       */
+/*                    FSM_TIMER_NOT_ARMED                                */
+/*************************************************************************/
+U4 u4_fsm_timerRemaining(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_timerTakeSlot                                 */
+/*  Purpose:       Empty the expired timeout slot of an instance.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        FSM_QUEUE_ITEM timeout event    OR                    */
+/*                 FSM_QUEUE_ITEM_NULL if cancelled meanwhile            */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_timerTakeSlot(FSM_INST inst);
+
+/* Default fsm_timerEnterCritical()/fsm_timerExitCritical(). */
+void vd_fsm_timerSpinLock(void);
+void vd_fsm_timerSpinUnlock(void);
+
+/* Expired timeout of an instance, or FSM_QUEUE_ITEM_NULL. One load when
+   none has expired. */
+static inline FSM_QUEUE_ITEM evt_fsm_timerTake(FSM_INST inst)
+{
+  return ((atomic_load_explicit(&u1_sa_timerExpired[inst], memory_order_relaxed) == FSM_TRUE) ?
+          evt_fsm_timerTakeSlot(inst) : FSM_QUEUE_ITEM_NULL);
+}
+
+/* Expired timeout waiting in the slot of an instance. */
+static inline U1 u1_fsm_timerReady(FSM_INST inst)
+{
+  return ((atomic_load_explicit(&u1_sa_timerExpired[inst], memory_order_acquire) == FSM_TRUE) ? FSM_TRUE : FSM_FALSE);
+}
+
+#else
+
+/* Without FSM_CFG_TIMER no timeout ever waits. */
+#define u1_fsm_timerReady(inst)          (FSM_FALSE)
+
+#endif
+
+#endif
@@ -0,0 +1,221 @@
+/*************************************************************************/
+/*  File Name: fsm_trace.h                                               */
+/*  Purpose: Optional transition trace for the FSM module, compiled in   */
+/*           with FSM_CFG_TRACE. Every served event is written as a      */
+/*           16 byte record into a ring of the serving thread, with no   */
+/*           lock and no system call. u4_fsm_traceFlush() moves the      */
+/*           records of all rings into a memory mapped trace file, which */
+/*           Tools/fsm_replay.c checks against the state table.          */
+/*************************************************************************/
+
+#ifndef fsm_trace_h
+#define fsm_trace_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_TRACE
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Number of rings. Each thread serving events takes one on first use and
+   gives it back when it exits. Records are dropped while all rings are
+   taken by live threads. */
+#ifndef FSM_TRACE_MAX_THREADS
+#define FSM_TRACE_MAX_THREADS            8
+#endif
+
+/* Records per ring, a power of 2. A full ring drops new records until
+   the next flush. */
+#ifndef FSM_TRACE_RING_LENGTH
+#define FSM_TRACE_RING_LENGTH            4096
+#endif
+
+#define FSM_TRACE_MAGIC                  0x544D5346u
+#define FSM_TRACE_VERSION                2
+
+/* toState of an event without a transition. */
+#define FSM_TRACE_STATE_NONE             0xFFFFu
+
+/* evt of a record written when an instance is reset to the initial
+   state, fromState is the state it left. */
+#define FSM_TRACE_EVT_RESET              0xFFFFu
+
+#define FSM_TRACE_OPENED                 0
+#define FSM_TRACE_OPEN_FAILED            1
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+/* Trace file layout, native byte order: one FSMTraceHeader, then
+   numRecords records. Records of one thread are in order, records of
+   different threads are interleaved in flush order. tickDelta is the
+   u4_fsm_getTicks() count since the previous record of the same thread,
+   or since startTicks for its first one. In the ring it holds the
+   absolute count, u4_fsm_traceFlush() converts it. thread is the ring,
+   which a later thread takes over once its owner has exited. */
+typedef struct FSMTraceRecord
+{
+  U4 tickDelta;
+  U4 inst;
+  U2 evt;
+  U2 fromState;
+  U2 toState;
+  U2 thread;
+}
+FSMTraceRecord;
+
+/* fingerprint is u8_fsm_tableFingerprint() of the recording build,
+   numInstances bounds the inst of every record, dropped counts records
+   lost to full rings, missing rings or a full file. */
+typedef struct FSMTraceHeader
+{
+  U4 magic;
+  U2 version;
+  U2 recordSize;
+  U4 numStates;
+  U4 numEvents;
+  U8 fingerprint;
+  U4 startTicks;
+  U4 numThreads;
+  U8 capacity;
+  U8 numRecords;
+  U8 dropped;
+  U4 numInstances;
+  U4 reserved;
+}
+FSMTraceHeader;
+
+/* Single producer, the owning thread, single consumer, the flush. */
+typedef struct FSMTraceRing
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint head;
+  atomic_ullong                             dropped;
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint tail;
+  FSMTraceRecord                            record[FSM_TRACE_RING_LENGTH];
+}
+FSMTraceRing;
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern FSMTraceRing fsm_sas_traceRing[FSM_TRACE_MAX_THREADS];
+extern _Thread_local U4 u4_tp_traceRing;
+extern _Thread_local unsigned int u4_tp_traceRingReleases;
+extern atomic_uint u4_s_traceRingReleases;
+extern atomic_uchar u1_s_traceActive;
+extern atomic_ullong u8_s_traceDropped;
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u1_fsm_traceOpen                                      */
+/*  Purpose:       Create a trace file, map it and start recording.      */
+/*                 Records still in the rings are discarded.             */
+/*  Arguments:     const char* path:                                     */
+/*                    File to create, truncated if it exists.            */
+/*                 U8 capacity:                                          */
+/*                    Max records in the file, later ones are dropped.   */
+/*  Return:        U1 FSM_TRACE_OPENED    OR                             */
+/*                    FSM_TRACE_OPEN_FAILED                              */
+/*************************************************************************/
+U1 u1_fsm_traceOpen(const char* path, U8 capacity);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_traceFlush                                     */
+/*  Purpose:       Copy the records of all rings into the trace file and */
+/*                 update its header. Safe from any thread, concurrent   */
+/*                 flushes are serialized.                               */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U4 records written                                    */
+/*************************************************************************/
+U4 u4_fsm_traceFlush(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_traceClose                                     */
+/*  Purpose:       Stop recording, flush, and cut the file to the        */
+/*                 records written.                                      */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_traceClose(void);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_traceClaimRing                                 */
+/*  Purpose:       Assign a free ring to the calling thread until it     */
+/*                 exits. If none is free, records are dropped without   */
+/*                 trying again until another thread releases its ring.  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U4 ring number + 1    OR                              */
+/*                    FSM_TRACE_MAX_THREADS + 1 if none is left          */
+/*************************************************************************/
+U4 u4_fsm_traceClaimRing(void);
+
+/*************************************************************************/
+/*  Recorders called from fsm.c                                          */
+/*************************************************************************/
+static inline void vd_fsm_traceRecord(FSM_INST inst, U4 evt, U4 fromState, U4 toState)
+{
+  FSMTraceRing* fsm_t_ring;
+  FSMTraceRecord* fsm_t_record;
+  unsigned int u4_t_head;
+  U4 u4_t_ring;
+
+  if(atomic_load_explicit(&u1_s_traceActive, memory_order_relaxed) != FSM_FALSE)
+  {
+    u4_t_ring = u4_tp_traceRing;
+
+    /* A failed claim is cached, a ring released since may be free. */
+    if((u4_t_ring == 0) ||
+       ((u4_t_ring > FSM_TRACE_MAX_THREADS) &&
+        (atomic_load_explicit(&u4_s_traceRingReleases, memory_order_relaxed) != u4_tp_traceRingReleases)))
+    {
+      u4_t_ring = u4_fsm_traceClaimRing();
+    }
+    else
+    {
+
+    }
+
+    if(u4_t_ring <= FSM_TRACE_MAX_THREADS)
+    {
+      fsm_t_ring = &fsm_sas_traceRing[u4_t_ring - 1];
+      u4_t_head  = atomic_load_explicit(&fsm_t_ring->head, memory_order_relaxed);
+
+      if((u4_t_head - atomic_load_explicit(&fsm_t_ring->tail, memory_order_acquire)) < FSM_TRACE_RING_LENGTH)
+      {
+        fsm_t_record            = &fsm_t_ring->record[u4_t_head & (FSM_TRACE_RING_LENGTH - 1)];
+        fsm_t_record->tickDelta = u4_fsm_getTicks();
+        fsm_t_record->inst      = inst;
+        fsm_t_record->evt       = (U2)evt;
+        fsm_t_record->fromState = (U2)fromState;
+        fsm_t_record->toState   = (U2)toState;
+        fsm_t_record->thread    = (U2)(u4_t_ring - 1);
+
+        atomic_store_explicit(&fsm_t_ring->head, u4_t_head + 1, memory_order_release);
+      }
+      /* Single writer, see FSM_INSTR_ADD. */
+      else
+      {
+        atomic_store_explicit(&fsm_t_ring->dropped,
+                              atomic_load_explicit(&fsm_t_ring->dropped, memory_order_relaxed) + 1,
+                              memory_order_relaxed);
+      }
+    }
+    else
+    {
+      atomic_fetch_add_explicit(&u8_s_traceDropped, 1, memory_order_relaxed);
+    }
+  }
+  else
+  {
+
+  }
+}
+
+#endif
+
+#endif
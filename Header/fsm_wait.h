@@ -0,0 +1,146 @@
+/*************************************************************************/
+/*  File Name: fsm_wait.h                                                */
+/*  Purpose: Optional blocking wait for the FSM module, compiled in with */
+/*           FSM_CFG_WAIT. Each instance has an eventfd, opened on first */
+/*           use and closed by vd_fsm_destroy(), that a thread waiting   */
+/*           for events sleeps on. The waiting thread arms the instance  */
+/*           before it sleeps, producers only signal the eventfd when    */
+/*           they find it armed and disarm it in the same step, so a     */
+/*           burst of events costs one system call at most. The eventfd  */
+/*           can be added to an existing epoll or poll loop through      */
+/*           u4_fsm_waitFd() and u1_fsm_waitArm(). Needs Linux.          */
+/*************************************************************************/
+
+#ifndef fsm_wait_h
+#define fsm_wait_h
+
+#include "fsm.h"
+
+#ifdef FSM_CFG_WAIT
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Timeout of u1_fsm_waitEvt() that never expires.                       */
+#define FSM_WAIT_FOREVER                 (-1)
+
+#define FSM_WAIT_EVT_READY               0
+#define FSM_WAIT_TIMEOUT                 1
+
+#define FSM_WAIT_NO_FD                   (-1)
+
+/*************************************************************************/
+/*  Public Variables                                                     */
+/*************************************************************************/
+extern atomic_uchar u1_sa_waitArmed[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitInit                                       */
+/*  Purpose:       Reset the wait state of every instance, emptying the  */
+/*                 eventfds opened so far. Called by vd_fsm_init().      */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitInit(void);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitClose                                      */
+/*  Purpose:       Close the eventfd of an instance and reset its wait   */
+/*                 state. Called by vd_fsm_destroy(), no thread may wait */
+/*                 for the instance.                                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitClose(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_waitFd                                         */
+/*  Purpose:       Return the eventfd of an instance, readable after a   */
+/*                 producer found the instance armed. Opened on the      */
+/*                 first call.                                           */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 file descriptor    OR                              */
+/*                    FSM_WAIT_NO_FD if it could not be opened or inst   */
+/*                    is out of range                                    */
+/*************************************************************************/
+U4 u4_fsm_waitFd(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_waitArm                                        */
+/*  Purpose:       Arm an instance before sleeping on its eventfd in an  */
+/*                 epoll or poll loop, and empty the eventfd of a signal */
+/*                 already taken. Only the thread serving the instance.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_TRUE if armed, the eventfd becomes readable    */
+/*                    with the next event    OR                          */
+/*                    FSM_FALSE if events are waiting, serve them first  */
+/*************************************************************************/
+U1 u1_fsm_waitArm(FSM_INST inst);
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_waitEvt                                        */
+/*  Purpose:       Block until an instance has events to serve. Spins    */
+/*                 first if vd_fsm_waitSetSpin() gave it a budget. Only  */
+/*                 the thread serving the instance.                      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 timeoutMs:                                         */
+/*                    Max milliseconds to block, or FSM_WAIT_FOREVER.    */
+/*  Return:        U1 FSM_WAIT_EVT_READY    OR                           */
+/*                    FSM_WAIT_TIMEOUT                                   */
+/*************************************************************************/
+U1 u1_fsm_waitEvt(FSM_INST inst, U4 timeoutMs);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitSetSpin                                    */
+/*  Purpose:       Let u1_fsm_waitEvt() poll the queue of an instance up */
+/*                 to maxSpins times before it blocks. The budget adapts */
+/*                 between 0 and maxSpins: it doubles when events arrive */
+/*                 while spinning and halves when the wait blocks.       */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 maxSpins:                                          */
+/*                    0 to always block at once, the default.            */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitSetSpin(FSM_INST inst, U4 maxSpins);
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitSignal                                     */
+/*  Purpose:       Make the eventfd of an instance readable.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitSignal(FSM_INST inst);
+
+/* Wake the thread waiting for an instance, called after an event is put
+   into its queue. One load when the instance is not armed. Pairs with the
+   fence in u1_fsm_waitArm(): either the waiting thread sees the event, or
+   this thread sees it armed. */
+static inline void vd_fsm_waitNotify(FSM_INST inst)
+{
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if((atomic_load_explicit(&u1_sa_waitArmed[inst], memory_order_relaxed) == FSM_TRUE) &&
+     (atomic_exchange(&u1_sa_waitArmed[inst], FSM_FALSE) == FSM_TRUE))
+  {
+    vd_fsm_waitSignal(inst);
+  }
+  else
+  {
+
+  }
+}
+
+#endif
+
+#endif
@@ -1,262 +1,1722 @@
-/*************************************************************************/
-/*  File Name: fsm.c                                                     */
-/*  Purpose: Source file for FSM module. Module designed to be integrated*/
-/*           with any RTOS or used bare metal, only handlers and queue   */
-/*           functions need to be defined in fsm.h.                      */
-/*  Created by: Garrett Sculthorpe on 10/20/20.                          */
-/*  Copyright © 2020 Garrett Sculthorpe.                                 */
-/*              All rights reserved.                                     */
-/*************************************************************************/
-
-/*************************************************************************/
-/*  Includes                                                             */
-/*************************************************************************/
-#include "fsm.h"
-#include "fsm_stub.h"
-
-/*************************************************************************/
-/*  Definitions                                                          */
-/*************************************************************************/
-#define FSM_MARKED_STATE   1
-#define FSM_UNMARKED_STATE 0
-#define FSM_NULL           0
-
-/*************************************************************************/
-/*  Private Data Types                                                   */
-/*************************************************************************/
-typedef struct FSMStateRoutines
-{
-  void (*entryFunction)(U1 reentrySts);
-  void (*exitFunction)(void);
-}
-FSMStateRoutines;
-
-typedef struct FSMState
-{
-  U1                markedState;
-  FSMStateRoutines* stateFunctions;
-  U4                eventList[FSM_NUM_EVENTS];
-}
-FSMState;
-
-/*************************************************************************/
-/*  Static Global Variables, Constants                                   */
-/*************************************************************************/
-static FSM_STATE state_s_currentState;
-static FSM_STATE state_s_prevState;
-
-static FSMStateRoutines fsm_sas_fp[FSM_NUM_STATES] = {FSM_NULL};
-
-
-/*************************************************************************/
-/*************************************************************************/
-/* Auto-generated state table, do not modify                             */
-/*************************************************************************/
-/*************************************************************************/
-const FSMState fsm_sas_fsmTable[FSM_NUM_STATES] =
-{   /* Marked status   Pointer to entry/exit APIs  Transition: 0          1
-  {
-    FSM_MARKED_STATE, &fsm_sas_fp[FSM_STATE_0],   {FSM_EVT_INACTIVE, FSM_STATE_1}
-  },
-  {
-    FSM_UNMARKED_STATE, &fsm_sas_fp[FSM_STATE_1], {FSM_STATE_0,      FSM_EVT_INACTIVE}
-  }
-};
-/*************************************************************************/
-/*************************************************************************/
-
-
-/*************************************************************************/
-/*  Private Function Prototypes                                          */
-/*************************************************************************/
-
-
-/*************************************************************************/
-
-/*************************************************************************/
-/*  Function Name: vd_fsm_init                                           */
-/*  Purpose:       Initialize module variables.                          */
-/*  Arguments:     N/A                                                   */
-/*  Return:        N/A                                                   */
-/*************************************************************************/
-void vd_fsm_init(void)
-{
-  state_s_currentState      = FSM_STATE_0;
-  state_s_prevState = FSM_EVT_NULL;
-}
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_setStateFp                                     */
-/*  Purpose:       Set function pointers for state entry/exit.           */
-/*  Arguments:     U4 state:                                             */
-/*                    State for which functions will be defined.         */
-/*                 U1 entryOrExit:                                       */
-/*                    FSM_STATE_SET_ENTRY_FUNC   OR                      */
-/*                    FSM_STATE_SET_EXIT_FUNC                            */
-/*                 void (*fp):                                           */
-/*                    Pointer to routine. Entry() has U1 argument.       */
-/*  Return:        U1 FSM_STATE_SET_FUNC_INV_SET       OR                */
-/*                    FSM_STATE_SET_FUNC_INV_STATE     OR                */
-/*                    FSM_STATE_SET_FUNC_SUCCESS                         */
-/*************************************************************************/
-U1 u1_fsm_setStateFp(U4 state, U1 entryOrExit, void (*fp))
-{
-  U1 u1_t_rtnSts;
-
-  /* Check valid state. */
-  if(state < FSM_NUM_STATES)
-  {
-    u1_t_rtnSts = FSM_STATE_SET_FUNC_SUCCESS;
-
-    fsm_enterCritical();
-
-    /* Entry or exit callback? */
-    if(entryOrExit == FSM_STATE_SET_ENTRY_FUNC)
-    {
-      fsm_sas_fsmTable[state].stateFunctions->entryFunction = fp;
-    }
-    else if(entryOrExit == FSM_STATE_SET_EXIT_FUNC)
-    {
-      fsm_sas_fsmTable[state].stateFunctions->exitFunction = fp;
-    }
-    /* Invalid param. */
-    else
-    {
-      u1_t_rtnSts = FSM_STATE_SET_FUNC_INV_SET;
-    }
-
-    fsm_exitCritical();
-  }
-  else
-  {
-    u1_t_rtnSts = FSM_STATE_SET_FUNC_INV_STATE;
-  }
-
-  return (u1_t_rtnSts);
-}
-
-/*************************************************************************/
-/*  Function Name: state_fsm_getCurrentState                             */
-/*  Purpose:       Return current state of FSM.                          */
-/*  Arguments:     N/A                                                   */
-/*  Return:        enum FSM_STATE                                        */
-/*************************************************************************/
-FSM_STATE state_fsm_getCurrentState(void)
-{
-  FSM_STATE state_t_currentState;
-
-  fsm_enterCritical();
-
-  state_t_currentState = state_s_currentState;
-
-  fsm_exitCritical();
-
-  return state_t_currentState;
-}
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_registerEvt                                    */
-/*  Purpose:       Register an event. Wraps event queue API.             */
-/*  Arguments:     FSM_EVT evt:                                          */
-/*                    Event number defined in enum FSM_EVT.              */
-/*  Return:        Return value from wrapped queue API.                  */
-/*************************************************************************/
-U1 u1_fsm_registerEvt(FSM_EVT evt)
-{
-  return u1_fsm_evtQueuePut(evt);
-}
-
-/*************************************************************************/
-/*  Function Name: u1_fsm_serveEvtQueue                                  */
-/*  Purpose:       Serve waiting events in event queue. Will run until   */
-/*                 error or empty. Calls vd_fsm_invalidEvtHandler() hook */
-/*                 if event is invalid at current state.                 */
-/*  Arguments:     N/A                                                   */
-/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
-/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
-/*************************************************************************/
-U1 u1_fsm_serveEvtQueue(void)
-{
-  FSM_EVT evt_s_nextEvent;
-  U1 u1_t_reentrySts;
-  U1 u1_t_rtnSts;
-  U1 u1_t_evtProcessFlag;
-
-  evt_s_nextEvent = FSM_EVT_NULL;
-  u1_t_evtProcessFlag = FSM_TRUE;
-
-  while(u1_t_evtProcessFlag == FSM_TRUE)
-  {
-    fsm_enterCritical();
-
-    evt_s_nextEvent = evt_fsm_evtQueueGet();
-
-    /* Check if empty or event returned. */
-    if(evt_s_nextEvent == FSM_EVT_NULL)
-    {
-      u1_t_evtProcessFlag = FSM_FALSE;
-      u1_t_rtnSts         = FSM_EVT_QUEUE_ALL_EVT_PROCESSED;
-    }
-    /* Check valid transition */
-    else if(fsm_sas_fsmTable[state_s_currentState].eventList[evt_s_nextEvent] == FSM_EVT_INACTIVE)
-    {
-      /* Invalid transition */
-      u1_t_rtnSts = FSM_EVT_QUEUE_INVALID_EVT;
-#ifdef u1_fsm_invalidEvtHandler
-      u1_t_evtProcessFlag = u1_fsm_invalidEvtHandler();
-#endif
-    }
-    else
-    {
-      state_s_prevState = state_s_currentState;
-
-      /* Call state exit function if defined. */
-      if(fsm_sas_fsmTable[state_s_currentState].stateFunctions->exitFunction != (void*)FSM_NULL)
-      {
-        fsm_sas_fsmTable[state_s_currentState].stateFunctions->exitFunction();
-      }
-      else
-      {
-
-      }
-
-      state_s_currentState = fsm_sas_fsmTable[state_s_currentState].eventList[evt_s_nextEvent];
-
-      /* Is the transition a self-loop?*/
-      u1_t_reentrySts = (state_s_prevState == state_s_currentState) ?
-                        FSM_STATE_REENTRY : FSM_STATE_FIRST_ENTRY;
-
-      /* Call state entry function if defined. */
-      if(fsm_sas_fsmTable[state_s_currentState].stateFunctions->entryFunction != (void*)FSM_NULL)
-      {
-        fsm_sas_fsmTable[state_s_currentState].stateFunctions->entryFunction(u1_t_reentrySts);
-      }
-      else
-      {
-
-      }
-
-      /* Call marked state handler if state is marked. */
-      if(fsm_sas_fsmTable[state_s_currentState].markedState == FSM_MARKED_STATE)
-      {
-#ifdef fsm_markedStateHandler
-        fsm_markedStateHandler(state_s_currentState);
-#endif
-      }
-      else
-      {
-
-      }
-    }
-
-    fsm_exitCritical();
-  }
-
-  return (u1_t_rtnSts);
-}
-
-/*************************************************************************/
-/* History                                                               */
-/*************************************************************************/
-/* 10/20/2020      First implementation.                                 */
-/*                                                                       */
+/*************************************************************************/
+/*  File Name: fsm.c                                                     */
+/*  Purpose: Source file for FSM module. Module designed to be integrated*/
+/*           with any RTOS or used bare metal, only handlers and queue   */
+/*           functions need to be defined in fsm.h.                      */
+/*  Created by: Garrett Sculthorpe on 10/20/20.                          */
+/*  Copyright © 2020 Garrett Sculthorpe.                                 */
+/*              All rights reserved.                                     */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_instr.h"
+#include "fsm_payload.h"
+#include "fsm_timer.h"
+#include "fsm_batch.h"
+#include "fsm_trace.h"
+#include "fsm_snapshot.h"
+#include "fsm_async.h"
+#include "fsm_coalesce.h"
+#include "fsm_wait.h"
+
+#ifdef FSM_CFG_FILTER
+#include <stdatomic.h>
+#endif
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define FSM_NULL           0
+
+#define FSM_INST_ALLOCATED (-2)
+
+#ifdef FSM_CFG_PAYLOAD
+#define FSM_PAYLOAD_ARG(payload)         , (payload)
+#else
+#define FSM_PAYLOAD_ARG(payload)
+#endif
+
+#ifdef FSM_CFG_HIERARCHY
+#define FSM_CHAIN_ARG(chain)             , (chain)
+#else
+#define FSM_CHAIN_ARG(chain)
+#endif
+
+_Static_assert(FSM_NUM_STATES == FSM_STATE_COUNT, "FSM_STATE_COUNT does not match enum FSM_STATE");
+_Static_assert(FSM_NUM_EVENTS == FSM_EVT_COUNT,   "FSM_EVT_COUNT does not match enum FSM_EVT");
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+typedef void (*FSMEntryFp)(FSM_INST inst, U1 reentrySts FSM_PAYLOAD_PARAM);
+typedef void (*FSMExitFp)(FSM_INST inst FSM_PAYLOAD_PARAM);
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+/* Instance pool, one entry per instance in each array so that serving many
+   instances walks dense memory. The state table in fsm_table.c is
+   shared. */
+static FSM_STATE_IDX state_sa_currentState[FSM_NUM_INSTANCES];
+static FSM_STATE_IDX state_sa_prevState[FSM_NUM_INSTANCES];
+static FSM_INST      inst_sa_nextFree[FSM_NUM_INSTANCES];
+static FSM_INST      inst_s_freeHead;
+
+static FSMEntryFp fsm_sa_entryFp[FSM_NUM_STATES];
+static FSMExitFp  fsm_sa_exitFp[FSM_NUM_STATES];
+
+#ifdef FSM_CFG_ASYNC
+static FSMAsyncFp fsm_sa_asyncFp[FSM_NUM_STATES];
+#endif
+
+#ifdef FSM_CFG_DEFER
+/* Events parked by the defer set of the current state, oldest first. Only
+   touched by the thread serving the instance. */
+static FSM_QUEUE_ITEM evt_sa_deferList[FSM_NUM_INSTANCES][FSM_DEFER_LENGTH];
+static U1             u1_sa_deferCount[FSM_NUM_INSTANCES];
+static U1             u1_sa_deferReplay[FSM_NUM_INSTANCES];
+
+_Static_assert(FSM_DEFER_LENGTH <= 0xFF, "FSM_DEFER_LENGTH must be at most 255");
+#endif
+
+#if defined(FSM_CFG_BATCH) && defined(FSM_CFG_HIERARCHY)
+/* Chain per (state, event), laid out as the flattened table of
+   fsm_batch.c, so batch stepped lanes never search the table. */
+static FSM_CHAIN_IDX chain_sa_batchChain[FSM_STATE_COUNT * FSM_EVT_COUNT];
+#endif
+
+#ifdef FSM_CFG_FILTER
+/* Set by vd_fsm_setEvtFilter(), read by every producer. */
+static atomic_uchar u1_s_filterMode;
+
+/* The current state is read by producers filtering events, so it is
+   loaded and stored atomically. Relaxed, a plain move on common targets. */
+#define FSM_STATE_LOAD(inst)             __atomic_load_n(&state_sa_currentState[(inst)], __ATOMIC_RELAXED)
+#define FSM_STATE_STORE(inst, state)     __atomic_store_n(&state_sa_currentState[(inst)], (state), __ATOMIC_RELAXED)
+#else
+#define FSM_STATE_STORE(inst, state)     (state_sa_currentState[(inst)] = (state))
+#endif
+
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static void vd_fsm_resetInst(FSM_INST inst);
+static void vd_fsm_discardEvts(FSM_INST inst);
+static U1 u1_fsm_processEvt(FSM_INST inst, FSM_QUEUE_ITEM item);
+static U1 u1_fsm_stepEvt(FSM_INST inst, FSM_QUEUE_ITEM item);
+static void vd_fsm_transition(FSM_INST inst, FSM_EVT evt, FSM_STATE_IDX nextState FSM_CHAIN_PARAM FSM_PAYLOAD_PARAM);
+#ifdef FSM_CFG_DEFER
+static U1 u1_fsm_replayEvts(FSM_INST inst, U1 evtProcessFlag);
+static U1 u1_fsm_deferEvt(FSM_INST inst, FSM_STATE_IDX state, FSM_QUEUE_ITEM item);
+#endif
+static inline FSM_QUEUE_ITEM evt_fsm_takeEvt(FSM_INST inst);
+#ifdef FSM_CFG_FILTER
+static inline U1 u1_fsm_filterEvt(FSM_INST inst, FSM_EVT evt);
+#endif
+static inline FSM_STATE_IDX state_fsm_lookup(FSM_STATE_IDX state, FSM_EVT evt FSM_CHAIN_PARAM);
+static inline void vd_fsm_callExit(FSM_INST inst, FSM_STATE_IDX state FSM_PAYLOAD_PARAM);
+static inline void vd_fsm_callEntry(FSM_INST inst, FSM_STATE_IDX state, U1 reentrySts FSM_PAYLOAD_PARAM);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_init                                           */
+/*  Purpose:       Initialize module variables. Releases all instances   */
+/*                 and resets FSM_INST_DEFAULT to the initial state.     */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_init(void)
+{
+  FSM_INST inst_t_idx;
+#if defined(FSM_CFG_BATCH) && defined(FSM_CFG_HIERARCHY)
+  U4 u4_t_state;
+  U4 u4_t_evt;
+#endif
+
+#ifdef FSM_CFG_PAYLOAD
+  vd_fsm_payloadInit();
+#endif
+#ifdef FSM_CFG_TIMER
+  vd_fsm_timerInit();
+#endif
+#ifdef FSM_CFG_BATCH
+  vd_fsm_batchInit();
+#ifdef FSM_CFG_HIERARCHY
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      (void)state_fsm_lookup((FSM_STATE_IDX)u4_t_state, (FSM_EVT)u4_t_evt,
+                             &chain_sa_batchChain[(u4_t_state * FSM_NUM_EVENTS) + u4_t_evt]);
+    }
+  }
+#endif
+#endif
+#ifdef FSM_CFG_COALESCE
+  vd_fsm_coalesceInit();
+#endif
+#ifdef FSM_CFG_WAIT
+  vd_fsm_waitInit();
+#endif
+#ifdef FSM_CFG_FILTER
+  atomic_store_explicit(&u1_s_filterMode, FSM_FILTER_OFF, memory_order_relaxed);
+#endif
+
+  fsm_enterCritical();
+
+  /* Chain all instances except the default one into the free list. */
+  inst_s_freeHead = FSM_INST_INVALID;
+
+  for(inst_t_idx = FSM_NUM_INSTANCES - 1; inst_t_idx > FSM_INST_DEFAULT; inst_t_idx--)
+  {
+    inst_sa_nextFree[inst_t_idx] = inst_s_freeHead;
+    inst_s_freeHead              = inst_t_idx;
+  }
+
+  inst_sa_nextFree[FSM_INST_DEFAULT] = FSM_INST_ALLOCATED;
+
+  fsm_exitCritical();
+
+  vd_fsm_resetInst(FSM_INST_DEFAULT);
+}
+
+/*************************************************************************/
+/*  Function Name: inst_fsm_create                                       */
+/*  Purpose:       Take an instance from the pool and reset it to the    */
+/*                 initial state with an empty event queue.              */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSM_INST handle    OR                                 */
+/*                 FSM_INST_INVALID if the pool is exhausted             */
+/*************************************************************************/
+FSM_INST inst_fsm_create(void)
+{
+  FSM_INST inst_t_inst;
+
+  fsm_enterCritical();
+
+  inst_t_inst = inst_s_freeHead;
+
+  if(inst_t_inst != FSM_INST_INVALID)
+  {
+    inst_s_freeHead               = inst_sa_nextFree[inst_t_inst];
+    inst_sa_nextFree[inst_t_inst] = FSM_INST_ALLOCATED;
+  }
+  else
+  {
+
+  }
+
+  fsm_exitCritical();
+
+  if(inst_t_inst != FSM_INST_INVALID)
+  {
+    vd_fsm_resetInst(inst_t_inst);
+  }
+  else
+  {
+
+  }
+
+  return (inst_t_inst);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_destroy                                        */
+/*  Purpose:       Return an instance to the pool. Pending events are    */
+/*                 discarded.                                            */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Handle returned by inst_fsm_create().              */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_destroy(FSM_INST inst)
+{
+  /* The default instance is never returned to the pool. */
+  if((inst > FSM_INST_DEFAULT) && (inst < FSM_NUM_INSTANCES))
+  {
+    fsm_enterCritical();
+
+    if(inst_sa_nextFree[inst] == FSM_INST_ALLOCATED)
+    {
+      /* Cancel first, a timer expiring meanwhile would leave a timeout. */
+#ifdef FSM_CFG_TIMER
+      vd_fsm_timerCancel(inst);
+#endif
+      vd_fsm_discardEvts(inst);
+#ifdef FSM_CFG_WAIT
+      vd_fsm_waitClose(inst);
+#endif
+
+      inst_sa_nextFree[inst] = inst_s_freeHead;
+      inst_s_freeHead        = inst;
+    }
+    else
+    {
+
+    }
+
+    fsm_exitCritical();
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_setStateFp                                     */
+/*  Purpose:       Set function pointers for state entry/exit. Shared by */
+/*                 all instances.                                        */
+/*  Arguments:     U4 state:                                             */
+/*                    State for which functions will be defined.         */
+/*                 U1 entryOrExit:                                       */
+/*                    FSM_STATE_SET_ENTRY_FUNC   OR                      */
+/*                    FSM_STATE_SET_EXIT_FUNC    OR                      */
+/*                    FSM_STATE_SET_ASYNC_FUNC with FSM_CFG_ASYNC        */
+/*                 void (*fp):                                           */
+/*                    Pointer to routine. Entry() has FSM_INST and U1    */
+/*                    arguments, Exit() has FSM_INST argument. Both take */
+/*                    a void* payload last with FSM_CFG_PAYLOAD. An      */
+/*                    async action is an FSMAsyncFp, see fsm_async.h.    */
+/*  Return:        U1 FSM_STATE_SET_FUNC_INV_SET       OR                */
+/*                    FSM_STATE_SET_FUNC_INV_STATE     OR                */
+/*                    FSM_STATE_SET_FUNC_SUCCESS                         */
+/*************************************************************************/
+U1 u1_fsm_setStateFp(U4 state, U1 entryOrExit, void (*fp))
+{
+  U1 u1_t_rtnSts;
+
+  /* Check valid state. */
+  if(state < FSM_NUM_STATES)
+  {
+    u1_t_rtnSts = FSM_STATE_SET_FUNC_SUCCESS;
+
+    fsm_enterCritical();
+
+    /* Entry or exit callback? */
+    if(entryOrExit == FSM_STATE_SET_ENTRY_FUNC)
+    {
+      fsm_sa_entryFp[state] = (FSMEntryFp)fp;
+    }
+    else if(entryOrExit == FSM_STATE_SET_EXIT_FUNC)
+    {
+      fsm_sa_exitFp[state] = (FSMExitFp)fp;
+    }
+#ifdef FSM_CFG_ASYNC
+    else if(entryOrExit == FSM_STATE_SET_ASYNC_FUNC)
+    {
+      fsm_sa_asyncFp[state] = (FSMAsyncFp)fp;
+    }
+#endif
+    /* Invalid param. */
+    else
+    {
+      u1_t_rtnSts = FSM_STATE_SET_FUNC_INV_SET;
+    }
+
+    fsm_exitCritical();
+  }
+  else
+  {
+    u1_t_rtnSts = FSM_STATE_SET_FUNC_INV_STATE;
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: state_fsm_getCurrentState                             */
+/*  Purpose:       Return current state of FSM_INST_DEFAULT.             */
+/*  Arguments:     N/A                                                   */
+/*  Return:        enum FSM_STATE                                        */
+/*************************************************************************/
+FSM_STATE state_fsm_getCurrentState(void)
+{
+  return state_fsm_instGetCurrentState(FSM_INST_DEFAULT);
+}
+
+/*************************************************************************/
+/*  Function Name: state_fsm_instGetCurrentState                         */
+/*  Purpose:       Return current state of an instance.                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        enum FSM_STATE    OR                                  */
+/*                 FSM_STATE_INACTIVE if inst is out of range            */
+/*************************************************************************/
+FSM_STATE state_fsm_instGetCurrentState(FSM_INST inst)
+{
+  FSM_STATE state_t_currentState;
+
+  if((inst >= FSM_INST_DEFAULT) && (inst < FSM_NUM_INSTANCES))
+  {
+    fsm_enterCritical();
+
+    state_t_currentState = (FSM_STATE)state_sa_currentState[inst];
+
+    fsm_exitCritical();
+  }
+  else
+  {
+    state_t_currentState = (FSM_STATE)FSM_STATE_INACTIVE;
+  }
+
+  return state_t_currentState;
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_getTransition                                  */
+/*  Purpose:       Look up the state table without changing any          */
+/*                 instance.                                             */
+/*  Arguments:     U4 state:                                             */
+/*                    Current state.                                     */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        U4 next state    OR                                   */
+/*                    FSM_STATE_INACTIVE if the event is not accepted or */
+/*                    an argument is out of range                        */
+/*************************************************************************/
+U4 u4_fsm_getTransition(U4 state, FSM_EVT evt)
+{
+  FSM_STATE_IDX state_t_nextState;
+  U4 u4_t_rtn;
+#ifdef FSM_CFG_HIERARCHY
+  FSM_CHAIN_IDX chain_t_chain;
+#endif
+
+  u4_t_rtn = FSM_STATE_INACTIVE;
+
+  if((state >= 0) && (state < FSM_NUM_STATES) && ((U4)evt < FSM_NUM_EVENTS))
+  {
+    state_t_nextState = state_fsm_lookup((FSM_STATE_IDX)state, evt FSM_CHAIN_ARG(&chain_t_chain));
+
+    if(state_t_nextState != FSM_STATE_IDX_INACTIVE)
+    {
+      u4_t_rtn = (U4)state_t_nextState;
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u4_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: u8_fsm_tableFingerprint                               */
+/*  Purpose:       Hash the next state of every (state, event) pair with */
+/*                 64 bit FNV-1a. Two builds with the same fingerprint   */
+/*                 take the same transitions, whatever the table format. */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U8 fingerprint                                        */
+/*************************************************************************/
+U8 u8_fsm_tableFingerprint(void)
+{
+  U8 u8_t_hash;
+  U4 u4_t_state;
+  U4 u4_t_evt;
+  U4 u4_t_next;
+  U4 u4_t_byte;
+
+  u8_t_hash = 0xCBF29CE484222325ull;
+
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      u4_t_next = u4_fsm_getTransition(u4_t_state, (FSM_EVT)u4_t_evt);
+
+      for(u4_t_byte = 0; u4_t_byte < 4; u4_t_byte++)
+      {
+        u8_t_hash ^= (U8)(((unsigned int)u4_t_next >> (u4_t_byte * 8)) & 0xFFu);
+        u8_t_hash *= 0x100000001B3ull;
+      }
+    }
+  }
+
+  return (u8_t_hash);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_registerEvt                                    */
+/*  Purpose:       Register an event for FSM_INST_DEFAULT.               */
+/*  Arguments:     FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_REJECTED if dropped by vd_fsm_setEvtFilter()  */
+/*************************************************************************/
+U1 u1_fsm_registerEvt(FSM_EVT evt)
+{
+  return u1_fsm_instRegisterEvt(FSM_INST_DEFAULT, evt);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instRegisterEvt                                */
+/*  Purpose:       Register an event for an instance. Wraps event queue  */
+/*                 API.                                                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_NOT_REGISTERED if inst or evt is out of range */
+/*                 OR FSM_EVT_REJECTED if dropped by                     */
+/*                 vd_fsm_setEvtFilter()                                 */
+/*************************************************************************/
+U1 u1_fsm_instRegisterEvt(FSM_INST inst, FSM_EVT evt)
+{
+  U1 u1_t_rtnSts;
+
+  if((inst < FSM_INST_DEFAULT) || (inst >= FSM_NUM_INSTANCES) || ((U4)evt >= FSM_NUM_EVENTS))
+  {
+    u1_t_rtnSts = FSM_EVT_NOT_REGISTERED;
+  }
+#ifdef FSM_CFG_FILTER
+  else if(u1_fsm_filterEvt(inst, evt) == FSM_FALSE)
+  {
+    u1_t_rtnSts = FSM_EVT_REJECTED;
+  }
+#endif
+  else
+  {
+    u1_t_rtnSts = u1_fsm_evtPut(inst, FSM_QUEUE_ITEM_MAKE(evt, FSM_PAYLOAD_NONE));
+
+#ifdef FSM_CFG_INSTRUMENT
+    /* The queue is deepest right after a put. */
+    if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+    {
+      vd_fsm_instrQueueDepth(inst, u4_fsm_evtQueueDepth(inst));
+    }
+    else
+    {
+
+    }
+#endif
+
+#ifdef FSM_CFG_WAIT
+    if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+    {
+      vd_fsm_waitNotify(inst);
+    }
+    else
+    {
+
+    }
+#endif
+  }
+
+  return (u1_t_rtnSts);
+}
+
+#ifdef FSM_CFG_PAYLOAD
+/*************************************************************************/
+/*  Function Name: u1_fsm_instRegisterEvtPayload                         */
+/*  Purpose:       Register an event with a payload for an instance. On  */
+/*                 success the payload belongs to the FSM module until   */
+/*                 the event is processed or discarded, then it goes     */
+/*                 back to the pool. On failure the caller keeps it.     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*                 FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc().                */
+/*  Return:        Return value from wrapped queue API    OR             */
+/*                 FSM_EVT_NOT_REGISTERED if an argument is out of range */
+/*                 OR FSM_EVT_REJECTED if dropped by                     */
+/*                 vd_fsm_setEvtFilter()                                 */
+/*************************************************************************/
+U1 u1_fsm_instRegisterEvtPayload(FSM_INST inst, FSM_EVT evt, FSM_PAYLOAD payload)
+{
+  U1 u1_t_rtnSts;
+
+  if((inst < FSM_INST_DEFAULT) || (inst >= FSM_NUM_INSTANCES) || ((U4)evt >= FSM_NUM_EVENTS) ||
+     (payload >= FSM_PAYLOAD_COUNT))
+  {
+    u1_t_rtnSts = FSM_EVT_NOT_REGISTERED;
+  }
+#ifdef FSM_CFG_FILTER
+  else if(u1_fsm_filterEvt(inst, evt) == FSM_FALSE)
+  {
+    u1_t_rtnSts = FSM_EVT_REJECTED;
+  }
+#endif
+  else
+  {
+    u1_t_rtnSts = u1_fsm_evtPut(inst, FSM_QUEUE_ITEM_MAKE(evt, payload));
+
+#ifdef FSM_CFG_INSTRUMENT
+    /* The queue is deepest right after a put. */
+    if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+    {
+      vd_fsm_instrQueueDepth(inst, u4_fsm_evtQueueDepth(inst));
+    }
+    else
+    {
+
+    }
+#endif
+
+#ifdef FSM_CFG_WAIT
+    if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+    {
+      vd_fsm_waitNotify(inst);
+    }
+    else
+    {
+
+    }
+#endif
+  }
+
+  return (u1_t_rtnSts);
+}
+#endif
+
+#ifdef FSM_CFG_FILTER
+/*************************************************************************/
+/*  Function Name: vd_fsm_setEvtFilter                                   */
+/*  Purpose:       Select which events registering rejects before they   */
+/*                 take a queue slot. Rejected events never reach        */
+/*                 u1_fsm_invalidEvtHandler(). Set before producers      */
+/*                 start, vd_fsm_init() sets FSM_FILTER_OFF.             */
+/*  Arguments:     U1 mode:                                              */
+/*                    FSM_FILTER_OFF             OR                      */
+/*                    FSM_FILTER_ANY_STATE, events no state accepts  OR  */
+/*                    FSM_FILTER_CURRENT_STATE, events the current state */
+/*                    neither accepts nor defers. Events still queued    */
+/*                    may change the state first, so this only suits     */
+/*                    producers that know the instance is idle.          */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_setEvtFilter(U1 mode)
+{
+  atomic_store_explicit(&u1_s_filterMode, mode, memory_order_relaxed);
+}
+#endif
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_serveEvtQueue                                  */
+/*  Purpose:       Serve waiting events of FSM_INST_DEFAULT.             */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_serveEvtQueue(void)
+{
+  return u1_fsm_instServeEvtQueue(FSM_INST_DEFAULT);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instServeEvtQueue                              */
+/*  Purpose:       Serve waiting events in event queue of an instance.   */
+/*                 Will run until error or empty. Calls                  */
+/*                 u1_fsm_invalidEvtHandler() hook if event is invalid   */
+/*                 at current state.                                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_instServeEvtQueue(FSM_INST inst)
+{
+  FSM_QUEUE_ITEM evt_t_nextEvent;
+  U1 u1_t_rtnSts;
+  U1 u1_t_evtProcessFlag;
+
+  u1_t_rtnSts         = FSM_EVT_QUEUE_ALL_EVT_PROCESSED;
+  u1_t_evtProcessFlag = FSM_TRUE;
+
+  while(u1_t_evtProcessFlag == FSM_TRUE)
+  {
+    fsm_enterCritical();
+
+    evt_t_nextEvent = evt_fsm_takeEvt(inst);
+
+#ifdef FSM_CFG_TIMER
+    /* An expired timeout is served once no other event is waiting. */
+    if(FSM_QUEUE_ITEM_EVT(evt_t_nextEvent) == FSM_EVT_NULL)
+    {
+      evt_t_nextEvent = evt_fsm_timerTake(inst);
+    }
+    else
+    {
+
+    }
+#endif
+
+    /* Check if empty or event returned. */
+    if(FSM_QUEUE_ITEM_EVT(evt_t_nextEvent) == FSM_EVT_NULL)
+    {
+      u1_t_evtProcessFlag = FSM_FALSE;
+      u1_t_rtnSts         = FSM_EVT_QUEUE_ALL_EVT_PROCESSED;
+    }
+    else
+    {
+      u1_t_evtProcessFlag = u1_fsm_processEvt(inst, evt_t_nextEvent);
+      u1_t_rtnSts         = (u1_t_evtProcessFlag == FSM_TRUE) ?
+                            FSM_EVT_QUEUE_ALL_EVT_PROCESSED : FSM_EVT_QUEUE_INVALID_EVT;
+    }
+
+    fsm_exitCritical();
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_instServeEvtQueueBudget                        */
+/*  Purpose:       Serve waiting events of an instance in batches. The   */
+/*                 critical section is only held while up to             */
+/*                 FSM_SERVE_BATCH_LENGTH events are copied out of the   */
+/*                 queue, transitions and callbacks run without it. A    */
+/*                 stop request from u1_fsm_invalidEvtHandler() takes    */
+/*                 effect once the current batch is served.              */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 maxEvts:                                           */
+/*                    Max events served by this call, or                 */
+/*                    FSM_SERVE_NO_LIMIT.                                */
+/*                 U4 maxTicks:                                          */
+/*                    Max u4_fsm_getTicks() ticks spent, checked         */
+/*                    between batches, or FSM_SERVE_NO_LIMIT.            */
+/*  Return:        U1 FSM_EVT_QUEUE_INVALID_EVT         OR               */
+/*                    FSM_EVT_QUEUE_BUDGET_EXPIRED      OR               */
+/*                    FSM_EVT_QUEUE_ALL_EVT_PROCESSED                    */
+/*************************************************************************/
+U1 u1_fsm_instServeEvtQueueBudget(FSM_INST inst, U4 maxEvts, U4 maxTicks)
+{
+  FSM_QUEUE_ITEM evt_ta_batch[FSM_SERVE_BATCH_LENGTH];
+  U4 u4_t_batchLength;
+  U4 u4_t_batchIdx;
+  U4 u4_t_remaining;
+  U4 u4_t_startTicks;
+  U1 u1_t_rtnSts;
+  U1 u1_t_evtProcessFlag;
+  U1 u1_t_serveFlag;
+
+  u4_t_remaining  = maxEvts;
+  u4_t_startTicks = u4_fsm_getTicks();
+  u1_t_rtnSts     = FSM_EVT_QUEUE_ALL_EVT_PROCESSED;
+  u1_t_serveFlag  = FSM_TRUE;
+
+  while(u1_t_serveFlag == FSM_TRUE)
+  {
+    u4_t_batchLength = FSM_SERVE_BATCH_LENGTH;
+
+    if((maxEvts != FSM_SERVE_NO_LIMIT) && (u4_t_remaining < u4_t_batchLength))
+    {
+      u4_t_batchLength = u4_t_remaining;
+    }
+    else
+    {
+
+    }
+
+    /* Copy out a batch, this is the only part done under lock. */
+#ifndef FSM_QUEUE_LOCK_FREE
+    fsm_enterCritical();
+#endif
+
+    for(u4_t_batchIdx = 0; u4_t_batchIdx < u4_t_batchLength; u4_t_batchIdx++)
+    {
+      evt_ta_batch[u4_t_batchIdx] = evt_fsm_takeEvt(inst);
+
+      if(FSM_QUEUE_ITEM_EVT(evt_ta_batch[u4_t_batchIdx]) == FSM_EVT_NULL)
+      {
+        u4_t_batchLength = u4_t_batchIdx;
+
+#ifdef FSM_CFG_TIMER
+        /* An expired timeout is served once no other event is waiting,
+           in a batch of its own: events before it could leave its state. */
+        if(u4_t_batchIdx == 0)
+        {
+          evt_ta_batch[0]  = evt_fsm_timerTake(inst);
+          u4_t_batchLength = (FSM_QUEUE_ITEM_EVT(evt_ta_batch[0]) == FSM_EVT_NULL) ? 0 : 1;
+        }
+        else
+        {
+
+        }
+#endif
+      }
+      else
+      {
+
+      }
+    }
+
+#ifndef FSM_QUEUE_LOCK_FREE
+    fsm_exitCritical();
+#endif
+
+    /* Serve the batch. */
+    u1_t_evtProcessFlag = FSM_TRUE;
+
+    for(u4_t_batchIdx = 0; u4_t_batchIdx < u4_t_batchLength; u4_t_batchIdx++)
+    {
+      if(u1_fsm_processEvt(inst, evt_ta_batch[u4_t_batchIdx]) == FSM_FALSE)
+      {
+        u1_t_evtProcessFlag = FSM_FALSE;
+      }
+      else
+      {
+
+      }
+    }
+
+    /* Only counted down under a budget, unbounded serves would overflow. */
+    if(maxEvts != FSM_SERVE_NO_LIMIT)
+    {
+      u4_t_remaining -= u4_t_batchLength;
+    }
+    else
+    {
+
+    }
+
+    /* Queue drained, unless the batch was cut short by the budget or a
+       timeout expired and still waits for a batch of its own. */
+    if((u4_t_batchLength < FSM_SERVE_BATCH_LENGTH) &&
+       ((maxEvts == FSM_SERVE_NO_LIMIT) || (u4_t_remaining != 0)) &&
+       (u1_fsm_timerReady(inst) == FSM_FALSE))
+    {
+      u1_t_serveFlag = FSM_FALSE;
+      u1_t_rtnSts    = FSM_EVT_QUEUE_ALL_EVT_PROCESSED;
+    }
+    else
+    {
+
+    }
+
+    if(u1_t_evtProcessFlag == FSM_FALSE)
+    {
+      u1_t_serveFlag = FSM_FALSE;
+      u1_t_rtnSts    = FSM_EVT_QUEUE_INVALID_EVT;
+    }
+    else if(u1_t_serveFlag == FSM_FALSE)
+    {
+
+    }
+    else if(((maxEvts != FSM_SERVE_NO_LIMIT) && (u4_t_remaining == 0)) ||
+            ((maxTicks != FSM_SERVE_NO_LIMIT) &&
+             ((unsigned int)(u4_fsm_getTicks() - u4_t_startTicks) >= (unsigned int)maxTicks)))
+    {
+      u1_t_serveFlag = FSM_FALSE;
+      u1_t_rtnSts    = FSM_EVT_QUEUE_BUDGET_EXPIRED;
+    }
+    else
+    {
+
+    }
+  }
+
+  return (u1_t_rtnSts);
+}
+
+#ifdef FSM_CFG_BATCH
+/*************************************************************************/
+/*  Function Name: u4_fsm_instBatchStep                                  */
+/*  Purpose:       Run one event each through count consecutive          */
+/*                 instances, bypassing their queues. Lanes are          */
+/*                 evaluated with u4_fsm_batchStep() and only those that */
+/*                 take a transition run callbacks, timers and deferred  */
+/*                 events as u1_fsm_instServeEvtQueue() would. Events    */
+/*                 without a transition are dropped without calling      */
+/*                 u1_fsm_invalidEvtHandler() or being deferred. Call    */
+/*                 only from the thread serving these instances.         */
+/*  Arguments:     FSM_INST first:                                       */
+/*                    First instance handle, all count must be created.  */
+/*                 U4 count:                                             */
+/*                    Number of instances.                               */
+/*                 const FSM_EVT* evt:                                   */
+/*                    Event per instance, each below FSM_NUM_EVENTS.     */
+/*  Return:        U4 number of instances that took a transition         */
+/*************************************************************************/
+U4 u4_fsm_instBatchStep(FSM_INST first, U4 count, const FSM_EVT* evt)
+{
+  U4 u4_ta_state[FSM_BATCH_CHUNK_LENGTH];
+  unsigned int u4_ta_transMask[FSM_BATCH_MASK_LENGTH(FSM_BATCH_CHUNK_LENGTH)];
+  unsigned int u4_t_bits;
+  FSM_INST inst_t_inst;
+  U4 u4_t_chunkStart;
+  U4 u4_t_chunkLength;
+  U4 u4_t_lane;
+  U4 u4_t_word;
+  U4 u4_t_rtn;
+#ifdef FSM_CFG_HIERARCHY
+  FSM_CHAIN_IDX chain_t_chain;
+#endif
+
+  u4_t_rtn = 0;
+
+  for(u4_t_chunkStart = 0; u4_t_chunkStart < count; u4_t_chunkStart += u4_t_chunkLength)
+  {
+    u4_t_chunkLength = count - u4_t_chunkStart;
+
+    if(u4_t_chunkLength > FSM_BATCH_CHUNK_LENGTH)
+    {
+      u4_t_chunkLength = FSM_BATCH_CHUNK_LENGTH;
+    }
+    else
+    {
+
+    }
+
+    for(u4_t_lane = 0; u4_t_lane < u4_t_chunkLength; u4_t_lane++)
+    {
+      u4_ta_state[u4_t_lane] = (U4)state_sa_currentState[first + u4_t_chunkStart + u4_t_lane];
+    }
+
+    u4_t_rtn += u4_fsm_batchStep(u4_ta_state, &evt[u4_t_chunkStart], u4_t_chunkLength, u4_ta_transMask);
+
+    /* Only lanes that take a transition run the callbacks, with the next
+       state the kernel found. */
+    for(u4_t_word = 0; u4_t_word < FSM_BATCH_MASK_LENGTH(u4_t_chunkLength); u4_t_word++)
+    {
+      u4_t_bits = u4_ta_transMask[u4_t_word];
+
+      while(u4_t_bits != 0)
+      {
+        u4_t_lane   = (u4_t_word * 32) + (U4)fsm_ctz(u4_t_bits);
+        u4_t_bits  &= u4_t_bits - 1;
+        inst_t_inst = first + u4_t_chunkStart + u4_t_lane;
+
+#ifdef FSM_CFG_HIERARCHY
+        chain_t_chain = chain_sa_batchChain[((U4)state_sa_currentState[inst_t_inst] * FSM_NUM_EVENTS) +
+                                            (U4)evt[u4_t_chunkStart + u4_t_lane]];
+#endif
+        vd_fsm_transition(inst_t_inst, evt[u4_t_chunkStart + u4_t_lane], (FSM_STATE_IDX)u4_ta_state[u4_t_lane]
+                          FSM_CHAIN_ARG(&chain_t_chain) FSM_PAYLOAD_ARG(NULL));
+#ifdef FSM_CFG_DEFER
+        (void)u1_fsm_replayEvts(inst_t_inst, FSM_TRUE);
+#endif
+      }
+    }
+  }
+
+  return (u4_t_rtn);
+}
+#endif
+
+#ifdef FSM_CFG_SNAPSHOT
+/*************************************************************************/
+/*  Function Name: vd_fsm_snapshotSavePool                               */
+/*  Purpose:       Copy the instance pool out of fsm.c.                  */
+/*  Arguments:     FSMSnapshotPool* pool:                                */
+/*                    Arrays to fill, freeHead is written.               */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_snapshotSavePool(FSMSnapshotPool* pool)
+{
+  fsm_enterCritical();
+
+  memcpy(pool->currentState, state_sa_currentState, sizeof(state_sa_currentState));
+  memcpy(pool->prevState, state_sa_prevState, sizeof(state_sa_prevState));
+  memcpy(pool->nextFree, inst_sa_nextFree, sizeof(inst_sa_nextFree));
+  pool->freeHead = inst_s_freeHead;
+
+#ifdef FSM_CFG_DEFER
+  memcpy(pool->deferCount, u1_sa_deferCount, sizeof(u1_sa_deferCount));
+  memcpy(pool->deferItem, evt_sa_deferList, sizeof(evt_sa_deferList));
+#endif
+
+  fsm_exitCritical();
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotLoadPool                               */
+/*  Purpose:       Check a saved instance pool and copy it into fsm.c.   */
+/*                 Event queues and timers are left to the caller.       */
+/*  Arguments:     const FSMSnapshotPool* pool:                          */
+/*                    Arrays to load.                                    */
+/*  Return:        U1 FSM_TRUE if loaded    OR                           */
+/*                    FSM_FALSE if invalid, nothing is changed           */
+/*************************************************************************/
+U1 u1_fsm_snapshotLoadPool(const FSMSnapshotPool* pool)
+{
+  FSM_INST inst_t_inst;
+  FSM_INST inst_t_next;
+  U4 u4_t_numFree;
+  U4 u4_t_walked;
+  U1 u1_t_valid;
+#ifdef FSM_CFG_DEFER
+  U4 u4_t_idx;
+#endif
+
+  u1_t_valid   = (pool->nextFree[FSM_INST_DEFAULT] == FSM_INST_ALLOCATED) ? FSM_TRUE : FSM_FALSE;
+  u4_t_numFree = 0;
+
+  for(inst_t_inst = 0; (inst_t_inst < FSM_NUM_INSTANCES) && (u1_t_valid == FSM_TRUE); inst_t_inst++)
+  {
+    inst_t_next = pool->nextFree[inst_t_inst];
+
+    u1_t_valid = (((unsigned int)pool->currentState[inst_t_inst] < FSM_NUM_STATES) &&
+                  ((unsigned int)pool->prevState[inst_t_inst] < FSM_NUM_STATES) &&
+                  ((inst_t_next == FSM_INST_ALLOCATED) || (inst_t_next == FSM_INST_INVALID) ||
+                   ((inst_t_next > FSM_INST_DEFAULT) && (inst_t_next < FSM_NUM_INSTANCES)))) ? FSM_TRUE : FSM_FALSE;
+
+    u4_t_numFree += (inst_t_next != FSM_INST_ALLOCATED) ? 1 : 0;
+
+#ifdef FSM_CFG_DEFER
+    u1_t_valid = ((u1_t_valid == FSM_TRUE) && (pool->deferCount[inst_t_inst] <= FSM_DEFER_LENGTH)) ? FSM_TRUE :
+                 FSM_FALSE;
+
+    for(u4_t_idx = 0; (u1_t_valid == FSM_TRUE) && (u4_t_idx < pool->deferCount[inst_t_inst]); u4_t_idx++)
+    {
+      u1_t_valid = ((unsigned int)FSM_QUEUE_ITEM_EVT(pool->deferItem[(inst_t_inst * FSM_DEFER_LENGTH) + u4_t_idx]) <
+                    FSM_NUM_EVENTS) ? FSM_TRUE : FSM_FALSE;
+    }
+#endif
+  }
+
+  /* The free list must reach every free instance exactly once. */
+  inst_t_inst = pool->freeHead;
+  u4_t_walked = 0;
+
+  while((u1_t_valid == FSM_TRUE) && (inst_t_inst != FSM_INST_INVALID))
+  {
+    u1_t_valid  = ((inst_t_inst > FSM_INST_DEFAULT) && (inst_t_inst < FSM_NUM_INSTANCES) &&
+                   (pool->nextFree[inst_t_inst] != FSM_INST_ALLOCATED) && (u4_t_walked < u4_t_numFree)) ? FSM_TRUE :
+                  FSM_FALSE;
+    inst_t_inst = (u1_t_valid == FSM_TRUE) ? pool->nextFree[inst_t_inst] : FSM_INST_INVALID;
+    u4_t_walked++;
+  }
+
+  if((u1_t_valid == FSM_TRUE) && (u4_t_walked == u4_t_numFree))
+  {
+    fsm_enterCritical();
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+#ifdef FSM_CFG_TRACE
+      if(pool->nextFree[inst_t_inst] == FSM_INST_ALLOCATED)
+      {
+        vd_fsm_traceRecord(inst_t_inst, FSM_TRACE_EVT_RESET, state_sa_currentState[inst_t_inst],
+                           pool->currentState[inst_t_inst]);
+      }
+      else
+      {
+
+      }
+#endif
+#ifdef FSM_CFG_INSTRUMENT
+      vd_fsm_instrResetInst(inst_t_inst);
+#endif
+#ifdef FSM_CFG_ASYNC
+      vd_fsm_asyncCancel(inst_t_inst);
+#endif
+#ifdef FSM_CFG_COALESCE
+      vd_fsm_coalesceReset(inst_t_inst);
+#endif
+
+      state_sa_currentState[inst_t_inst] = pool->currentState[inst_t_inst];
+      state_sa_prevState[inst_t_inst]    = pool->prevState[inst_t_inst];
+      inst_sa_nextFree[inst_t_inst]      = pool->nextFree[inst_t_inst];
+    }
+
+    inst_s_freeHead = pool->freeHead;
+
+#ifdef FSM_CFG_DEFER
+    memcpy(u1_sa_deferCount, pool->deferCount, sizeof(u1_sa_deferCount));
+    memcpy(evt_sa_deferList, pool->deferItem, sizeof(evt_sa_deferList));
+    memset(u1_sa_deferReplay, FSM_FALSE, sizeof(u1_sa_deferReplay));
+#endif
+
+    fsm_exitCritical();
+  }
+  else
+  {
+    u1_t_valid = FSM_FALSE;
+  }
+
+  return (u1_t_valid);
+}
+#endif
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u1_fsm_processEvt                                     */
+/*  Purpose:       Run one event taken from the queue. With              */
+/*                 FSM_CFG_DEFER, parked events are replayed in arrival  */
+/*                 order after every state change it causes.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event taken from the queue.                        */
+/*  Return:        U1 FSM_TRUE to continue serving    OR                 */
+/*                    FSM_FALSE if u1_fsm_invalidEvtHandler() requested  */
+/*                    a stop                                             */
+/*************************************************************************/
+static U1 u1_fsm_processEvt(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  U1 u1_t_evtProcessFlag;
+
+  u1_t_evtProcessFlag = u1_fsm_stepEvt(inst, item);
+
+#ifdef FSM_CFG_DEFER
+  u1_t_evtProcessFlag = u1_fsm_replayEvts(inst, u1_t_evtProcessFlag);
+#endif
+
+  return (u1_t_evtProcessFlag);
+}
+
+#ifdef FSM_CFG_DEFER
+/*************************************************************************/
+/*  Function Name: u1_fsm_replayEvts                                     */
+/*  Purpose:       Replay parked events in arrival order after a state   */
+/*                 change, until none is left to replay.                 */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U1 evtProcessFlag:                                    */
+/*                    FSM_FALSE if a stop was already requested.         */
+/*  Return:        U1 FSM_TRUE to continue serving    OR                 */
+/*                    FSM_FALSE if u1_fsm_invalidEvtHandler() requested  */
+/*                    a stop                                             */
+/*************************************************************************/
+static U1 u1_fsm_replayEvts(FSM_INST inst, U1 evtProcessFlag)
+{
+  FSM_QUEUE_ITEM evt_ta_replay[FSM_DEFER_LENGTH];
+  U4 u4_t_replayLength;
+  U4 u4_t_idx;
+
+  /* Take the whole list, events deferred again are parked anew. Each pass
+     consumes an event or changes nothing, so this ends. */
+  while((evtProcessFlag == FSM_TRUE) && (u1_sa_deferReplay[inst] == FSM_TRUE))
+  {
+    u4_t_replayLength       = u1_sa_deferCount[inst];
+    u1_sa_deferCount[inst]  = 0;
+    u1_sa_deferReplay[inst] = FSM_FALSE;
+
+    for(u4_t_idx = 0; u4_t_idx < u4_t_replayLength; u4_t_idx++)
+    {
+      evt_ta_replay[u4_t_idx] = evt_sa_deferList[inst][u4_t_idx];
+    }
+
+    for(u4_t_idx = 0; u4_t_idx < u4_t_replayLength; u4_t_idx++)
+    {
+      if(evtProcessFlag == FSM_TRUE)
+      {
+        evtProcessFlag = u1_fsm_stepEvt(inst, evt_ta_replay[u4_t_idx]);
+      }
+      /* Stop requested, park the rest for the next call. */
+      else
+      {
+        evt_sa_deferList[inst][u1_sa_deferCount[inst]] = evt_ta_replay[u4_t_idx];
+        u1_sa_deferCount[inst]++;
+        u1_sa_deferReplay[inst] = FSM_TRUE;
+      }
+    }
+  }
+
+  return (evtProcessFlag);
+}
+#endif
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_stepEvt                                        */
+/*  Purpose:       Run one event through the state table for an          */
+/*                 instance: exit callback, transition, entry callback   */
+/*                 and marked state handler. A payload is returned to    */
+/*                 the pool afterwards unless the event is deferred.     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event taken from the queue.                        */
+/*  Return:        U1 FSM_TRUE to continue serving    OR                 */
+/*                    FSM_FALSE if u1_fsm_invalidEvtHandler() requested  */
+/*                    a stop                                             */
+/*************************************************************************/
+static U1 u1_fsm_stepEvt(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  FSM_EVT evt_t_evt;
+  FSM_STATE_IDX state_t_currentState;
+  FSM_STATE_IDX state_t_nextState;
+  U1 u1_t_evtProcessFlag;
+  U1 u1_t_deferFlag;
+#ifdef FSM_CFG_HIERARCHY
+  FSM_CHAIN_IDX chain_t_chain;
+#endif
+#ifdef FSM_CFG_PAYLOAD
+  void* pv_t_payload;
+
+  pv_t_payload = pv_fsm_payloadGet(FSM_QUEUE_ITEM_PAYLOAD(item));
+#endif
+
+  evt_t_evt            = FSM_QUEUE_ITEM_EVT(item);
+  u1_t_evtProcessFlag  = FSM_TRUE;
+  u1_t_deferFlag       = FSM_FALSE;
+  state_t_currentState = state_sa_currentState[inst];
+
+  /* Check valid transition */
+#if defined(FSM_CFG_FILTER) && (FSM_TABLE_FORMAT != FSM_TABLE_DENSE)
+  /* Invalid events skip the search of a sparse or switch table. A dense
+     lookup is a single load, it is not worth the extra test. */
+  state_t_nextState = ((fsm_sas_fsmTable.acceptSet[state_t_currentState][FSM_EVT_SET_BYTE(evt_t_evt)] &
+                        FSM_EVT_SET_BIT(evt_t_evt)) != 0) ?
+                      state_fsm_lookup(state_t_currentState, evt_t_evt FSM_CHAIN_ARG(&chain_t_chain)) :
+                      FSM_STATE_IDX_INACTIVE;
+#else
+  state_t_nextState = state_fsm_lookup(state_t_currentState, evt_t_evt FSM_CHAIN_ARG(&chain_t_chain));
+#endif
+
+  if(state_t_nextState == FSM_STATE_IDX_INACTIVE)
+  {
+#ifdef FSM_CFG_DEFER
+    u1_t_deferFlag = u1_fsm_deferEvt(inst, state_t_currentState, item);
+#endif
+
+    if(u1_t_deferFlag == FSM_FALSE)
+    {
+#ifdef FSM_CFG_COALESCE
+      vd_fsm_coalesceServe(inst, evt_t_evt);
+#endif
+      /* Invalid transition */
+#ifdef FSM_CFG_INSTRUMENT
+      vd_fsm_instrInvalid(state_t_currentState);
+#endif
+#ifdef FSM_CFG_TRACE
+      vd_fsm_traceRecord(inst, evt_t_evt, state_t_currentState, FSM_TRACE_STATE_NONE);
+#endif
+#if defined(u1_fsm_invalidEvtHandler) && defined(FSM_CFG_PAYLOAD)
+      u1_t_evtProcessFlag = u1_fsm_invalidEvtHandler(inst, pv_t_payload);
+#elif defined(u1_fsm_invalidEvtHandler)
+      u1_t_evtProcessFlag = u1_fsm_invalidEvtHandler(inst);
+#endif
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+    vd_fsm_transition(inst, evt_t_evt, state_t_nextState FSM_CHAIN_ARG(&chain_t_chain) FSM_PAYLOAD_ARG(pv_t_payload));
+  }
+
+#ifdef FSM_CFG_PAYLOAD
+  /* A parked event keeps its payload. */
+  if(u1_t_deferFlag == FSM_FALSE)
+  {
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD(item));
+  }
+  else
+  {
+
+  }
+#endif
+
+  return (u1_t_evtProcessFlag);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_transition                                     */
+/*  Purpose:       Take a transition found in the state table: exit      */
+/*                 callbacks, state change, timers, entry callbacks and  */
+/*                 marked state handler.                                 */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event that caused it.                              */
+/*                 FSM_STATE_IDX nextState:                              */
+/*                    Next state from the lookup.                        */
+/*                 FSM_CHAIN_IDX* chain:                                 */
+/*                    Chain from the lookup, FSM_CFG_HIERARCHY only.     */
+/*                 void* payload:                                        */
+/*                    Payload of the event, FSM_CFG_PAYLOAD only.        */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_transition(FSM_INST inst, FSM_EVT evt, FSM_STATE_IDX nextState FSM_CHAIN_PARAM FSM_PAYLOAD_PARAM)
+{
+  FSM_STATE_IDX state_t_currentState;
+  FSM_STATE_IDX state_t_prevState;
+#ifdef FSM_CFG_HIERARCHY
+  const FSMChain* ps_t_chain;
+  const FSM_STATE_IDX* state_t_chainState;
+  U4 u4_t_idx;
+#else
+  U1 u1_t_reentrySts;
+#endif
+#if !defined(FSM_CFG_COALESCE) && !defined(FSM_CFG_INSTRUMENT) && !defined(FSM_CFG_TRACE)
+  (void)evt;
+#endif
+
+  state_t_prevState = state_sa_currentState[inst];
+
+#ifdef FSM_CFG_COALESCE
+  vd_fsm_coalesceServe(inst, evt);
+#endif
+
+#ifdef FSM_CFG_HIERARCHY
+  /* Exit up to the least common ancestor. */
+  ps_t_chain         = &fsm_sas_fsmChain[*chain];
+  state_t_chainState = &fsm_sa_fsmChainState[ps_t_chain->start];
+
+  for(u4_t_idx = 0; u4_t_idx < ps_t_chain->exitCount; u4_t_idx++)
+  {
+    vd_fsm_callExit(inst, state_t_chainState[u4_t_idx] FSM_PAYLOAD_ARG(payload));
+  }
+#else
+  vd_fsm_callExit(inst, state_t_prevState FSM_PAYLOAD_ARG(payload));
+#endif
+
+  state_t_currentState = nextState;
+
+  state_sa_prevState[inst] = state_t_prevState;
+  FSM_STATE_STORE(inst, state_t_currentState);
+
+#ifdef FSM_CFG_DEFER
+  if((state_t_prevState != state_t_currentState) && (u1_sa_deferCount[inst] != 0))
+  {
+    u1_sa_deferReplay[inst] = FSM_TRUE;
+  }
+  else
+  {
+
+  }
+#endif
+
+#ifdef FSM_CFG_INSTRUMENT
+  vd_fsm_instrTransition(inst, state_t_prevState, evt, u4_fsm_getTicks());
+#endif
+#ifdef FSM_CFG_TRACE
+  vd_fsm_traceRecord(inst, evt, state_t_prevState, state_t_currentState);
+#endif
+#ifdef FSM_CFG_ASYNC
+  /* Leaving the state drops the result of its action. */
+  vd_fsm_asyncCancel(inst);
+#endif
+
+#ifdef FSM_CFG_TIMER
+  /* Restart the timeout on every entry, skip the wheel lock when neither
+     state has one. */
+  if((fsm_sas_fsmTimeout[state_t_prevState].ticks != 0) ||
+     (fsm_sas_fsmTimeout[state_t_currentState].ticks != 0))
+  {
+    vd_fsm_timerArm(inst, state_t_currentState);
+  }
+  else
+  {
+
+  }
+#endif
+
+#ifdef FSM_CFG_HIERARCHY
+  /* Enter down to the target, states exited on the way up are
+     re-entered. */
+  state_t_chainState += ps_t_chain->exitCount;
+
+  for(u4_t_idx = 0; u4_t_idx < ps_t_chain->entryCount; u4_t_idx++)
+  {
+    vd_fsm_callEntry(inst, state_t_chainState[u4_t_idx],
+                     (((ps_t_chain->reentrySet >> u4_t_idx) & 1u) != 0) ?
+                     FSM_STATE_REENTRY : FSM_STATE_FIRST_ENTRY FSM_PAYLOAD_ARG(payload));
+  }
+#else
+  /* Is the transition a self-loop?*/
+  u1_t_reentrySts = (state_t_prevState == state_t_currentState) ?
+                    FSM_STATE_REENTRY : FSM_STATE_FIRST_ENTRY;
+
+  vd_fsm_callEntry(inst, state_t_currentState, u1_t_reentrySts FSM_PAYLOAD_ARG(payload));
+#endif
+
+#ifdef FSM_CFG_ASYNC
+  if(fsm_sa_asyncFp[state_t_currentState] != FSM_NULL)
+  {
+    vd_fsm_asyncDispatch(inst, fsm_sa_asyncFp[state_t_currentState],
+                         (state_t_prevState == state_t_currentState) ? FSM_STATE_REENTRY : FSM_STATE_FIRST_ENTRY);
+  }
+  else
+  {
+
+  }
+#endif
+
+  /* Call marked state handler if state is marked. */
+  if((fsm_sas_fsmTable.markedSet[FSM_STATE_SET_BYTE(state_t_currentState)] &
+      FSM_STATE_SET_BIT(state_t_currentState)) != 0)
+  {
+#ifdef fsm_markedStateHandler
+    fsm_markedStateHandler(inst, (FSM_STATE)state_t_currentState);
+#endif
+  }
+  else
+  {
+
+  }
+}
+
+#ifdef FSM_CFG_DEFER
+/*************************************************************************/
+/*  Function Name: u1_fsm_deferEvt                                       */
+/*  Purpose:       Park an event the current state has no transition     */
+/*                 for, if the state defers it and the list has room.    */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_STATE_IDX state:                                  */
+/*                    Current state.                                     */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event taken from the queue.                        */
+/*  Return:        U1 FSM_TRUE if parked    OR                           */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+static U1 u1_fsm_deferEvt(FSM_INST inst, FSM_STATE_IDX state, FSM_QUEUE_ITEM item)
+{
+  FSM_EVT evt_t_evt;
+  U1 u1_t_rtn;
+
+  evt_t_evt = FSM_QUEUE_ITEM_EVT(item);
+
+  if(((fsm_sa_fsmDeferSet[state][FSM_EVT_SET_BYTE(evt_t_evt)] & FSM_EVT_SET_BIT(evt_t_evt)) != 0) &&
+     (u1_sa_deferCount[inst] < FSM_DEFER_LENGTH))
+  {
+    evt_sa_deferList[inst][u1_sa_deferCount[inst]] = item;
+    u1_sa_deferCount[inst]++;
+
+    u1_t_rtn = FSM_TRUE;
+  }
+  else
+  {
+    u1_t_rtn = FSM_FALSE;
+  }
+
+  return (u1_t_rtn);
+}
+#endif
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_takeEvt                                       */
+/*  Purpose:       Take the next event of an instance to serve. With     */
+/*                 FSM_CFG_ASYNC, a completion event goes before the     */
+/*                 queue. With FSM_CFG_COALESCE, the event is taken out  */
+/*                 of its pending state.                                 */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        FSM_QUEUE_ITEM event    OR                            */
+/*                 FSM_QUEUE_ITEM_NULL if none is waiting                */
+/*************************************************************************/
+static inline FSM_QUEUE_ITEM evt_fsm_takeEvt(FSM_INST inst)
+{
+  FSM_QUEUE_ITEM evt_t_item;
+#ifdef FSM_CFG_COALESCE
+  U1 u1_t_takeFlag;
+#endif
+
+#ifdef FSM_CFG_ASYNC
+  evt_t_item = evt_fsm_asyncTake(inst);
+#else
+  evt_t_item = FSM_QUEUE_ITEM_NULL;
+#endif
+
+  if(FSM_QUEUE_ITEM_EVT(evt_t_item) == FSM_EVT_NULL)
+  {
+#ifdef FSM_CFG_COALESCE
+    /* Skip events merged into one taken earlier. */
+    u1_t_takeFlag = FSM_TRUE;
+
+    while(u1_t_takeFlag == FSM_TRUE)
+    {
+      evt_t_item = evt_fsm_evtQueueGet(inst);
+
+      if(FSM_QUEUE_ITEM_EVT(evt_t_item) == FSM_EVT_NULL)
+      {
+        u1_t_takeFlag = FSM_FALSE;
+      }
+      else
+      {
+        evt_t_item    = evt_fsm_coalesceTake(inst, evt_t_item);
+        u1_t_takeFlag = (FSM_QUEUE_ITEM_EVT(evt_t_item) == FSM_EVT_NULL) ? FSM_TRUE : FSM_FALSE;
+      }
+    }
+#else
+    evt_t_item = evt_fsm_evtQueueGet(inst);
+#endif
+  }
+  else
+  {
+
+  }
+
+  return (evt_t_item);
+}
+
+#ifdef FSM_CFG_FILTER
+/*************************************************************************/
+/*  Function Name: u1_fsm_filterEvt                                      */
+/*  Purpose:       Test an event against the mode of                     */
+/*                 vd_fsm_setEvtFilter() before it is registered.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        U1 FSM_TRUE to register the event    OR               */
+/*                    FSM_FALSE to reject it                             */
+/*************************************************************************/
+static inline U1 u1_fsm_filterEvt(FSM_INST inst, FSM_EVT evt)
+{
+  FSM_STATE_IDX state_t_state;
+  U4 u4_t_acceptSet;
+  U1 u1_t_mode;
+  U1 u1_t_rtn;
+
+  u1_t_mode = atomic_load_explicit(&u1_s_filterMode, memory_order_relaxed);
+
+  if(u1_t_mode == FSM_FILTER_ANY_STATE)
+  {
+    u4_t_acceptSet = fsm_sas_fsmTable.acceptAnySet[FSM_EVT_SET_BYTE(evt)];
+    u1_t_rtn       = ((u4_t_acceptSet & FSM_EVT_SET_BIT(evt)) != 0) ? FSM_TRUE : FSM_FALSE;
+  }
+  else if(u1_t_mode == FSM_FILTER_CURRENT_STATE)
+  {
+    /* Read without the lock, the state may change before the event is
+       served anyway. */
+    state_t_state  = FSM_STATE_LOAD(inst);
+    u4_t_acceptSet = fsm_sas_fsmTable.acceptSet[state_t_state][FSM_EVT_SET_BYTE(evt)];
+#ifdef FSM_CFG_DEFER
+    u4_t_acceptSet |= fsm_sa_fsmDeferSet[state_t_state][FSM_EVT_SET_BYTE(evt)];
+#endif
+    u1_t_rtn       = ((u4_t_acceptSet & FSM_EVT_SET_BIT(evt)) != 0) ? FSM_TRUE : FSM_FALSE;
+  }
+  else
+  {
+    u1_t_rtn = FSM_TRUE;
+  }
+
+  return (u1_t_rtn);
+}
+#endif
+
+/*************************************************************************/
+/*  Function Name: state_fsm_lookup                                      */
+/*  Purpose:       Find the next state for an event in the state table.  */
+/*  Arguments:     FSM_STATE_IDX state:                                  */
+/*                    Current state.                                     */
+/*                 FSM_EVT evt:                                          */
+/*                    Event, must be below FSM_NUM_EVENTS.               */
+/*                 FSM_CHAIN_IDX* chain:                                 */
+/*                    Chain of the transition, FSM_CFG_HIERARCHY only.   */
+/*  Return:        FSM_STATE_IDX next state    OR                        */
+/*                 FSM_STATE_IDX_INACTIVE                                */
+/*************************************************************************/
+static inline FSM_STATE_IDX state_fsm_lookup(FSM_STATE_IDX state, FSM_EVT evt FSM_CHAIN_PARAM)
+{
+#if (FSM_TABLE_FORMAT == FSM_TABLE_SPARSE)
+  FSM_TABLE_ROW_IDX u4_t_low;
+  FSM_TABLE_ROW_IDX u4_t_high;
+  FSM_TABLE_ROW_IDX u4_t_mid;
+  FSM_STATE_IDX state_t_nextState;
+
+  u4_t_low          = fsm_sas_fsmTable.rowStart[state];
+  u4_t_high         = fsm_sas_fsmTable.rowStart[state + 1];
+  state_t_nextState = FSM_STATE_IDX_INACTIVE;
+
+  /* Binary search of the row, events are stored in ascending order. */
+  while(u4_t_low < u4_t_high)
+  {
+    u4_t_mid = u4_t_low + ((u4_t_high - u4_t_low) >> 1);
+
+    if(fsm_sas_fsmTable.evtList[u4_t_mid] < (FSM_EVT_IDX)evt)
+    {
+      u4_t_low = u4_t_mid + 1;
+    }
+    else if(fsm_sas_fsmTable.evtList[u4_t_mid] > (FSM_EVT_IDX)evt)
+    {
+      u4_t_high = u4_t_mid;
+    }
+    else
+    {
+      state_t_nextState = fsm_sas_fsmTable.nextState[u4_t_mid];
+      u4_t_low          = u4_t_high;
+
+      FSM_CHAIN_SET(fsm_sas_fsmTable.chain[u4_t_mid]);
+    }
+  }
+
+  return (state_t_nextState);
+#elif (FSM_TABLE_FORMAT == FSM_TABLE_SWITCH)
+  return (state_fsm_tableDispatch(state, evt FSM_CHAIN_ARG(chain)));
+#else
+  FSM_CHAIN_SET(fsm_sas_fsmTable.chain[state][evt]);
+
+  return (fsm_sas_fsmTable.nextState[state][evt]);
+#endif
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_callExit                                       */
+/*  Purpose:       Call the exit function of a state if defined.         */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_STATE_IDX state:                                  */
+/*                    State exited.                                      */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static inline void vd_fsm_callExit(FSM_INST inst, FSM_STATE_IDX state FSM_PAYLOAD_PARAM)
+{
+#ifdef FSM_CFG_INSTRUMENT
+  U4 u4_t_cbTicks;
+#endif
+
+  if(fsm_sa_exitFp[state] != (FSMExitFp)FSM_NULL)
+  {
+#ifdef FSM_CFG_INSTRUMENT
+    u4_t_cbTicks = u4_fsm_getTicks();
+    fsm_sa_exitFp[state](inst FSM_PAYLOAD_ARG(payload));
+    vd_fsm_instrExit(u4_t_cbTicks, u4_fsm_getTicks());
+#else
+    fsm_sa_exitFp[state](inst FSM_PAYLOAD_ARG(payload));
+#endif
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_callEntry                                      */
+/*  Purpose:       Call the entry function of a state if defined.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_STATE_IDX state:                                  */
+/*                    State entered.                                     */
+/*                 U1 reentrySts:                                        */
+/*                    FSM_STATE_REENTRY if the state was just exited.    */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static inline void vd_fsm_callEntry(FSM_INST inst, FSM_STATE_IDX state, U1 reentrySts FSM_PAYLOAD_PARAM)
+{
+#ifdef FSM_CFG_INSTRUMENT
+  U4 u4_t_cbTicks;
+#endif
+
+  if(fsm_sa_entryFp[state] != (FSMEntryFp)FSM_NULL)
+  {
+#ifdef FSM_CFG_INSTRUMENT
+    u4_t_cbTicks = u4_fsm_getTicks();
+    fsm_sa_entryFp[state](inst, reentrySts FSM_PAYLOAD_ARG(payload));
+    vd_fsm_instrEntry(u4_t_cbTicks, u4_fsm_getTicks());
+#else
+    fsm_sa_entryFp[state](inst, reentrySts FSM_PAYLOAD_ARG(payload));
+#endif
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_resetInst                                      */
+/*  Purpose:       Put an instance in the initial state and empty its    */
+/*                 event queue.                                          */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_resetInst(FSM_INST inst)
+{
+  fsm_enterCritical();
+
+#ifdef FSM_CFG_TRACE
+  vd_fsm_traceRecord(inst, FSM_TRACE_EVT_RESET, state_sa_currentState[inst], FSM_STATE_INITIAL);
+#endif
+
+  FSM_STATE_STORE(inst, FSM_STATE_INITIAL);
+  state_sa_prevState[inst] = FSM_STATE_INITIAL;
+
+  vd_fsm_discardEvts(inst);
+
+#ifdef FSM_CFG_INSTRUMENT
+  vd_fsm_instrResetInst(inst);
+#endif
+
+  fsm_exitCritical();
+
+#ifdef FSM_CFG_TIMER
+  vd_fsm_timerArm(inst, FSM_STATE_INITIAL);
+#endif
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_discardEvts                                    */
+/*  Purpose:       Empty the event queue of an instance, returning       */
+/*                 payloads of discarded events to the pool.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_discardEvts(FSM_INST inst)
+{
+#ifdef FSM_CFG_PAYLOAD
+  FSM_QUEUE_ITEM evt_t_item;
+#endif
+#if defined(FSM_CFG_DEFER) && defined(FSM_CFG_PAYLOAD)
+  U4 u4_t_idx;
+#endif
+
+#if defined(FSM_CFG_DEFER) && defined(FSM_CFG_PAYLOAD)
+  for(u4_t_idx = 0; u4_t_idx < u1_sa_deferCount[inst]; u4_t_idx++)
+  {
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD(evt_sa_deferList[inst][u4_t_idx]));
+  }
+#endif
+
+#ifdef FSM_CFG_DEFER
+  u1_sa_deferCount[inst]  = 0;
+  u1_sa_deferReplay[inst] = FSM_FALSE;
+#endif
+#ifdef FSM_CFG_ASYNC
+  vd_fsm_asyncCancel(inst);
+#endif
+
+#ifdef FSM_CFG_PAYLOAD
+  evt_t_item = evt_fsm_evtQueueGet(inst);
+
+  while(FSM_QUEUE_ITEM_EVT(evt_t_item) != FSM_EVT_NULL)
+  {
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD(evt_t_item));
+    evt_t_item = evt_fsm_evtQueueGet(inst);
+  }
+#endif
+
+  vd_fsm_evtQueueReset(inst);
+
+#ifdef FSM_CFG_COALESCE
+  vd_fsm_coalesceReset(inst);
+#endif
+}
+
+/*************************************************************************/
+/* History                                                               */
+/*************************************************************************/
+/* 10/20/2020      First implementation.                                 */
+/* 10/17/2026      Instance pool, multiple machines share one table.     */
+/* 10/17/2026      Batched serve with event/time budget.                 */
+/* 10/17/2026      Compact dense/sparse state table, marked bitset.      */
+/* 10/17/2026      State table moved to generated fsm_table.c.           */
+/* 10/17/2026      Optional transition statistics, FSM_CFG_INSTRUMENT.   */
+/* 10/17/2026      Optional event payloads, FSM_CFG_PAYLOAD.             */
+/* 10/17/2026      Optional state timeouts, FSM_CFG_TIMER.               */
+/* 10/17/2026      Optional nested states, FSM_CFG_HIERARCHY.            */
+/* 10/17/2026      Optional deferred events, FSM_CFG_DEFER.              */
+/* 10/17/2026      Optional batch stepping, FSM_CFG_BATCH.               */
+/* 10/17/2026      Optional transition trace, FSM_CFG_TRACE.             */
+/* 10/17/2026      Optional instance snapshot, FSM_CFG_SNAPSHOT.         */
+/* 10/17/2026      Optional asynchronous entry actions, FSM_CFG_ASYNC.   */
+/* 10/17/2026      Optional event coalescing, FSM_CFG_COALESCE.          */
+/* 10/17/2026      Optional blocking wait on an eventfd, FSM_CFG_WAIT.   */
+/* 10/17/2026      Optional accepted event bitsets, FSM_CFG_FILTER.      */
+/*                                                                       */
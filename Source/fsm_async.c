@@ -0,0 +1,422 @@
+/*************************************************************************/
+/*  File Name: fsm_async.c                                               */
+/*  Purpose: Optional asynchronous entry actions for the FSM module,     */
+/*           compiled in with FSM_CFG_ASYNC. Needs POSIX threads.        */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_exec.h"
+#include "fsm_wait.h"
+#include "fsm_payload.h"
+#include "fsm_async.h"
+
+#ifdef FSM_CFG_ASYNC
+
+#include <pthread.h>
+
+_Static_assert((FSM_ASYNC_QUEUE_LENGTH & (FSM_ASYNC_QUEUE_LENGTH - 1)) == 0,
+               "FSM_ASYNC_QUEUE_LENGTH must be a power of 2");
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+typedef struct FSMAsyncJob
+{
+  FSMAsyncFp fp;
+  FSM_INST   inst;
+  U4         ticket;
+  U1         reentrySts;
+}
+FSMAsyncJob;
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+atomic_ullong u8_sa_asyncDone[FSM_NUM_INSTANCES];
+
+/* Set from dispatch until the completion is taken or dropped. */
+static atomic_uchar u1_sa_asyncPending[FSM_NUM_INSTANCES];
+
+/* Bumped by every dispatch and cancel, a completion is only served if the
+   ticket it was started with is still current. */
+static atomic_uint u4_sa_asyncTicket[FSM_NUM_INSTANCES];
+
+/* Actions waiting for a worker, under fsm_s_asyncMutex. */
+static FSMAsyncJob fsm_sas_asyncJob[FSM_ASYNC_QUEUE_LENGTH];
+static U4          u4_s_asyncPut;
+static U4          u4_s_asyncGet;
+
+static pthread_t       fsm_sa_asyncThread[FSM_ASYNC_MAX_WORKERS];
+static U4              u4_s_asyncNumWorkers;
+static U1              u1_s_asyncRunning;
+static U1              u1_s_asyncStop;
+static pthread_mutex_t fsm_s_asyncMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  fsm_s_asyncCond  = PTHREAD_COND_INITIALIZER;
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static void vd_fsm_asyncComplete(const FSMAsyncJob* job);
+static void* vd_fsm_asyncWorker(void* arg);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_asyncStart                                     */
+/*  Purpose:       Start worker threads for asynchronous actions.        */
+/*  Arguments:     U4 numWorkers:                                        */
+/*                    1 to FSM_ASYNC_MAX_WORKERS.                        */
+/*  Return:        U1 FSM_ASYNC_STARTED         OR                       */
+/*                    FSM_ASYNC_START_FAILED                             */
+/*************************************************************************/
+U1 u1_fsm_asyncStart(U4 numWorkers)
+{
+  U4 u4_t_started;
+  U1 u1_t_rtnSts;
+
+  u1_t_rtnSts = FSM_ASYNC_START_FAILED;
+
+  pthread_mutex_lock(&fsm_s_asyncMutex);
+
+  if((numWorkers >= 1) && (numWorkers <= FSM_ASYNC_MAX_WORKERS) && (u1_s_asyncRunning == FSM_FALSE))
+  {
+    u1_s_asyncStop    = FSM_FALSE;
+    u1_s_asyncRunning = FSM_TRUE;
+    u1_t_rtnSts       = FSM_ASYNC_STARTED;
+    u4_t_started      = 0;
+
+    while((u4_t_started < numWorkers) && (u1_t_rtnSts == FSM_ASYNC_STARTED))
+    {
+      if(pthread_create(&fsm_sa_asyncThread[u4_t_started], NULL, vd_fsm_asyncWorker, NULL) == 0)
+      {
+        u4_t_started++;
+      }
+      else
+      {
+        u1_t_rtnSts       = FSM_ASYNC_START_FAILED;
+        u1_s_asyncRunning = (u4_t_started != 0) ? FSM_TRUE : FSM_FALSE;
+      }
+    }
+
+    u4_s_asyncNumWorkers = u4_t_started;
+  }
+  else
+  {
+    u4_t_started = 0;
+  }
+
+  pthread_mutex_unlock(&fsm_s_asyncMutex);
+
+  /* Undo a partial start. */
+  if((u1_t_rtnSts == FSM_ASYNC_START_FAILED) && (u4_t_started != 0))
+  {
+    vd_fsm_asyncStop();
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncStop                                      */
+/*  Purpose:       Run the actions still waiting, then stop and join the */
+/*                 worker threads.                                       */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncStop(void)
+{
+  U4 u4_t_idx;
+  U4 u4_t_numWorkers;
+
+  pthread_mutex_lock(&fsm_s_asyncMutex);
+
+  u4_t_numWorkers      = u4_s_asyncNumWorkers;
+  u4_s_asyncNumWorkers = 0;
+  u1_s_asyncStop       = FSM_TRUE;
+  pthread_cond_broadcast(&fsm_s_asyncCond);
+
+  pthread_mutex_unlock(&fsm_s_asyncMutex);
+
+  for(u4_t_idx = 0; u4_t_idx < u4_t_numWorkers; u4_t_idx++)
+  {
+    pthread_join(fsm_sa_asyncThread[u4_t_idx], NULL);
+  }
+
+  pthread_mutex_lock(&fsm_s_asyncMutex);
+  u1_s_asyncRunning = FSM_FALSE;
+  pthread_mutex_unlock(&fsm_s_asyncMutex);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_asyncPending                                   */
+/*  Purpose:       Check if an instance waits for the completion of an   */
+/*                 asynchronous action.                                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+U1 u1_fsm_asyncPending(FSM_INST inst)
+{
+  return (((inst >= 0) && (inst < FSM_NUM_INSTANCES) &&
+           (atomic_load_explicit(&u1_sa_asyncPending[inst], memory_order_acquire) != 0)) ? FSM_TRUE : FSM_FALSE);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncDispatch                                  */
+/*  Purpose:       Start the action of a state just entered, dropping    */
+/*                 the completion of an earlier one.                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSMAsyncFp fp:                                        */
+/*                    Action of the state.                               */
+/*                 U1 reentrySts:                                        */
+/*                    FSM_STATE_REENTRY if the state was just exited.    */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncDispatch(FSM_INST inst, FSMAsyncFp fp, U1 reentrySts)
+{
+  FSMAsyncJob fsm_t_job;
+  U1 u1_t_queuedFlag;
+
+  vd_fsm_asyncCancel(inst);
+
+  fsm_t_job.fp         = fp;
+  fsm_t_job.inst       = inst;
+  fsm_t_job.reentrySts = reentrySts;
+  fsm_t_job.ticket     = (U4)((atomic_fetch_add_explicit(&u4_sa_asyncTicket[inst], 1, memory_order_relaxed) + 1) &
+                             FSM_ASYNC_TICKET_MASK);
+  u1_t_queuedFlag      = FSM_FALSE;
+
+  atomic_store_explicit(&u1_sa_asyncPending[inst], FSM_TRUE, memory_order_release);
+
+  pthread_mutex_lock(&fsm_s_asyncMutex);
+
+  if((u4_s_asyncNumWorkers != 0) && (u1_s_asyncStop == FSM_FALSE) &&
+     ((U4)(u4_s_asyncPut - u4_s_asyncGet) < FSM_ASYNC_QUEUE_LENGTH))
+  {
+    fsm_sas_asyncJob[u4_s_asyncPut & (FSM_ASYNC_QUEUE_LENGTH - 1)] = fsm_t_job;
+    u4_s_asyncPut++;
+    u1_t_queuedFlag = FSM_TRUE;
+    pthread_cond_signal(&fsm_s_asyncCond);
+  }
+  else
+  {
+
+  }
+
+  pthread_mutex_unlock(&fsm_s_asyncMutex);
+
+  /* No worker to take it, run it here. */
+  if(u1_t_queuedFlag == FSM_FALSE)
+  {
+    vd_fsm_asyncComplete(&fsm_t_job);
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncCancel                                    */
+/*  Purpose:       Drop the completion of the running action of an       */
+/*                 instance, if any. The action itself runs to the end.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_asyncCancel(FSM_INST inst)
+{
+  unsigned long long u8_t_done;
+
+  if((atomic_load_explicit(&u1_sa_asyncPending[inst], memory_order_relaxed) != 0) &&
+     (atomic_exchange_explicit(&u1_sa_asyncPending[inst], FSM_FALSE, memory_order_acq_rel) != 0))
+  {
+    atomic_fetch_add_explicit(&u4_sa_asyncTicket[inst], 1, memory_order_relaxed);
+  }
+  else
+  {
+
+  }
+
+  if(atomic_load_explicit(&u8_sa_asyncDone[inst], memory_order_relaxed) != 0)
+  {
+    u8_t_done = atomic_exchange_explicit(&u8_sa_asyncDone[inst], 0, memory_order_acquire);
+
+#ifdef FSM_CFG_PAYLOAD
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD((FSM_QUEUE_ITEM)u8_t_done));
+#else
+    (void)u8_t_done;
+#endif
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_asyncTakeSlot                                 */
+/*  Purpose:       Empty the completion slot of an instance.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        FSM_QUEUE_ITEM completion event    OR                 */
+/*                 FSM_QUEUE_ITEM_NULL if dropped                        */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_asyncTakeSlot(FSM_INST inst)
+{
+  unsigned long long u8_t_done;
+  FSM_QUEUE_ITEM evt_t_item;
+
+  u8_t_done  = atomic_exchange_explicit(&u8_sa_asyncDone[inst], 0, memory_order_acquire);
+  evt_t_item = (FSM_QUEUE_ITEM)u8_t_done;
+
+  if((u8_t_done != 0) &&
+     ((U4)((u8_t_done >> 32) & FSM_ASYNC_TICKET_MASK) ==
+      (U4)(atomic_load_explicit(&u4_sa_asyncTicket[inst], memory_order_relaxed) & FSM_ASYNC_TICKET_MASK)))
+  {
+    atomic_store_explicit(&u1_sa_asyncPending[inst], FSM_FALSE, memory_order_release);
+  }
+  else
+  {
+#ifdef FSM_CFG_PAYLOAD
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD(evt_t_item));
+#endif
+    evt_t_item = FSM_QUEUE_ITEM_NULL;
+  }
+
+  return (evt_t_item);
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncComplete                                  */
+/*  Purpose:       Run an action and put its result in the completion    */
+/*                 slot, unless the instance left the state meanwhile.   */
+/*  Arguments:     const FSMAsyncJob* job:                               */
+/*                    Action to run.                                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_asyncComplete(const FSMAsyncJob* job)
+{
+  unsigned long long u8_t_prev;
+  unsigned long long u8_t_done;
+  FSM_QUEUE_ITEM evt_t_item;
+  U1 u1_t_storedFlag;
+  U1 u1_t_doneFlag;
+
+  evt_t_item      = job->fp(job->inst, job->reentrySts);
+  u8_t_done       = FSM_ASYNC_DONE | ((unsigned long long)job->ticket << 32) |
+                    (unsigned long long)(unsigned int)evt_t_item;
+  u8_t_prev       = atomic_load_explicit(&u8_sa_asyncDone[job->inst], memory_order_relaxed);
+  u1_t_storedFlag = FSM_FALSE;
+  u1_t_doneFlag   = FSM_FALSE;
+
+  /* The ticket is checked again on every try, a newer action that
+     completes meanwhile changes the slot and is never replaced. */
+  while(u1_t_doneFlag == FSM_FALSE)
+  {
+    if((U4)(atomic_load_explicit(&u4_sa_asyncTicket[job->inst], memory_order_acquire) & FSM_ASYNC_TICKET_MASK) !=
+       job->ticket)
+    {
+      u1_t_doneFlag = FSM_TRUE;
+    }
+    /* A completion still in the slot is stale, this ticket is current. */
+    else if(atomic_compare_exchange_weak_explicit(&u8_sa_asyncDone[job->inst], &u8_t_prev, u8_t_done,
+                                                  memory_order_acq_rel, memory_order_relaxed))
+    {
+      u1_t_storedFlag = FSM_TRUE;
+      u1_t_doneFlag   = FSM_TRUE;
+    }
+    else
+    {
+
+    }
+  }
+
+  if(u1_t_storedFlag == FSM_TRUE)
+  {
+#ifdef FSM_CFG_PAYLOAD
+    if(u8_t_prev != 0)
+    {
+      vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD((FSM_QUEUE_ITEM)u8_t_prev));
+    }
+    else
+    {
+
+    }
+#endif
+
+    vd_fsm_asyncNotify(job->inst);
+  }
+  else
+  {
+#ifdef FSM_CFG_PAYLOAD
+    vd_fsm_payloadFree(FSM_QUEUE_ITEM_PAYLOAD(evt_t_item));
+#endif
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_asyncWorker                                    */
+/*  Purpose:       Worker thread, runs waiting actions until stopped.    */
+/*  Arguments:     void* arg:                                            */
+/*                    Unused.                                            */
+/*  Return:        NULL                                                  */
+/*************************************************************************/
+static void* vd_fsm_asyncWorker(void* arg)
+{
+  FSMAsyncJob fsm_t_job;
+  U1 u1_t_runFlag;
+
+  (void)arg;
+  u1_t_runFlag = FSM_TRUE;
+
+  while(u1_t_runFlag == FSM_TRUE)
+  {
+    pthread_mutex_lock(&fsm_s_asyncMutex);
+
+    while((u4_s_asyncPut == u4_s_asyncGet) && (u1_s_asyncStop == FSM_FALSE))
+    {
+      pthread_cond_wait(&fsm_s_asyncCond, &fsm_s_asyncMutex);
+    }
+
+    if(u4_s_asyncPut != u4_s_asyncGet)
+    {
+      fsm_t_job = fsm_sas_asyncJob[u4_s_asyncGet & (FSM_ASYNC_QUEUE_LENGTH - 1)];
+      u4_s_asyncGet++;
+    }
+    else
+    {
+      u1_t_runFlag = FSM_FALSE;
+    }
+
+    pthread_mutex_unlock(&fsm_s_asyncMutex);
+
+    if(u1_t_runFlag == FSM_TRUE)
+    {
+      vd_fsm_asyncComplete(&fsm_t_job);
+    }
+    else
+    {
+
+    }
+  }
+
+  return (NULL);
+}
+
+#endif
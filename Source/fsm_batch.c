@@ -0,0 +1,274 @@
+/*************************************************************************/
+/*  File Name: fsm_batch.c                                               */
+/*  Purpose: Optional batch stepping for the FSM module, compiled in     */
+/*           with FSM_CFG_BATCH.                                         */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include "fsm.h"
+#include "fsm_batch.h"
+
+#ifdef FSM_CFG_BATCH
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define FSM_BATCH_X86
+#include <immintrin.h>
+#endif
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+_Static_assert(sizeof(FSM_EVT) == sizeof(U4), "FSM_CFG_BATCH loads events as 32 bit lanes");
+_Static_assert((unsigned long long)FSM_STATE_COUNT * FSM_EVT_COUNT <= 0x7FFFFFFFull,
+               "FSM_CFG_BATCH indexes the flattened table with 32 bit lanes");
+_Static_assert((unsigned long long)FSM_STATE_COUNT * FSM_EVT_COUNT <= (unsigned long long)FSM_BATCH_MAX_ENTRIES,
+               "FSM_CFG_BATCH flattened table above FSM_BATCH_MAX_ENTRIES, see fsm_batch.h");
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+typedef U4 (*FSMBatchKernel)(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask);
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+/* Next state per (state, event) at state * FSM_NUM_EVENTS + event, or
+   FSM_STATE_INACTIVE. Any table format flattens to this so the kernels
+   need a single gather per lane. */
+static _Alignas(FSM_CACHE_LINE_SIZE) U4 u4_sa_batchTable[FSM_STATE_COUNT * FSM_EVT_COUNT];
+
+static FSMBatchKernel fsm_s_batchKernel;
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static U4 u4_fsm_batchScalar(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask);
+#ifdef FSM_BATCH_X86
+static U4 u4_fsm_batchAvx2(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask);
+static U4 u4_fsm_batchAvx512(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask);
+#endif
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_batchInit                                      */
+/*  Purpose:       Flatten the state table and select the fastest kernel */
+/*                 the CPU supports. Called by vd_fsm_init().            */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_batchInit(void)
+{
+  U4 u4_t_state;
+  U4 u4_t_evt;
+
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      u4_sa_batchTable[(u4_t_state * FSM_NUM_EVENTS) + u4_t_evt] = u4_fsm_getTransition(u4_t_state,
+                                                                                        (FSM_EVT)u4_t_evt);
+    }
+  }
+
+  (void)u1_fsm_batchSetKernel(FSM_BATCH_KERNEL_AVX512);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_batchSetKernel                                 */
+/*  Purpose:       Select a kernel, falls back to the next slower one    */
+/*                 the CPU supports.                                     */
+/*  Arguments:     U1 kernel:                                            */
+/*                    FSM_BATCH_KERNEL_AVX512    OR                      */
+/*                    FSM_BATCH_KERNEL_AVX2      OR                      */
+/*                    FSM_BATCH_KERNEL_SCALAR                            */
+/*  Return:        U1 kernel selected                                    */
+/*************************************************************************/
+U1 u1_fsm_batchSetKernel(U1 kernel)
+{
+  U1 u1_t_rtn;
+
+  u1_t_rtn          = FSM_BATCH_KERNEL_SCALAR;
+  fsm_s_batchKernel = u4_fsm_batchScalar;
+
+#ifdef FSM_BATCH_X86
+  __builtin_cpu_init();
+
+  if((kernel >= FSM_BATCH_KERNEL_AVX512) && (__builtin_cpu_supports("avx512f") != 0))
+  {
+    u1_t_rtn          = FSM_BATCH_KERNEL_AVX512;
+    fsm_s_batchKernel = u4_fsm_batchAvx512;
+  }
+  else if((kernel >= FSM_BATCH_KERNEL_AVX2) && (__builtin_cpu_supports("avx2") != 0))
+  {
+    u1_t_rtn          = FSM_BATCH_KERNEL_AVX2;
+    fsm_s_batchKernel = u4_fsm_batchAvx2;
+  }
+  else
+  {
+
+  }
+#else
+  (void)kernel;
+#endif
+
+  return (u1_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_batchStep                                      */
+/*  Purpose:       Step count lanes through the state table. Lanes whose */
+/*                 event has a transition take it and get their bit set  */
+/*                 in transMask, self-loops included since they run      */
+/*                 exit and re-entry callbacks. Other lanes are left     */
+/*                 alone with their bit clear. No instance is touched.   */
+/*  Arguments:     U4* state:                                            */
+/*                    Current states in, next states out. Each must be   */
+/*                    below FSM_NUM_STATES.                              */
+/*                 const FSM_EVT* evt:                                   */
+/*                    Event per lane, each below FSM_NUM_EVENTS.         */
+/*                 U4 count:                                             */
+/*                    Number of lanes.                                   */
+/*                 unsigned int* transMask:                              */
+/*                    FSM_BATCH_MASK_LENGTH(count) words, written.       */
+/*  Return:        U4 number of lanes that took a transition             */
+/*************************************************************************/
+U4 u4_fsm_batchStep(U4* state, const FSM_EVT* evt, U4 count, unsigned int* transMask)
+{
+  U4 u4_t_word;
+
+  for(u4_t_word = 0; u4_t_word < FSM_BATCH_MASK_LENGTH(count); u4_t_word++)
+  {
+    transMask[u4_t_word] = 0;
+  }
+
+  return (fsm_s_batchKernel(state, evt, 0, count, transMask));
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u4_fsm_batchScalar                                    */
+/*  Purpose:       Step lanes one at a time. Fallback kernel and tail of */
+/*                 the vector kernels.                                   */
+/*  Arguments:     U4* state, const FSM_EVT* evt, U4 count,              */
+/*                 unsigned int* transMask:                              */
+/*                    As u4_fsm_batchStep(), mask cleared.               */
+/*                 U4 first:                                             */
+/*                    First lane to step.                                */
+/*  Return:        U4 number of lanes that took a transition             */
+/*************************************************************************/
+static U4 u4_fsm_batchScalar(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask)
+{
+  U4 u4_t_lane;
+  U4 u4_t_next;
+  U4 u4_t_rtn;
+
+  u4_t_rtn = 0;
+
+  for(u4_t_lane = first; u4_t_lane < count; u4_t_lane++)
+  {
+    u4_t_next = u4_sa_batchTable[(state[u4_t_lane] * FSM_NUM_EVENTS) + (U4)evt[u4_t_lane]];
+
+    if(u4_t_next != FSM_STATE_INACTIVE)
+    {
+      state[u4_t_lane]           = u4_t_next;
+      transMask[u4_t_lane >> 5] |= 1u << (u4_t_lane & 31);
+      u4_t_rtn++;
+    }
+    else
+    {
+
+    }
+  }
+
+  return (u4_t_rtn);
+}
+
+#ifdef FSM_BATCH_X86
+/*************************************************************************/
+/*  Function Name: u4_fsm_batchAvx2                                      */
+/*  Purpose:       Step 8 lanes per gather, the rest with                */
+/*                 u4_fsm_batchScalar().                                 */
+/*  Arguments:     As u4_fsm_batchScalar(), first is a multiple of 32.   */
+/*  Return:        U4 number of lanes that took a transition             */
+/*************************************************************************/
+__attribute__((target("avx2")))
+static U4 u4_fsm_batchAvx2(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask)
+{
+  __m256i v_t_numEvts;
+  __m256i v_t_inactive;
+  __m256i v_t_state;
+  __m256i v_t_next;
+  __m256i v_t_take;
+  unsigned int u4_t_bits;
+  U4 u4_t_lane;
+  U4 u4_t_rtn;
+
+  v_t_numEvts  = _mm256_set1_epi32(FSM_NUM_EVENTS);
+  v_t_inactive = _mm256_set1_epi32(FSM_STATE_INACTIVE);
+  u4_t_rtn     = 0;
+
+  for(u4_t_lane = first; (u4_t_lane + 8) <= count; u4_t_lane += 8)
+  {
+    v_t_state = _mm256_loadu_si256((const __m256i*)&state[u4_t_lane]);
+    v_t_next  = _mm256_add_epi32(_mm256_mullo_epi32(v_t_state, v_t_numEvts),
+                                 _mm256_loadu_si256((const __m256i*)&evt[u4_t_lane]));
+    v_t_next  = _mm256_i32gather_epi32((const int*)u4_sa_batchTable, v_t_next, 4);
+    v_t_take  = _mm256_cmpgt_epi32(v_t_next, v_t_inactive);
+
+    _mm256_storeu_si256((__m256i*)&state[u4_t_lane], _mm256_blendv_epi8(v_t_state, v_t_next, v_t_take));
+
+    u4_t_bits                   = (unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(v_t_take));
+    transMask[u4_t_lane >> 5] |= u4_t_bits << (u4_t_lane & 31);
+    u4_t_rtn                   += (U4)__builtin_popcount(u4_t_bits);
+  }
+
+  return (u4_t_rtn + u4_fsm_batchScalar(state, evt, u4_t_lane, count, transMask));
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_batchAvx512                                    */
+/*  Purpose:       Step 16 lanes per gather, the rest with               */
+/*                 u4_fsm_batchScalar().                                 */
+/*  Arguments:     As u4_fsm_batchScalar(), first is a multiple of 32.   */
+/*  Return:        U4 number of lanes that took a transition             */
+/*************************************************************************/
+__attribute__((target("avx512f")))
+static U4 u4_fsm_batchAvx512(U4* state, const FSM_EVT* evt, U4 first, U4 count, unsigned int* transMask)
+{
+  __m512i v_t_numEvts;
+  __m512i v_t_inactive;
+  __m512i v_t_state;
+  __m512i v_t_next;
+  __mmask16 u2_t_take;
+  U4 u4_t_lane;
+  U4 u4_t_rtn;
+
+  v_t_numEvts  = _mm512_set1_epi32(FSM_NUM_EVENTS);
+  v_t_inactive = _mm512_set1_epi32(FSM_STATE_INACTIVE);
+  u4_t_rtn     = 0;
+
+  for(u4_t_lane = first; (u4_t_lane + 16) <= count; u4_t_lane += 16)
+  {
+    v_t_state = _mm512_loadu_si512((const void*)&state[u4_t_lane]);
+    v_t_next  = _mm512_add_epi32(_mm512_mullo_epi32(v_t_state, v_t_numEvts),
+                                 _mm512_loadu_si512((const void*)&evt[u4_t_lane]));
+    v_t_next  = _mm512_i32gather_epi32(v_t_next, (const void*)u4_sa_batchTable, 4);
+    u2_t_take = _mm512_cmpgt_epi32_mask(v_t_next, v_t_inactive);
+
+    _mm512_storeu_si512((void*)&state[u4_t_lane], _mm512_mask_blend_epi32(u2_t_take, v_t_state, v_t_next));
+
+    transMask[u4_t_lane >> 5] |= (unsigned int)u2_t_take << (u4_t_lane & 31);
+    u4_t_rtn                   += (U4)__builtin_popcount((unsigned int)u2_t_take);
+  }
+
+  return (u4_t_rtn + u4_fsm_batchScalar(state, evt, u4_t_lane, count, transMask));
+}
+#endif
+
+#endif
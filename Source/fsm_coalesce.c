@@ -0,0 +1,382 @@
+/*************************************************************************/
+/*  File Name: fsm_coalesce.c                                            */
+/*  Purpose: Optional event coalescing for the FSM module, compiled in   */
+/*           with FSM_CFG_COALESCE.                                      */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_payload.h"
+#include "fsm_coalesce.h"
+
+#ifdef FSM_CFG_COALESCE
+
+#include <sched.h>
+
+_Static_assert(FSM_COALESCE_SLOT_COUNT <= 0xFF, "FSM_COALESCE_SLOT_COUNT must be at most 255");
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Pending and commit bit of a collapsed event, two bits per event.      */
+#define FSM_COALESCE_BIT(evt)            (1u << (((U4)(evt) & 15) * 2))
+#define FSM_COALESCE_COMMIT_BIT(evt)     (FSM_COALESCE_BIT(evt) << 1)
+#define FSM_COALESCE_WORD(evt)           ((U4)(evt) >> 4)
+
+/* Payload of an event as kept in a slot word, and returning one. */
+#ifdef FSM_CFG_PAYLOAD
+#define FSM_COALESCE_VALUE(item)         ((unsigned int)FSM_QUEUE_ITEM_PAYLOAD(item))
+#define FSM_COALESCE_FREE(value)         vd_fsm_payloadFree((FSM_PAYLOAD)(value))
+#else
+#define FSM_COALESCE_VALUE(item)         0u
+#define FSM_COALESCE_FREE(value)         ((void)(value))
+#endif
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+/* Collapsed events queued per instance, pending and commit bit per
+   event as in a slot word. */
+static atomic_uint u4_sa_coalescePending[FSM_NUM_INSTANCES][FSM_COALESCE_WORDS];
+
+/* Latest and counted events per instance, see FSM_COALESCE_PENDING. */
+static atomic_uint u4_sa_coalesceSlot[FSM_NUM_INSTANCES][FSM_COALESCE_SLOTS];
+
+/* Count of a counted event taken from the queue and not served yet, and
+   of the event being served. Only touched by the serving thread. */
+static U4 u4_sa_coalesceTaken[FSM_NUM_INSTANCES][FSM_COALESCE_SLOTS];
+U4        u4_sa_coalesceServed[FSM_NUM_INSTANCES];
+
+/* Slot per latest or counted event. */
+static U1 u1_sa_coalesceSlot[FSM_EVT_COUNT];
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceInit                                   */
+/*  Purpose:       Give every latest or counted event its slot. Called   */
+/*                 from vd_fsm_init().                                   */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceInit(void)
+{
+  U4 u4_t_evt;
+  U4 u4_t_slot;
+
+  u4_t_slot = 0;
+
+  for(u4_t_evt = 0; u4_t_evt < FSM_EVT_COUNT; u4_t_evt++)
+  {
+    if(fsm_sa_evtCoalesce[u4_t_evt] >= FSM_COALESCE_LATEST)
+    {
+      u1_sa_coalesceSlot[u4_t_evt] = (U1)u4_t_slot;
+      u4_t_slot++;
+    }
+    else
+    {
+
+    }
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_coalescePutEvt                                 */
+/*  Purpose:       Merge an event into the same one still queued, or     */
+/*                 queue it. Safe from any thread.                       */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event with a policy other than FSM_COALESCE_NONE.  */
+/*  Return:        U1 FSM_EVT_REGISTERED if queued or merged    OR       */
+/*                    return value from the queue API                    */
+/*************************************************************************/
+U1 u1_fsm_coalescePutEvt(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  atomic_uint* pu4_t_word;
+  FSM_EVT evt_t_evt;
+  unsigned int u4_t_old;
+  unsigned int u4_t_new;
+  unsigned int u4_t_pending;
+  unsigned int u4_t_commit;
+  U1 u1_t_policy;
+  U1 u1_t_rtnSts;
+  U1 u1_t_doneFlag;
+
+  evt_t_evt   = FSM_QUEUE_ITEM_EVT(item);
+  u1_t_policy = fsm_sa_evtCoalesce[evt_t_evt];
+
+  if(u1_t_policy == FSM_COALESCE_COLLAPSE)
+  {
+    pu4_t_word   = &u4_sa_coalescePending[inst][FSM_COALESCE_WORD(evt_t_evt)];
+    u4_t_pending = FSM_COALESCE_BIT(evt_t_evt);
+    u4_t_commit  = FSM_COALESCE_COMMIT_BIT(evt_t_evt);
+  }
+  else
+  {
+    pu4_t_word   = &u4_sa_coalesceSlot[inst][u1_sa_coalesceSlot[evt_t_evt]];
+    u4_t_pending = FSM_COALESCE_PENDING;
+    u4_t_commit  = FSM_COALESCE_COMMIT;
+  }
+
+  u1_t_rtnSts   = FSM_EVT_REGISTERED;
+  u1_t_doneFlag = FSM_FALSE;
+  u4_t_old      = atomic_load(pu4_t_word);
+
+  while(u1_t_doneFlag == FSM_FALSE)
+  {
+    /* The first event is being queued, merging now could lose the new
+       one if that fails. */
+    if((u4_t_old & u4_t_commit) != 0)
+    {
+      sched_yield();
+      u4_t_old = atomic_load(pu4_t_word);
+    }
+    else if((u4_t_old & u4_t_pending) != 0)
+    {
+      if(u1_t_policy == FSM_COALESCE_COLLAPSE)
+      {
+        FSM_COALESCE_FREE(FSM_COALESCE_VALUE(item));
+        u1_t_doneFlag = FSM_TRUE;
+      }
+      else
+      {
+        if(u1_t_policy == FSM_COALESCE_LATEST)
+        {
+          u4_t_new = FSM_COALESCE_PENDING | FSM_COALESCE_VALUE(item);
+        }
+        else
+        {
+          u4_t_new = ((u4_t_old & FSM_COALESCE_VALUE_MASK) < FSM_COALESCE_VALUE_MASK) ? (u4_t_old + 1) : u4_t_old;
+        }
+
+        if(atomic_compare_exchange_weak(pu4_t_word, &u4_t_old, u4_t_new))
+        {
+          /* Latest drops the older payload, count keeps the first. */
+          FSM_COALESCE_FREE((u1_t_policy == FSM_COALESCE_LATEST) ? (u4_t_old & FSM_COALESCE_VALUE_MASK) :
+                            FSM_COALESCE_VALUE(item));
+          u1_t_doneFlag = FSM_TRUE;
+        }
+        else
+        {
+
+        }
+      }
+    }
+    else
+    {
+      /* Collapsed events share the word with others, slots hold one. */
+      if(u1_t_policy == FSM_COALESCE_COLLAPSE)
+      {
+        u4_t_new = u4_t_old | u4_t_pending | u4_t_commit;
+      }
+      else
+      {
+        u4_t_new = FSM_COALESCE_PENDING | FSM_COALESCE_COMMIT |
+                   ((u1_t_policy == FSM_COALESCE_LATEST) ? FSM_COALESCE_VALUE(item) : 1u);
+      }
+
+      if(atomic_compare_exchange_weak(pu4_t_word, &u4_t_old, u4_t_new))
+      {
+        /* A latest event is queued without its payload, the slot holds
+           the newest one. */
+        u1_t_rtnSts = u1_fsm_evtQueuePut(inst, (u1_t_policy == FSM_COALESCE_LATEST) ?
+                                         FSM_QUEUE_ITEM_MAKE(evt_t_evt, FSM_PAYLOAD_NONE) : item);
+
+        if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+        {
+          atomic_fetch_and(pu4_t_word, ~u4_t_commit);
+        }
+        /* Nothing merged meanwhile, the caller keeps its payload. */
+        else if(u1_t_policy == FSM_COALESCE_COLLAPSE)
+        {
+          atomic_fetch_and(pu4_t_word, ~(u4_t_pending | u4_t_commit));
+        }
+        else
+        {
+          atomic_store(pu4_t_word, 0);
+        }
+
+        u1_t_doneFlag = FSM_TRUE;
+      }
+      else
+      {
+
+      }
+    }
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_coalesceTakeEvt                               */
+/*  Purpose:       Clear the pending state of an event taken from the    */
+/*                 queue. Only the thread serving the instance.          */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event with a policy other than FSM_COALESCE_NONE.  */
+/*  Return:        FSM_QUEUE_ITEM event to serve    OR                   */
+/*                 FSM_QUEUE_ITEM_NULL if it was merged into an earlier  */
+/*                 one not served yet                                    */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_coalesceTakeEvt(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  FSM_EVT evt_t_evt;
+  unsigned int u4_t_word;
+  U4 u4_t_slot;
+
+  evt_t_evt = FSM_QUEUE_ITEM_EVT(item);
+
+  if(fsm_sa_evtCoalesce[evt_t_evt] == FSM_COALESCE_COLLAPSE)
+  {
+    atomic_fetch_and(&u4_sa_coalescePending[inst][FSM_COALESCE_WORD(evt_t_evt)], ~FSM_COALESCE_BIT(evt_t_evt));
+  }
+  else
+  {
+    u4_t_slot = u1_sa_coalesceSlot[evt_t_evt];
+    u4_t_word = atomic_exchange(&u4_sa_coalesceSlot[inst][u4_t_slot], 0);
+
+    if((u4_t_word & FSM_COALESCE_PENDING) == 0)
+    {
+      FSM_COALESCE_FREE(FSM_COALESCE_VALUE(item));
+      item = FSM_QUEUE_ITEM_NULL;
+    }
+    else if(fsm_sa_evtCoalesce[evt_t_evt] == FSM_COALESCE_LATEST)
+    {
+      item = FSM_QUEUE_ITEM_MAKE(evt_t_evt, (FSM_PAYLOAD)(u4_t_word & FSM_COALESCE_VALUE_MASK));
+    }
+    /* Counted again before the earlier one was served, add to it. */
+    else if(u4_sa_coalesceTaken[inst][u4_t_slot] != 0)
+    {
+      u4_sa_coalesceTaken[inst][u4_t_slot] += u4_t_word & FSM_COALESCE_VALUE_MASK;
+      FSM_COALESCE_FREE(FSM_COALESCE_VALUE(item));
+      item = FSM_QUEUE_ITEM_NULL;
+    }
+    else
+    {
+      u4_sa_coalesceTaken[inst][u4_t_slot] = u4_t_word & FSM_COALESCE_VALUE_MASK;
+    }
+  }
+
+  return (item);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceServeCount                             */
+/*  Purpose:       Move the count of a counted event into                */
+/*                 u4_fsm_coalesceCount() before it is served.           */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event with FSM_COALESCE_COUNT.                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceServeCount(FSM_INST inst, FSM_EVT evt)
+{
+  U4* pu4_t_taken;
+
+  pu4_t_taken = &u4_sa_coalesceTaken[inst][u1_sa_coalesceSlot[evt]];
+
+  /* An event not from the queue, batch stepped or returned by an
+     asynchronous action, stands for itself. */
+  u4_sa_coalesceServed[inst] = (*pu4_t_taken != 0) ? *pu4_t_taken : 1;
+  *pu4_t_taken               = 0;
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_coalesceCount                                  */
+/*  Purpose:       Return how many events the event being served stands  */
+/*                 for, for use in entry, exit and marked state          */
+/*                 callbacks. 1 unless it has FSM_COALESCE_COUNT.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 count                                              */
+/*************************************************************************/
+U4 u4_fsm_coalesceCount(FSM_INST inst)
+{
+  return (u4_sa_coalesceServed[inst]);
+}
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_coalescePeek                                  */
+/*  Purpose:       Return a queued event with the payload it will be     */
+/*                 served with, without clearing anything.               */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_QUEUE_ITEM item:                                  */
+/*                    Event taken from the queue.                        */
+/*  Return:        FSM_QUEUE_ITEM event                                  */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_coalescePeek(FSM_INST inst, FSM_QUEUE_ITEM item)
+{
+  FSM_EVT evt_t_evt;
+  unsigned int u4_t_word;
+
+  evt_t_evt = FSM_QUEUE_ITEM_EVT(item);
+
+  if(fsm_sa_evtCoalesce[evt_t_evt] == FSM_COALESCE_LATEST)
+  {
+    u4_t_word = atomic_load(&u4_sa_coalesceSlot[inst][u1_sa_coalesceSlot[evt_t_evt]]);
+    item      = ((u4_t_word & FSM_COALESCE_PENDING) != 0) ?
+                FSM_QUEUE_ITEM_MAKE(evt_t_evt, (FSM_PAYLOAD)(u4_t_word & FSM_COALESCE_VALUE_MASK)) : item;
+  }
+  else
+  {
+
+  }
+
+  return (item);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_coalesceReset                                  */
+/*  Purpose:       Forget all pending events of an instance whose queue  */
+/*                 is emptied, returning kept payloads to the pool.      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_coalesceReset(FSM_INST inst)
+{
+  unsigned int u4_t_word;
+  U4 u4_t_idx;
+
+  for(u4_t_idx = 0; u4_t_idx < FSM_COALESCE_WORDS; u4_t_idx++)
+  {
+    atomic_store_explicit(&u4_sa_coalescePending[inst][u4_t_idx], 0, memory_order_relaxed);
+  }
+
+  for(u4_t_idx = 0; u4_t_idx < FSM_EVT_COUNT; u4_t_idx++)
+  {
+    if(fsm_sa_evtCoalesce[u4_t_idx] >= FSM_COALESCE_LATEST)
+    {
+      u4_t_word = atomic_exchange(&u4_sa_coalesceSlot[inst][u1_sa_coalesceSlot[u4_t_idx]], 0);
+
+      if((fsm_sa_evtCoalesce[u4_t_idx] == FSM_COALESCE_LATEST) && ((u4_t_word & FSM_COALESCE_PENDING) != 0))
+      {
+        FSM_COALESCE_FREE(u4_t_word & FSM_COALESCE_VALUE_MASK);
+      }
+      else
+      {
+
+      }
+
+      u4_sa_coalesceTaken[inst][u1_sa_coalesceSlot[u4_t_idx]] = 0;
+    }
+    else
+    {
+
+    }
+  }
+
+  u4_sa_coalesceServed[inst] = 1;
+}
+
+#endif
@@ -0,0 +1,588 @@
+/*************************************************************************/
+/*  File Name: fsm_exec.c                                                */
+/*  Purpose: Optional executor for the FSM module, compiled in with      */
+/*           FSM_CFG_EXECUTOR. Needs POSIX threads.                      */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#ifdef FSM_EXEC_PIN_WORKERS
+#define _GNU_SOURCE
+#else
+#define _POSIX_C_SOURCE 200809L
+#endif
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_exec.h"
+#include "fsm_async.h"
+#include "fsm_timer.h"
+
+#ifdef FSM_CFG_EXECUTOR
+
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Instance has an event to serve, with FSM_CFG_ASYNC also a completion
+   and with FSM_CFG_TIMER an expired timeout. */
+#ifdef FSM_CFG_ASYNC
+#define FSM_EXEC_EVT_WAITING(inst)       ((u4_fsm_evtQueueDepth(inst) != 0) || \
+                                          (u1_fsm_asyncReady(inst) == FSM_TRUE) || \
+                                          (u1_fsm_timerReady(inst) == FSM_TRUE))
+#else
+#define FSM_EXEC_EVT_WAITING(inst)       ((u4_fsm_evtQueueDepth(inst) != 0) || \
+                                          (u1_fsm_timerReady(inst) == FSM_TRUE))
+#endif
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+/* Ready queue of a shard, bounded ring with a sequence number per slot so
+   that posting threads and stealing workers can all use it. An instance
+   is on at most one ready queue at a time and always returns to its own
+   shard, so the ring never holds more entries than the shard has
+   instances. */
+typedef struct FSMExecSlot
+{
+  atomic_ullong sequence;
+  FSM_INST      inst;
+}
+FSMExecSlot;
+
+typedef struct FSMExecShard
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_ullong putIndex;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_ullong getIndex;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) FSMExecSlot*  slotList;
+  unsigned long long                          length;
+  pthread_t                                   thread;
+  U4                                          idx;
+}
+FSMExecShard;
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static FSMExecShard fsm_sas_execShard[FSM_EXEC_MAX_WORKERS];
+static FSMExecSlot  fsm_sas_execSlot[FSM_NUM_INSTANCES + FSM_EXEC_MAX_WORKERS];
+
+/* Set while an instance is on a ready queue or being served. */
+static atomic_uchar u1_sa_execScheduled[FSM_NUM_INSTANCES];
+
+static U4          u4_s_execNumWorkers;
+static U4          u4_s_execShardLength;
+static atomic_int  u1_s_execRunning;
+static atomic_int  u1_s_execStop;
+
+static atomic_int      s4_s_execSleepers;
+static pthread_mutex_t fsm_s_execMutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t  fsm_s_execCond  = PTHREAD_COND_INITIALIZER;
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static void vd_fsm_execPush(FSMExecShard* shard, FSM_INST inst);
+static FSM_INST inst_fsm_execPop(FSMExecShard* shard);
+static FSM_INST inst_fsm_execTake(U4 self);
+static U1 u1_fsm_execAnyReady(void);
+static void vd_fsm_execRun(FSM_INST inst);
+static void vd_fsm_execSleep(void);
+static void* vd_fsm_execWorker(void* arg);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_execStart                                      */
+/*  Purpose:       Start worker threads. Instances that already have     */
+/*                 events waiting are scheduled right away.              */
+/*  Arguments:     U4 numWorkers:                                        */
+/*                    1 to FSM_EXEC_MAX_WORKERS.                         */
+/*  Return:        U1 FSM_EXEC_STARTED         OR                        */
+/*                    FSM_EXEC_START_FAILED                              */
+/*************************************************************************/
+U1 u1_fsm_execStart(U4 numWorkers)
+{
+  FSMExecShard* fsm_t_shard;
+  FSM_INST inst_t_inst;
+  U4 u4_t_idx;
+  U4 u4_t_started;
+  U1 u1_t_rtnSts;
+
+  u1_t_rtnSts = FSM_EXEC_START_FAILED;
+
+  if((numWorkers >= 1) && (numWorkers <= FSM_EXEC_MAX_WORKERS) &&
+     (atomic_load(&u1_s_execRunning) == FSM_FALSE))
+  {
+    u4_s_execNumWorkers  = numWorkers;
+    u4_s_execShardLength = (FSM_NUM_INSTANCES + numWorkers - 1) / numWorkers;
+
+    atomic_store(&u1_s_execStop, FSM_FALSE);
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      atomic_store_explicit(&u1_sa_execScheduled[inst_t_inst], FSM_FALSE, memory_order_relaxed);
+    }
+
+    for(u4_t_idx = 0; u4_t_idx < numWorkers; u4_t_idx++)
+    {
+      fsm_t_shard           = &fsm_sas_execShard[u4_t_idx];
+      fsm_t_shard->idx      = u4_t_idx;
+      fsm_t_shard->length   = (unsigned long long)u4_s_execShardLength;
+      fsm_t_shard->slotList = &fsm_sas_execSlot[u4_t_idx * u4_s_execShardLength];
+
+      atomic_store_explicit(&fsm_t_shard->putIndex, 0, memory_order_relaxed);
+      atomic_store_explicit(&fsm_t_shard->getIndex, 0, memory_order_relaxed);
+
+      for(inst_t_inst = 0; inst_t_inst < u4_s_execShardLength; inst_t_inst++)
+      {
+        atomic_store_explicit(&fsm_t_shard->slotList[inst_t_inst].sequence,
+                              (unsigned long long)inst_t_inst, memory_order_relaxed);
+      }
+    }
+
+    atomic_store(&u1_s_execRunning, FSM_TRUE);
+
+    u1_t_rtnSts  = FSM_EXEC_STARTED;
+    u4_t_started = 0;
+
+    while((u4_t_started < numWorkers) && (u1_t_rtnSts == FSM_EXEC_STARTED))
+    {
+      if(pthread_create(&fsm_sas_execShard[u4_t_started].thread, NULL, vd_fsm_execWorker,
+                        &fsm_sas_execShard[u4_t_started]) == 0)
+      {
+        u4_t_started++;
+      }
+      else
+      {
+        u1_t_rtnSts = FSM_EXEC_START_FAILED;
+      }
+    }
+
+    if(u1_t_rtnSts == FSM_EXEC_STARTED)
+    {
+      for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+      {
+        if(FSM_EXEC_EVT_WAITING(inst_t_inst))
+        {
+          vd_fsm_execNotify(inst_t_inst);
+        }
+        else
+        {
+
+        }
+      }
+    }
+    else
+    {
+      /* Undo a partial start. */
+      u4_s_execNumWorkers = u4_t_started;
+      vd_fsm_execStop();
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execStop                                       */
+/*  Purpose:       Stop and join the worker threads. Events not served   */
+/*                 yet stay in the event queues.                         */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_execStop(void)
+{
+  U4 u4_t_idx;
+
+  if(atomic_load(&u1_s_execRunning) == FSM_TRUE)
+  {
+    pthread_mutex_lock(&fsm_s_execMutex);
+    atomic_store(&u1_s_execStop, FSM_TRUE);
+    pthread_cond_broadcast(&fsm_s_execCond);
+    pthread_mutex_unlock(&fsm_s_execMutex);
+
+    for(u4_t_idx = 0; u4_t_idx < u4_s_execNumWorkers; u4_t_idx++)
+    {
+      pthread_join(fsm_sas_execShard[u4_t_idx].thread, NULL);
+    }
+
+    atomic_store(&u1_s_execRunning, FSM_FALSE);
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_execPostEvt                                    */
+/*  Purpose:       Register an event for an instance and schedule the    */
+/*                 instance on its shard. Safe from any thread.          */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*  Return:        Return value from u1_fsm_instRegisterEvt().           */
+/*************************************************************************/
+U1 u1_fsm_execPostEvt(FSM_INST inst, FSM_EVT evt)
+{
+  U1 u1_t_rtnSts;
+
+  u1_t_rtnSts = u1_fsm_instRegisterEvt(inst, evt);
+
+  if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+  {
+    vd_fsm_execNotify(inst);
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+#ifdef FSM_CFG_PAYLOAD
+/*************************************************************************/
+/*  Function Name: u1_fsm_execPostEvtPayload                             */
+/*  Purpose:       Register an event with a payload for an instance and  */
+/*                 schedule the instance on its shard. Safe from any     */
+/*                 thread. On failure the caller keeps the payload.      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_EVT evt:                                          */
+/*                    Event number defined in enum FSM_EVT.              */
+/*                 FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc().                */
+/*  Return:        Return value from u1_fsm_instRegisterEvtPayload().    */
+/*************************************************************************/
+U1 u1_fsm_execPostEvtPayload(FSM_INST inst, FSM_EVT evt, FSM_PAYLOAD payload)
+{
+  U1 u1_t_rtnSts;
+
+  u1_t_rtnSts = u1_fsm_instRegisterEvtPayload(inst, evt, payload);
+
+  if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+  {
+    vd_fsm_execNotify(inst);
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+#endif
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execNotify                                     */
+/*  Purpose:       Schedule an instance whose queue was filled without   */
+/*                 u1_fsm_execPostEvt(). Does nothing if the instance is */
+/*                 already scheduled or the executor is stopped.         */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_execNotify(FSM_INST inst)
+{
+  /* Pairs with the fence in vd_fsm_execRun(): either the worker sees the
+     event after clearing the flag, or this thread sees the flag clear. */
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if((inst >= 0) && (inst < FSM_NUM_INSTANCES) &&
+     (atomic_load_explicit(&u1_s_execRunning, memory_order_relaxed) == FSM_TRUE) &&
+     (atomic_exchange(&u1_sa_execScheduled[inst], FSM_TRUE) == FSM_FALSE))
+  {
+    vd_fsm_execPush(&fsm_sas_execShard[(U4)inst / u4_s_execShardLength], inst);
+
+    /* Pairs with the count in vd_fsm_execSleep(): either the worker sees
+       the pushed instance, or this thread sees the worker counted. The
+       release store of the push alone does not order the load below. */
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if(atomic_load_explicit(&s4_s_execSleepers, memory_order_relaxed) != 0)
+    {
+      pthread_mutex_lock(&fsm_s_execMutex);
+      pthread_cond_signal(&fsm_s_execCond);
+      pthread_mutex_unlock(&fsm_s_execMutex);
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_execPush                                       */
+/*  Purpose:       Append an instance to the ready queue of a shard.     */
+/*  Arguments:     FSMExecShard* shard:                                  */
+/*                    Home shard of the instance.                        */
+/*                 FSM_INST inst:                                        */
+/*                    Instance handle, must not be on any ready queue.   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_execPush(FSMExecShard* shard, FSM_INST inst)
+{
+  FSMExecSlot* fsm_t_slot;
+  unsigned long long u8_t_putIndex;
+  unsigned long long u8_t_sequence;
+  U1 u1_t_claimFlag;
+
+  u1_t_claimFlag = FSM_FALSE;
+  u8_t_putIndex  = atomic_load_explicit(&shard->putIndex, memory_order_relaxed);
+
+  while(u1_t_claimFlag == FSM_FALSE)
+  {
+    fsm_t_slot    = &shard->slotList[u8_t_putIndex % shard->length];
+    u8_t_sequence = atomic_load_explicit(&fsm_t_slot->sequence, memory_order_acquire);
+
+    /* The ring cannot be full, a slot still being read only delays us. */
+    if(u8_t_sequence == u8_t_putIndex)
+    {
+      u1_t_claimFlag = (U1)atomic_compare_exchange_weak_explicit(&shard->putIndex, &u8_t_putIndex,
+                                                                 u8_t_putIndex + 1,
+                                                                 memory_order_relaxed, memory_order_relaxed);
+    }
+    else
+    {
+      u8_t_putIndex = atomic_load_explicit(&shard->putIndex, memory_order_relaxed);
+    }
+  }
+
+  fsm_t_slot->inst = inst;
+  atomic_store_explicit(&fsm_t_slot->sequence, u8_t_putIndex + 1, memory_order_release);
+}
+
+/*************************************************************************/
+/*  Function Name: inst_fsm_execPop                                      */
+/*  Purpose:       Take the oldest instance from a ready queue.          */
+/*  Arguments:     FSMExecShard* shard:                                  */
+/*                    Any shard.                                         */
+/*  Return:        FSM_INST handle    OR                                 */
+/*                 FSM_INST_INVALID if the queue is empty                */
+/*************************************************************************/
+static FSM_INST inst_fsm_execPop(FSMExecShard* shard)
+{
+  FSMExecSlot* fsm_t_slot;
+  unsigned long long u8_t_getIndex;
+  unsigned long long u8_t_sequence;
+  FSM_INST inst_t_inst;
+  U1 u1_t_doneFlag;
+
+  inst_t_inst   = FSM_INST_INVALID;
+  u1_t_doneFlag = FSM_FALSE;
+  u8_t_getIndex = atomic_load_explicit(&shard->getIndex, memory_order_relaxed);
+
+  while(u1_t_doneFlag == FSM_FALSE)
+  {
+    fsm_t_slot    = &shard->slotList[u8_t_getIndex % shard->length];
+    u8_t_sequence = atomic_load_explicit(&fsm_t_slot->sequence, memory_order_acquire);
+
+    if(u8_t_sequence == (u8_t_getIndex + 1))
+    {
+      if(atomic_compare_exchange_weak_explicit(&shard->getIndex, &u8_t_getIndex, u8_t_getIndex + 1,
+                                               memory_order_relaxed, memory_order_relaxed))
+      {
+        inst_t_inst = fsm_t_slot->inst;
+        atomic_store_explicit(&fsm_t_slot->sequence, u8_t_getIndex + shard->length, memory_order_release);
+        u1_t_doneFlag = FSM_TRUE;
+      }
+      else
+      {
+
+      }
+    }
+    else if(u8_t_sequence < (u8_t_getIndex + 1))
+    {
+      /* Empty. */
+      u1_t_doneFlag = FSM_TRUE;
+    }
+    else
+    {
+      u8_t_getIndex = atomic_load_explicit(&shard->getIndex, memory_order_relaxed);
+    }
+  }
+
+  return (inst_t_inst);
+}
+
+/*************************************************************************/
+/*  Function Name: inst_fsm_execTake                                     */
+/*  Purpose:       Take a ready instance, from the own shard first and   */
+/*                 then from the following shards in turn.               */
+/*  Arguments:     U4 self:                                              */
+/*                    Shard of the calling worker.                       */
+/*  Return:        FSM_INST handle    OR                                 */
+/*                 FSM_INST_INVALID if no instance is ready              */
+/*************************************************************************/
+static FSM_INST inst_fsm_execTake(U4 self)
+{
+  FSM_INST inst_t_inst;
+  U4 u4_t_offset;
+
+  inst_t_inst = FSM_INST_INVALID;
+
+  for(u4_t_offset = 0; (u4_t_offset < u4_s_execNumWorkers) && (inst_t_inst == FSM_INST_INVALID); u4_t_offset++)
+  {
+    inst_t_inst = inst_fsm_execPop(&fsm_sas_execShard[(self + u4_t_offset) % u4_s_execNumWorkers]);
+  }
+
+  return (inst_t_inst);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_execAnyReady                                   */
+/*  Purpose:       Check all ready queues for waiting instances.         */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+static U1 u1_fsm_execAnyReady(void)
+{
+  U4 u4_t_idx;
+  U1 u1_t_rtn;
+
+  u1_t_rtn = FSM_FALSE;
+
+  for(u4_t_idx = 0; (u4_t_idx < u4_s_execNumWorkers) && (u1_t_rtn == FSM_FALSE); u4_t_idx++)
+  {
+    u1_t_rtn = (atomic_load(&fsm_sas_execShard[u4_t_idx].putIndex) !=
+                atomic_load(&fsm_sas_execShard[u4_t_idx].getIndex)) ? FSM_TRUE : FSM_FALSE;
+  }
+
+  return (u1_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execRun                                        */
+/*  Purpose:       Serve one instance up to FSM_EXEC_SERVE_BUDGET events */
+/*                 and either requeue it or release it.                  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance taken from a ready queue.                 */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_execRun(FSM_INST inst)
+{
+  /* A stop request from u1_fsm_invalidEvtHandler() only ends this run,
+     events still waiting reschedule the instance below. */
+  if(u1_fsm_instServeEvtQueueBudget(inst, FSM_EXEC_SERVE_BUDGET, FSM_SERVE_NO_LIMIT) ==
+     FSM_EVT_QUEUE_BUDGET_EXPIRED)
+  {
+    vd_fsm_execPush(&fsm_sas_execShard[(U4)inst / u4_s_execShardLength], inst);
+  }
+  else
+  {
+    atomic_store(&u1_sa_execScheduled[inst], FSM_FALSE);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    /* An event posted while the flag was still set was not scheduled. */
+    if(FSM_EXEC_EVT_WAITING(inst))
+    {
+      vd_fsm_execNotify(inst);
+    }
+    else
+    {
+
+    }
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execSleep                                      */
+/*  Purpose:       Block the calling worker until an instance is         */
+/*                 scheduled or the executor stops.                      */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_execSleep(void)
+{
+  pthread_mutex_lock(&fsm_s_execMutex);
+
+  /* Count this worker before the last check, vd_fsm_execNotify() pushes
+     before it reads the count. */
+  atomic_fetch_add(&s4_s_execSleepers, 1);
+
+  if((atomic_load(&u1_s_execStop) == FSM_FALSE) && (u1_fsm_execAnyReady() == FSM_FALSE))
+  {
+    pthread_cond_wait(&fsm_s_execCond, &fsm_s_execMutex);
+  }
+  else
+  {
+
+  }
+
+  atomic_fetch_sub(&s4_s_execSleepers, 1);
+
+  pthread_mutex_unlock(&fsm_s_execMutex);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_execWorker                                     */
+/*  Purpose:       Worker thread, serves ready instances until stopped.  */
+/*  Arguments:     void* arg:                                            */
+/*                    FSMExecShard owned by this worker.                 */
+/*  Return:        NULL                                                  */
+/*************************************************************************/
+static void* vd_fsm_execWorker(void* arg)
+{
+  FSMExecShard* fsm_t_shard;
+  FSM_INST inst_t_inst;
+  U4 u4_t_idleCount;
+#ifdef FSM_EXEC_PIN_WORKERS
+  cpu_set_t fsm_t_cpuSet;
+#endif
+
+  fsm_t_shard    = (FSMExecShard*)arg;
+  u4_t_idleCount = 0;
+
+#ifdef FSM_EXEC_PIN_WORKERS
+  CPU_ZERO(&fsm_t_cpuSet);
+  CPU_SET(fsm_t_shard->idx, &fsm_t_cpuSet);
+  (void)pthread_setaffinity_np(pthread_self(), sizeof(fsm_t_cpuSet), &fsm_t_cpuSet);
+#endif
+
+  while(atomic_load_explicit(&u1_s_execStop, memory_order_relaxed) == FSM_FALSE)
+  {
+    inst_t_inst = inst_fsm_execTake(fsm_t_shard->idx);
+
+    if(inst_t_inst != FSM_INST_INVALID)
+    {
+      vd_fsm_execRun(inst_t_inst);
+      u4_t_idleCount = 0;
+    }
+    else if(u4_t_idleCount < FSM_EXEC_SPIN_COUNT)
+    {
+      u4_t_idleCount++;
+      sched_yield();
+    }
+    else
+    {
+      vd_fsm_execSleep();
+      u4_t_idleCount = 0;
+    }
+  }
+
+  return (NULL);
+}
+
+#endif
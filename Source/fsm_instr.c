@@ -0,0 +1,250 @@
+/*************************************************************************/
+/*  File Name: fsm_instr.c                                               */
+/*  Purpose: Optional transition statistics for the FSM module, compiled */
+/*           in with FSM_CFG_INSTRUMENT. Needs POSIX threads.            */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <string.h>
+#include "fsm.h"
+#include "fsm_instr.h"
+
+#ifdef FSM_CFG_INSTRUMENT
+
+#include <pthread.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Index of the block shared by threads that found no free one.          */
+#define FSM_INSTR_SHARED_BLOCK           (FSM_INSTR_MAX_THREADS - 1)
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static FSMInstrBlock fsm_sas_instrBlock[FSM_INSTR_MAX_THREADS];
+
+/* Set while a live thread owns the block. The thread specific key folds
+   the counters into the shared block and gives the block back when its
+   thread exits. */
+static atomic_uchar   u1_sa_instrBlockOwned[FSM_INSTR_MAX_THREADS];
+static pthread_key_t  fsm_s_instrBlockKey;
+static pthread_once_t fsm_s_instrBlockOnce = PTHREAD_ONCE_INIT;
+
+_Thread_local FSMInstrBlock* fsm_tp_instrBlock;
+_Thread_local U1 u1_tp_instrShared;
+
+/* Per instance, next to the instance pool in fsm.c. */
+atomic_uint u4_sa_instrEntryTicks[FSM_NUM_INSTANCES];
+atomic_uint u4_sa_instrQueueHighWater[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static void vd_fsm_instrMakeKey(void);
+static void vd_fsm_instrReleaseBlock(void* block);
+static void vd_fsm_instrFold(atomic_uint* counter, atomic_uint* shared);
+static void vd_fsm_instrFold64(atomic_ullong* counter, atomic_ullong* shared);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: instr_fsm_claimBlock                                  */
+/*  Purpose:       Assign a free counter block to the calling thread     */
+/*                 until it exits, or the shared block if none is free.  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSMInstrBlock* of the calling thread                  */
+/*************************************************************************/
+FSMInstrBlock* instr_fsm_claimBlock(void)
+{
+  U4 u4_t_idx;
+  U4 u4_t_block;
+
+  u4_t_block = FSM_INSTR_SHARED_BLOCK;
+
+  if(pthread_once(&fsm_s_instrBlockOnce, vd_fsm_instrMakeKey) == 0)
+  {
+    for(u4_t_idx = 0; (u4_t_idx < FSM_INSTR_SHARED_BLOCK) && (u4_t_block == FSM_INSTR_SHARED_BLOCK); u4_t_idx++)
+    {
+      /* Exchange pairs with the release in vd_fsm_instrReleaseBlock(), the
+         new owner sees the block cleared by the previous one. */
+      if((atomic_load_explicit(&u1_sa_instrBlockOwned[u4_t_idx], memory_order_relaxed) == FSM_FALSE) &&
+         (atomic_exchange(&u1_sa_instrBlockOwned[u4_t_idx], FSM_TRUE) == FSM_FALSE))
+      {
+        if(pthread_setspecific(fsm_s_instrBlockKey, &fsm_sas_instrBlock[u4_t_idx]) == 0)
+        {
+          u4_t_block = u4_t_idx;
+        }
+        else
+        {
+          atomic_store_explicit(&u1_sa_instrBlockOwned[u4_t_idx], FSM_FALSE, memory_order_release);
+        }
+      }
+      else
+      {
+
+      }
+    }
+  }
+  else
+  {
+
+  }
+
+  u1_tp_instrShared = (u4_t_block == FSM_INSTR_SHARED_BLOCK) ? FSM_TRUE : FSM_FALSE;
+  fsm_tp_instrBlock = &fsm_sas_instrBlock[u4_t_block];
+
+  return (fsm_tp_instrBlock);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_instrSnapshot                                  */
+/*  Purpose:       Sum the counters of all threads. Does not stop the    */
+/*                 machines, each counter is read atomically but the     */
+/*                 snapshot as a whole is not.                           */
+/*  Arguments:     FSMInstrSnapshot* snapshot:                           */
+/*                    Filled with the totals.                            */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_instrSnapshot(FSMInstrSnapshot* snapshot)
+{
+  FSMInstrBlock* fsm_t_block;
+  U4 u4_t_blk;
+  U4 u4_t_state;
+  U4 u4_t_evt;
+  U4 u4_t_bucket;
+  FSM_INST inst_t_inst;
+  unsigned int u4_t_depth;
+
+  memset(snapshot, 0, sizeof(*snapshot));
+
+  for(u4_t_blk = 0; u4_t_blk < FSM_INSTR_MAX_THREADS; u4_t_blk++)
+  {
+    fsm_t_block = &fsm_sas_instrBlock[u4_t_blk];
+
+    for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+    {
+      for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+      {
+        snapshot->transitionCount[u4_t_state][u4_t_evt] +=
+          atomic_load_explicit(&fsm_t_block->transitionCount[u4_t_state][u4_t_evt], memory_order_relaxed);
+      }
+
+      snapshot->invalidCount[u4_t_state] +=
+        atomic_load_explicit(&fsm_t_block->invalidCount[u4_t_state], memory_order_relaxed);
+      snapshot->timeInState[u4_t_state] +=
+        atomic_load_explicit(&fsm_t_block->timeInState[u4_t_state], memory_order_relaxed);
+    }
+
+    for(u4_t_bucket = 0; u4_t_bucket < FSM_INSTR_HIST_LENGTH; u4_t_bucket++)
+    {
+      snapshot->entryHist[u4_t_bucket] += atomic_load_explicit(&fsm_t_block->entryHist[u4_t_bucket], memory_order_relaxed);
+      snapshot->exitHist[u4_t_bucket]  += atomic_load_explicit(&fsm_t_block->exitHist[u4_t_bucket], memory_order_relaxed);
+    }
+  }
+
+  for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+  {
+    u4_t_depth = atomic_load_explicit(&u4_sa_instrQueueHighWater[inst_t_inst], memory_order_relaxed);
+
+    if(u4_t_depth > (unsigned int)snapshot->queueHighWater)
+    {
+      snapshot->queueHighWater = (U4)u4_t_depth;
+    }
+    else
+    {
+
+    }
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_instrQueueHighWater                            */
+/*  Purpose:       Return the deepest queue seen after registering an    */
+/*                 event for an instance.                                */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 events                                             */
+/*************************************************************************/
+U4 u4_fsm_instrQueueHighWater(FSM_INST inst)
+{
+  return ((U4)atomic_load_explicit(&u4_sa_instrQueueHighWater[inst], memory_order_relaxed));
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_instrMakeKey                                   */
+/*  Purpose:       Create the key that releases blocks on thread exit.   */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_instrMakeKey(void)
+{
+  (void)pthread_key_create(&fsm_s_instrBlockKey, vd_fsm_instrReleaseBlock);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_instrReleaseBlock                              */
+/*  Purpose:       Add the counters of an exiting thread to the shared   */
+/*                 block, clear them and give the block back. A snapshot */
+/*                 taken meanwhile may miss the counts being moved.      */
+/*  Arguments:     void* block:                                          */
+/*                    FSMInstrBlock owned by the thread.                 */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_instrReleaseBlock(void* block)
+{
+  FSMInstrBlock* fsm_t_block;
+  FSMInstrBlock* fsm_t_shared;
+  U4 u4_t_state;
+  U4 u4_t_evt;
+  U4 u4_t_bucket;
+
+  fsm_t_block  = (FSMInstrBlock*)block;
+  fsm_t_shared = &fsm_sas_instrBlock[FSM_INSTR_SHARED_BLOCK];
+
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      vd_fsm_instrFold(&fsm_t_block->transitionCount[u4_t_state][u4_t_evt],
+                       &fsm_t_shared->transitionCount[u4_t_state][u4_t_evt]);
+    }
+
+    vd_fsm_instrFold(&fsm_t_block->invalidCount[u4_t_state], &fsm_t_shared->invalidCount[u4_t_state]);
+    vd_fsm_instrFold64(&fsm_t_block->timeInState[u4_t_state], &fsm_t_shared->timeInState[u4_t_state]);
+  }
+
+  for(u4_t_bucket = 0; u4_t_bucket < FSM_INSTR_HIST_LENGTH; u4_t_bucket++)
+  {
+    vd_fsm_instrFold64(&fsm_t_block->entryHist[u4_t_bucket], &fsm_t_shared->entryHist[u4_t_bucket]);
+    vd_fsm_instrFold64(&fsm_t_block->exitHist[u4_t_bucket], &fsm_t_shared->exitHist[u4_t_bucket]);
+  }
+
+  /* Anything recorded later by another key destructor of this thread
+     claims a block again. */
+  fsm_tp_instrBlock = NULL;
+
+  atomic_store_explicit(&u1_sa_instrBlockOwned[fsm_t_block - fsm_sas_instrBlock], FSM_FALSE,
+                        memory_order_release);
+}
+
+static void vd_fsm_instrFold(atomic_uint* counter, atomic_uint* shared)
+{
+  (void)atomic_fetch_add_explicit(shared, atomic_exchange_explicit(counter, 0, memory_order_relaxed),
+                                  memory_order_relaxed);
+}
+
+static void vd_fsm_instrFold64(atomic_ullong* counter, atomic_ullong* shared)
+{
+  (void)atomic_fetch_add_explicit(shared, atomic_exchange_explicit(counter, 0, memory_order_relaxed),
+                                  memory_order_relaxed);
+}
+
+#endif
@@ -0,0 +1,170 @@
+/*************************************************************************/
+/*  File Name: fsm_payload.c                                             */
+/*  Purpose: Optional event payloads for the FSM module, compiled in     */
+/*           with FSM_CFG_PAYLOAD.                                       */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include "fsm.h"
+#include "fsm_payload.h"
+
+#ifdef FSM_CFG_PAYLOAD
+
+#include <stdatomic.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+_Static_assert(FSM_PAYLOAD_COUNT < FSM_PAYLOAD_NONE, "FSM_PAYLOAD_COUNT must be below 0xFFFF");
+_Static_assert(FSM_EVT_NULL < 0xFFFF, "FSM_CFG_PAYLOAD keeps events in 16 bits");
+
+/* Free list head: buffer index in the low half, a count of head updates in
+   the high half so that a pop racing with a pop and push of the same
+   buffer fails its compare and swap. */
+#define FSM_PAYLOAD_HEAD(tag, idx)       (((unsigned long long)(tag) << 32) | (unsigned long long)(idx))
+#define FSM_PAYLOAD_HEAD_IDX(head)       ((unsigned int)((head) & 0xFFFFFFFFu))
+#define FSM_PAYLOAD_HEAD_TAG(head)       ((unsigned int)((head) >> 32))
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+FSMPayloadBuf fsm_sas_payloadPool[FSM_PAYLOAD_COUNT];
+
+static atomic_uint   u4_sa_payloadNext[FSM_PAYLOAD_COUNT];
+static atomic_ullong u8_s_payloadHead;
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadInit                                    */
+/*  Purpose:       Return all buffers to the pool. Called by             */
+/*                 vd_fsm_init().                                        */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadInit(void)
+{
+  unsigned int u4_t_idx;
+
+  for(u4_t_idx = 0; u4_t_idx < FSM_PAYLOAD_COUNT; u4_t_idx++)
+  {
+    atomic_store_explicit(&u4_sa_payloadNext[u4_t_idx],
+                          (u4_t_idx + 1 < FSM_PAYLOAD_COUNT) ? (u4_t_idx + 1) : FSM_PAYLOAD_NONE,
+                          memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&u8_s_payloadHead, FSM_PAYLOAD_HEAD(0, 0), memory_order_release);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadReserve                                 */
+/*  Purpose:       Rebuild the pool with the buffers marked in usedSet   */
+/*                 taken and all others free, for a restored snapshot.   */
+/*                 Only while no thread allocates or frees.              */
+/*  Arguments:     const U1* usedSet:                                    */
+/*                    FSM_PAYLOAD_SET_LENGTH bytes, bit payload % 8 of   */
+/*                    byte payload / 8 set for a buffer in use.          */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadReserve(const U1* usedSet)
+{
+  unsigned int u4_t_idx;
+  unsigned int u4_t_head;
+
+  /* Push from the top so free buffers are handed out lowest first. */
+  u4_t_head = FSM_PAYLOAD_NONE;
+
+  for(u4_t_idx = FSM_PAYLOAD_COUNT; u4_t_idx-- > 0;)
+  {
+    if((usedSet[FSM_PAYLOAD_SET_BYTE(u4_t_idx)] & FSM_PAYLOAD_SET_BIT(u4_t_idx)) == 0)
+    {
+      atomic_store_explicit(&u4_sa_payloadNext[u4_t_idx], u4_t_head, memory_order_relaxed);
+      u4_t_head = u4_t_idx;
+    }
+    else
+    {
+
+    }
+  }
+
+  atomic_store_explicit(&u8_s_payloadHead,
+                        FSM_PAYLOAD_HEAD(FSM_PAYLOAD_HEAD_TAG(atomic_load_explicit(&u8_s_payloadHead,
+                                                                                   memory_order_relaxed)) + 1,
+                                         u4_t_head),
+                        memory_order_release);
+}
+
+/*************************************************************************/
+/*  Function Name: pld_fsm_payloadAlloc                                  */
+/*  Purpose:       Take a buffer from the pool. Safe from any thread.    */
+/*  Arguments:     N/A                                                   */
+/*  Return:        FSM_PAYLOAD handle    OR                              */
+/*                 FSM_PAYLOAD_NONE if the pool is empty                 */
+/*************************************************************************/
+FSM_PAYLOAD pld_fsm_payloadAlloc(void)
+{
+  unsigned long long u8_t_head;
+  unsigned long long u8_t_newHead;
+  unsigned int u4_t_idx;
+  U1 u1_t_doneFlag;
+
+  u1_t_doneFlag = FSM_FALSE;
+  u8_t_head     = atomic_load_explicit(&u8_s_payloadHead, memory_order_acquire);
+
+  while(u1_t_doneFlag == FSM_FALSE)
+  {
+    u4_t_idx = FSM_PAYLOAD_HEAD_IDX(u8_t_head);
+
+    if(u4_t_idx == FSM_PAYLOAD_NONE)
+    {
+      u1_t_doneFlag = FSM_TRUE;
+    }
+    else
+    {
+      /* next may be stale if the buffer was taken meanwhile, the tag
+         check of the compare and swap rejects it then. */
+      u8_t_newHead  = FSM_PAYLOAD_HEAD(FSM_PAYLOAD_HEAD_TAG(u8_t_head) + 1,
+                                       atomic_load_explicit(&u4_sa_payloadNext[u4_t_idx], memory_order_relaxed));
+      u1_t_doneFlag = (U1)atomic_compare_exchange_weak_explicit(&u8_s_payloadHead, &u8_t_head, u8_t_newHead,
+                                                                memory_order_acquire, memory_order_acquire);
+    }
+  }
+
+  return ((FSM_PAYLOAD)u4_t_idx);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_payloadFree                                    */
+/*  Purpose:       Return a buffer to the pool. Safe from any thread.    */
+/*  Arguments:     FSM_PAYLOAD payload:                                  */
+/*                    Handle from pld_fsm_payloadAlloc(), or             */
+/*                    FSM_PAYLOAD_NONE which is ignored.                 */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_payloadFree(FSM_PAYLOAD payload)
+{
+  unsigned long long u8_t_head;
+  unsigned long long u8_t_newHead;
+  U1 u1_t_doneFlag;
+
+  if(payload < FSM_PAYLOAD_COUNT)
+  {
+    u1_t_doneFlag = FSM_FALSE;
+    u8_t_head     = atomic_load_explicit(&u8_s_payloadHead, memory_order_relaxed);
+
+    while(u1_t_doneFlag == FSM_FALSE)
+    {
+      atomic_store_explicit(&u4_sa_payloadNext[payload], FSM_PAYLOAD_HEAD_IDX(u8_t_head), memory_order_relaxed);
+
+      u8_t_newHead  = FSM_PAYLOAD_HEAD(FSM_PAYLOAD_HEAD_TAG(u8_t_head) + 1, payload);
+      u1_t_doneFlag = (U1)atomic_compare_exchange_weak_explicit(&u8_s_payloadHead, &u8_t_head, u8_t_newHead,
+                                                                memory_order_release, memory_order_relaxed);
+    }
+  }
+  else
+  {
+
+  }
+}
+
+#endif
@@ -0,0 +1,874 @@
+/*************************************************************************/
+/*  File Name: fsm_snapshot.c                                            */
+/*  Purpose: Optional checkpoint of all FSM instances, compiled in with  */
+/*           FSM_CFG_SNAPSHOT. Needs POSIX mmap.                         */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_exec.h"
+#include "fsm_wait.h"
+#include "fsm_payload.h"
+#include "fsm_timer.h"
+#include "fsm_snapshot.h"
+#include "fsm_coalesce.h"
+#include "fsm_async.h"
+
+#ifdef FSM_CFG_SNAPSHOT
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+_Static_assert(sizeof(FSMSnapshotHeader) == 160, "FSMSnapshotHeader must be 160 bytes");
+_Static_assert(FSM_SNAPSHOT_SEC_QUEUE_ITEM < FSM_SNAPSHOT_SECTIONS, "FSM_SNAPSHOT_SECTIONS too small");
+
+#define FSM_SNAPSHOT_ROUND(offset)       (((offset) + (FSM_SNAPSHOT_ALIGN - 1)) & ~(U8)(FSM_SNAPSHOT_ALIGN - 1))
+
+/* Section as a typed pointer into an image. */
+#define FSM_SNAPSHOT_SEC(image, header, sec, type) \
+  ((type*)((U1*)(image) + (header)->section[(sec)]))
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static U8 u8_fsm_snapshotLayout(FSMSnapshotHeader* header);
+static U8 u8_fsm_snapshotAdd(FSMSnapshotHeader* header, U8 offset, U4 sec, U8 length);
+static U1 u1_fsm_snapshotSameLayout(const FSMSnapshotHeader* header, const FSMSnapshotHeader* expect);
+static U1 u1_fsm_snapshotCheckItems(const void* image, const FSMSnapshotHeader* header, U1* payloadSet);
+#ifdef FSM_CFG_PAYLOAD
+static U1 u1_fsm_snapshotMarkPayload(FSM_QUEUE_ITEM item, U1* payloadSet);
+#endif
+#ifdef FSM_CFG_ASYNC
+static U1 u1_fsm_snapshotAsyncIdle(void);
+#endif
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: u8_fsm_snapshotSize                                   */
+/*  Purpose:       Return the bytes an image of the current instances    */
+/*                 needs.                                                */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U8 image size                                         */
+/*************************************************************************/
+U8 u8_fsm_snapshotSize(void)
+{
+  FSMSnapshotHeader fsm_t_header;
+  FSM_INST inst_t_inst;
+  U8 u8_t_size;
+
+  u8_t_size = u8_fsm_snapshotLayout(&fsm_t_header);
+
+  for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+  {
+    u8_t_size += (U8)(unsigned int)u4_fsm_evtQueueDepth(inst_t_inst) * sizeof(FSM_QUEUE_ITEM);
+  }
+
+  return (u8_t_size);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotWrite                                  */
+/*  Purpose:       Write an image of all instances into memory. Queued   */
+/*                 events are taken out and put back in order. Only      */
+/*                 while no thread serves, registers events or ticks     */
+/*                 timers.                                               */
+/*  Arguments:     void* image:                                          */
+/*                    Destination, 8 byte aligned.                       */
+/*                 U8 size:                                              */
+/*                    Bytes available, see u8_fsm_snapshotSize().        */
+/*                 U8* written:                                          */
+/*                    Image size out, may be NULL.                       */
+/*  Return:        U1 FSM_SNAPSHOT_OK              OR                    */
+/*                    FSM_SNAPSHOT_BAD_IMAGE       OR                    */
+/*                    FSM_SNAPSHOT_NO_SPACE        OR                    */
+/*                    FSM_SNAPSHOT_ASYNC_PENDING if an asynchronous      */
+/*                    action runs or its completion is not served yet    */
+/*************************************************************************/
+U1 u1_fsm_snapshotWrite(void* image, U8 size, U8* written)
+{
+  FSMSnapshotHeader* fsm_t_header;
+  FSMSnapshotPool fsm_t_pool;
+  FSM_QUEUE_ITEM* evt_t_item;
+  FSM_QUEUE_ITEM evt_t_taken;
+  FSM_INST inst_t_inst;
+  U4* u4_t_queueCount;
+  U8 u8_t_base;
+  U8 u8_t_capacity;
+  U4 u4_t_numQueued;
+  U4 u4_t_depth;
+  U4 u4_t_idx;
+  U1 u1_t_rtnSts;
+#ifdef FSM_CFG_TIMER
+  U4* u4_t_timer;
+#endif
+
+  fsm_t_header = image;
+  u8_t_base    = 0;
+
+  if((image == NULL) || (((uintptr_t)image & 7) != 0))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else if(size < FSM_SNAPSHOT_ROUND(sizeof(FSMSnapshotHeader)))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_NO_SPACE;
+  }
+#ifdef FSM_CFG_ASYNC
+  else if(u1_fsm_snapshotAsyncIdle() == FSM_FALSE)
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_ASYNC_PENDING;
+  }
+#endif
+  else
+  {
+    /* Magic stays 0 until the image is complete. */
+    memset(fsm_t_header, 0, sizeof(FSMSnapshotHeader));
+    u8_t_base   = u8_fsm_snapshotLayout(fsm_t_header);
+    u1_t_rtnSts = (size < u8_t_base) ? FSM_SNAPSHOT_NO_SPACE : FSM_SNAPSHOT_OK;
+  }
+
+  if(u1_t_rtnSts == FSM_SNAPSHOT_OK)
+  {
+    fsm_t_pool.currentState = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_CURRENT, FSM_STATE_IDX);
+    fsm_t_pool.prevState    = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_PREV, FSM_STATE_IDX);
+    fsm_t_pool.nextFree     = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_NEXT_FREE, FSM_INST);
+#ifdef FSM_CFG_DEFER
+    fsm_t_pool.deferCount   = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_DEFER_COUNT, U1);
+    fsm_t_pool.deferItem    = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_DEFER_ITEM, FSM_QUEUE_ITEM);
+#endif
+
+    vd_fsm_snapshotSavePool(&fsm_t_pool);
+    fsm_t_header->freeHead = (U4)fsm_t_pool.freeHead;
+
+#ifdef FSM_CFG_TIMER
+    u4_t_timer = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_TIMER, U4);
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      u4_t_timer[inst_t_inst] = u4_fsm_timerRemaining(inst_t_inst);
+    }
+#endif
+#ifdef FSM_CFG_PAYLOAD
+    memcpy(FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_PAYLOAD, U1), fsm_sas_payloadPool,
+           sizeof(fsm_sas_payloadPool));
+#endif
+
+    /* Queues are only reachable through the queue API, take the events
+       out and put them straight back. */
+    u4_t_queueCount = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_QUEUE_COUNT, U4);
+    evt_t_item      = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_QUEUE_ITEM, FSM_QUEUE_ITEM);
+    u8_t_capacity   = (size - u8_t_base) / sizeof(FSM_QUEUE_ITEM);
+    u4_t_numQueued  = 0;
+
+    for(inst_t_inst = 0; (inst_t_inst < FSM_NUM_INSTANCES) && (u1_t_rtnSts == FSM_SNAPSHOT_OK); inst_t_inst++)
+    {
+      u4_t_depth = u4_fsm_evtQueueDepth(inst_t_inst);
+
+      if(((U8)(unsigned int)u4_t_numQueued + (U8)(unsigned int)u4_t_depth) > u8_t_capacity)
+      {
+        u1_t_rtnSts = FSM_SNAPSHOT_NO_SPACE;
+      }
+      else
+      {
+        u4_t_idx    = 0;
+        evt_t_taken = (u4_t_depth > 0) ? evt_fsm_evtQueueGet(inst_t_inst) : FSM_QUEUE_ITEM_NULL;
+
+        while(FSM_QUEUE_ITEM_EVT(evt_t_taken) != FSM_EVT_NULL)
+        {
+          evt_t_item[u4_t_numQueued + u4_t_idx] = evt_t_taken;
+          u4_t_idx++;
+          evt_t_taken = (u4_t_idx < u4_t_depth) ? evt_fsm_evtQueueGet(inst_t_inst) : FSM_QUEUE_ITEM_NULL;
+        }
+
+        u4_t_queueCount[inst_t_inst] = u4_t_idx;
+
+        for(u4_t_idx = 0; u4_t_idx < u4_t_queueCount[inst_t_inst]; u4_t_idx++)
+        {
+          (void)u1_fsm_evtQueuePut(inst_t_inst, evt_t_item[u4_t_numQueued + u4_t_idx]);
+#ifdef FSM_CFG_COALESCE
+          /* Saved with the payload it would be served with, restored
+             through the coalescing put. */
+          evt_t_item[u4_t_numQueued + u4_t_idx] = evt_fsm_coalescePeek(inst_t_inst,
+                                                                       evt_t_item[u4_t_numQueued + u4_t_idx]);
+#endif
+        }
+
+        u4_t_numQueued += u4_t_queueCount[inst_t_inst];
+      }
+    }
+
+    if(u1_t_rtnSts == FSM_SNAPSHOT_OK)
+    {
+      fsm_t_header->numQueued = u4_t_numQueued;
+      fsm_t_header->imageSize = u8_t_base + ((U8)(unsigned int)u4_t_numQueued * sizeof(FSM_QUEUE_ITEM));
+      fsm_t_header->magic     = FSM_SNAPSHOT_MAGIC;
+
+      if(written != NULL)
+      {
+        *written = fsm_t_header->imageSize;
+      }
+      else
+      {
+
+      }
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotRead                                   */
+/*  Purpose:       Replace all instances with an image. The whole image  */
+/*                 is checked first, nothing changes if it is rejected.  */
+/*                 No entry or exit callback runs, timers continue with  */
+/*                 the ticks they had left. Same conditions as           */
+/*                 u1_fsm_snapshotWrite(), after vd_fsm_init().          */
+/*  Arguments:     const void* image:                                    */
+/*                    Image, 8 byte aligned.                             */
+/*                 U8 size:                                              */
+/*                    Bytes available.                                   */
+/*  Return:        U1 FSM_SNAPSHOT_OK                OR                  */
+/*                    FSM_SNAPSHOT_BAD_IMAGE         OR                  */
+/*                    FSM_SNAPSHOT_TABLE_MISMATCH    OR                  */
+/*                    FSM_SNAPSHOT_CONFIG_MISMATCH   OR                  */
+/*                    FSM_SNAPSHOT_NO_SPACE if an event queue of this    */
+/*                    build is too short, the rest is restored           */
+/*************************************************************************/
+U1 u1_fsm_snapshotRead(const void* image, U8 size)
+{
+  const FSMSnapshotHeader* fsm_t_header;
+  FSMSnapshotHeader fsm_t_expect;
+  FSMSnapshotPool fsm_t_pool;
+  const FSM_QUEUE_ITEM* evt_t_item;
+  const U4* u4_t_queueCount;
+  FSM_INST inst_t_inst;
+  U8 u8_t_base;
+  U4 u4_t_idx;
+  U1 u1_t_rtnSts;
+#ifdef FSM_CFG_PAYLOAD
+  U1 u1_ta_usedSet[FSM_PAYLOAD_SET_LENGTH];
+#else
+  U1 u1_ta_usedSet[1];
+#endif
+#ifdef FSM_CFG_TIMER
+  const U4* u4_t_timer;
+#endif
+
+  fsm_t_header = image;
+  u8_t_base    = u8_fsm_snapshotLayout(&fsm_t_expect);
+
+  if((image == NULL) || (((uintptr_t)image & 7) != 0) || (size < sizeof(FSMSnapshotHeader)) ||
+     (fsm_t_header->magic != FSM_SNAPSHOT_MAGIC) || (fsm_t_header->version != FSM_SNAPSHOT_VERSION) ||
+     (fsm_t_header->headerSize != sizeof(FSMSnapshotHeader)))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else if(fsm_t_header->fingerprint != fsm_t_expect.fingerprint)
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_TABLE_MISMATCH;
+  }
+  else if(u1_fsm_snapshotSameLayout(fsm_t_header, &fsm_t_expect) == FSM_FALSE)
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_CONFIG_MISMATCH;
+  }
+  else if((fsm_t_header->imageSize > size) ||
+          (fsm_t_header->imageSize != (u8_t_base + ((U8)(unsigned int)fsm_t_header->numQueued *
+                                                    sizeof(FSM_QUEUE_ITEM)))))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_OK;
+  }
+
+  memset(u1_ta_usedSet, 0, sizeof(u1_ta_usedSet));
+
+  if((u1_t_rtnSts == FSM_SNAPSHOT_OK) && (u1_fsm_snapshotCheckItems(image, fsm_t_header, u1_ta_usedSet) == FSM_FALSE))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else
+  {
+
+  }
+
+  if(u1_t_rtnSts == FSM_SNAPSHOT_OK)
+  {
+    fsm_t_pool.currentState = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_CURRENT, FSM_STATE_IDX);
+    fsm_t_pool.prevState    = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_PREV, FSM_STATE_IDX);
+    fsm_t_pool.nextFree     = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_NEXT_FREE, FSM_INST);
+    fsm_t_pool.freeHead     = (FSM_INST)fsm_t_header->freeHead;
+#ifdef FSM_CFG_DEFER
+    fsm_t_pool.deferCount   = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_DEFER_COUNT, U1);
+    fsm_t_pool.deferItem    = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_DEFER_ITEM, FSM_QUEUE_ITEM);
+#endif
+
+    /* Last check, nothing has changed if it fails. */
+    u1_t_rtnSts = (u1_fsm_snapshotLoadPool(&fsm_t_pool) == FSM_TRUE) ? FSM_SNAPSHOT_OK : FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else
+  {
+
+  }
+
+  if(u1_t_rtnSts == FSM_SNAPSHOT_OK)
+  {
+#ifdef FSM_CFG_ASYNC
+    /* Completions of actions started before the restore belong to states
+       the image does not hold. Dropped before the payload pool is replaced. */
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      vd_fsm_asyncCancel(inst_t_inst);
+    }
+#endif
+
+#ifdef FSM_CFG_PAYLOAD
+    memcpy(fsm_sas_payloadPool, FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_PAYLOAD, U1),
+           sizeof(fsm_sas_payloadPool));
+    vd_fsm_payloadReserve(u1_ta_usedSet);
+#endif
+
+    u4_t_queueCount = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_QUEUE_COUNT, const U4);
+    evt_t_item      = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_QUEUE_ITEM, const FSM_QUEUE_ITEM);
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      /* Reading the depth is cheaper than a reset, most queues are empty
+         on both sides. */
+      if((u4_t_queueCount[inst_t_inst] != 0) || (u4_fsm_evtQueueDepth(inst_t_inst) != 0))
+      {
+        vd_fsm_evtQueueReset(inst_t_inst);
+      }
+      else
+      {
+
+      }
+
+      for(u4_t_idx = 0; u4_t_idx < u4_t_queueCount[inst_t_inst]; u4_t_idx++)
+      {
+        if(u1_fsm_evtPut(inst_t_inst, *evt_t_item) != FSM_EVT_REGISTERED)
+        {
+          u1_t_rtnSts = FSM_SNAPSHOT_NO_SPACE;
+        }
+        else
+        {
+
+        }
+
+        evt_t_item++;
+      }
+
+      if(u4_t_queueCount[inst_t_inst] != 0)
+      {
+        vd_fsm_snapshotNotify(inst_t_inst);
+      }
+      else
+      {
+
+      }
+    }
+
+#ifdef FSM_CFG_TIMER
+    u4_t_timer = FSM_SNAPSHOT_SEC(image, fsm_t_header, FSM_SNAPSHOT_SEC_TIMER, const U4);
+
+    vd_fsm_timerInit();
+
+    for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+    {
+      if(u4_t_timer[inst_t_inst] != FSM_TIMER_NOT_ARMED)
+      {
+        vd_fsm_timerArmTicks(inst_t_inst, u4_t_timer[inst_t_inst],
+                             fsm_sas_fsmTimeout[fsm_t_pool.currentState[inst_t_inst]].evt);
+      }
+      else
+      {
+
+      }
+
+      /* Expired and not served when the image was taken. */
+      if(u4_t_timer[inst_t_inst] == 0)
+      {
+        vd_fsm_snapshotNotify(inst_t_inst);
+      }
+      else
+      {
+
+      }
+    }
+#endif
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotSave                                   */
+/*  Purpose:       Write an image into a memory mapped temporary file    */
+/*                 next to path, flush it to disk and rename it to path. */
+/*                 A checkpoint already at path is replaced atomically   */
+/*                 and stays intact if saving fails.                     */
+/*  Arguments:     const char* path:                                     */
+/*                    File to create or replace, shorter than            */
+/*                    FSM_SNAPSHOT_PATH_LENGTH - 7 characters.           */
+/*  Return:        U1 FSM_SNAPSHOT_OK          OR                        */
+/*                    FSM_SNAPSHOT_IO_ERROR    OR                        */
+/*                    u1_fsm_snapshotWrite() status                      */
+/*************************************************************************/
+U1 u1_fsm_snapshotSave(const char* path)
+{
+  char c_ta_tmpPath[FSM_SNAPSHOT_PATH_LENGTH];
+  const char* pc_t_slash;
+  void* pv_t_map;
+  U8 u8_t_size;
+  U8 u8_t_written;
+  int s4_t_fd;
+  int s4_t_dirFd;
+  U1 u1_t_rtnSts;
+
+  u8_t_size = u8_fsm_snapshotSize();
+  s4_t_fd   = -1;
+  pv_t_map  = MAP_FAILED;
+
+  /* mkstemp() replaces the X with a unique suffix and creates the file
+     with mode 0600. */
+  if(((size_t)snprintf(c_ta_tmpPath, sizeof(c_ta_tmpPath), "%s.XXXXXX", path) >= sizeof(c_ta_tmpPath)) ||
+     ((s4_t_fd = mkstemp(c_ta_tmpPath)) < 0))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_IO_ERROR;
+  }
+  else if((fchmod(s4_t_fd, 0644) != 0) || (ftruncate(s4_t_fd, (off_t)u8_t_size) != 0) ||
+          ((pv_t_map = mmap(NULL, (size_t)u8_t_size, PROT_READ | PROT_WRITE, MAP_SHARED, s4_t_fd, 0)) ==
+           MAP_FAILED))
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_IO_ERROR;
+  }
+  else
+  {
+    u1_t_rtnSts = u1_fsm_snapshotWrite(pv_t_map, u8_t_size, &u8_t_written);
+
+    (void)munmap(pv_t_map, (size_t)u8_t_size);
+
+    /* Fewer events may be queued than when the size was taken. fsync()
+       also writes the pages dirtied through the mapping. */
+    if((u1_t_rtnSts == FSM_SNAPSHOT_OK) &&
+       ((ftruncate(s4_t_fd, (off_t)u8_t_written) != 0) || (fsync(s4_t_fd) != 0)))
+    {
+      u1_t_rtnSts = FSM_SNAPSHOT_IO_ERROR;
+    }
+    else
+    {
+
+    }
+  }
+
+  if(s4_t_fd >= 0)
+  {
+    if((close(s4_t_fd) != 0) && (u1_t_rtnSts == FSM_SNAPSHOT_OK))
+    {
+      u1_t_rtnSts = FSM_SNAPSHOT_IO_ERROR;
+    }
+    else
+    {
+
+    }
+
+    if((u1_t_rtnSts == FSM_SNAPSHOT_OK) && (rename(c_ta_tmpPath, path) == 0))
+    {
+      /* Flush the directory so the rename survives a crash, the image is
+         in place either way. */
+      pc_t_slash = strrchr(path, '/');
+
+      if(pc_t_slash == NULL)
+      {
+        s4_t_dirFd = open(".", O_RDONLY);
+      }
+      else
+      {
+        c_ta_tmpPath[(pc_t_slash == path) ? 1 : (size_t)(pc_t_slash - path)] = '\0';
+        s4_t_dirFd = open(c_ta_tmpPath, O_RDONLY);
+      }
+
+      if(s4_t_dirFd >= 0)
+      {
+        (void)fsync(s4_t_dirFd);
+        (void)close(s4_t_dirFd);
+      }
+      else
+      {
+
+      }
+    }
+    else
+    {
+      u1_t_rtnSts = (u1_t_rtnSts == FSM_SNAPSHOT_OK) ? FSM_SNAPSHOT_IO_ERROR : u1_t_rtnSts;
+      (void)unlink(c_ta_tmpPath);
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotRestore                                */
+/*  Purpose:       Map an image file and restore it with                 */
+/*                 u1_fsm_snapshotRead().                                */
+/*  Arguments:     const char* path:                                     */
+/*                    File written by u1_fsm_snapshotSave().             */
+/*  Return:        U1 FSM_SNAPSHOT_OK          OR                        */
+/*                    FSM_SNAPSHOT_IO_ERROR    OR                        */
+/*                    u1_fsm_snapshotRead() status                       */
+/*************************************************************************/
+U1 u1_fsm_snapshotRestore(const char* path)
+{
+  struct stat st_t_stat;
+  void* pv_t_map;
+  int s4_t_fd;
+  U1 u1_t_rtnSts;
+
+  s4_t_fd  = open(path, O_RDONLY);
+  pv_t_map = MAP_FAILED;
+
+  if((s4_t_fd < 0) || (fstat(s4_t_fd, &st_t_stat) != 0) || ((size_t)st_t_stat.st_size < sizeof(FSMSnapshotHeader)))
+  {
+    u1_t_rtnSts = (s4_t_fd < 0) ? FSM_SNAPSHOT_IO_ERROR : FSM_SNAPSHOT_BAD_IMAGE;
+  }
+  else if((pv_t_map = mmap(NULL, (size_t)st_t_stat.st_size, PROT_READ, MAP_PRIVATE, s4_t_fd, 0)) == MAP_FAILED)
+  {
+    u1_t_rtnSts = FSM_SNAPSHOT_IO_ERROR;
+  }
+  else
+  {
+    u1_t_rtnSts = u1_fsm_snapshotRead(pv_t_map, (U8)st_t_stat.st_size);
+
+    (void)munmap(pv_t_map, (size_t)st_t_stat.st_size);
+  }
+
+  if(s4_t_fd >= 0)
+  {
+    (void)close(s4_t_fd);
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u8_fsm_snapshotLayout                                 */
+/*  Purpose:       Fill a header with the table and build of this        */
+/*                 module and the section offsets for its image.         */
+/*  Arguments:     FSMSnapshotHeader* header:                            */
+/*                    Header to fill, magic and counts are left.         */
+/*  Return:        U8 offset of the queued events section                */
+/*************************************************************************/
+static U8 u8_fsm_snapshotLayout(FSMSnapshotHeader* header)
+{
+  U8 u8_t_offset;
+  U4 u4_t_sec;
+
+  header->version      = FSM_SNAPSHOT_VERSION;
+  header->headerSize   = (U2)sizeof(FSMSnapshotHeader);
+  header->fingerprint  = u8_fsm_tableFingerprint();
+  header->numInstances = FSM_NUM_INSTANCES;
+  header->numStates    = FSM_NUM_STATES;
+  header->numEvents    = FSM_NUM_EVENTS;
+  header->features     = 0;
+  header->stateSize    = (U2)sizeof(FSM_STATE_IDX);
+  header->instSize     = (U2)sizeof(FSM_INST);
+  header->itemSize     = (U2)sizeof(FSM_QUEUE_ITEM);
+  header->deferLength  = 0;
+  header->payloadCount = 0;
+  header->payloadSize  = 0;
+
+  for(u4_t_sec = 0; u4_t_sec < FSM_SNAPSHOT_SECTIONS; u4_t_sec++)
+  {
+    header->section[u4_t_sec] = 0;
+  }
+
+  u8_t_offset = FSM_SNAPSHOT_ROUND(sizeof(FSMSnapshotHeader));
+  u8_t_offset = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_CURRENT,
+                                   FSM_NUM_INSTANCES * sizeof(FSM_STATE_IDX));
+  u8_t_offset = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_PREV,
+                                   FSM_NUM_INSTANCES * sizeof(FSM_STATE_IDX));
+  u8_t_offset = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_NEXT_FREE,
+                                   FSM_NUM_INSTANCES * sizeof(FSM_INST));
+  u8_t_offset = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_QUEUE_COUNT,
+                                   FSM_NUM_INSTANCES * sizeof(U4));
+#ifdef FSM_CFG_DEFER
+  header->features   |= FSM_SNAPSHOT_FEATURE_DEFER;
+  header->deferLength = FSM_DEFER_LENGTH;
+  u8_t_offset         = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_DEFER_COUNT,
+                                           FSM_NUM_INSTANCES * sizeof(U1));
+  u8_t_offset         = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_DEFER_ITEM,
+                                           (U8)FSM_NUM_INSTANCES * FSM_DEFER_LENGTH * sizeof(FSM_QUEUE_ITEM));
+#endif
+#ifdef FSM_CFG_TIMER
+  header->features |= FSM_SNAPSHOT_FEATURE_TIMER;
+  u8_t_offset       = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_TIMER,
+                                         FSM_NUM_INSTANCES * sizeof(U4));
+#endif
+#ifdef FSM_CFG_PAYLOAD
+  header->features    |= FSM_SNAPSHOT_FEATURE_PAYLOAD;
+  header->payloadCount = FSM_PAYLOAD_COUNT;
+  header->payloadSize  = (U4)sizeof(FSMPayloadBuf);
+  u8_t_offset          = u8_fsm_snapshotAdd(header, u8_t_offset, FSM_SNAPSHOT_SEC_PAYLOAD,
+                                            sizeof(fsm_sas_payloadPool));
+#endif
+
+  header->section[FSM_SNAPSHOT_SEC_QUEUE_ITEM] = u8_t_offset;
+
+  return (u8_t_offset);
+}
+
+/*************************************************************************/
+/*  Function Name: u8_fsm_snapshotAdd                                    */
+/*  Purpose:       Place a section at offset.                            */
+/*  Arguments:     FSMSnapshotHeader* header:                            */
+/*                    Header to update.                                  */
+/*                 U8 offset:                                            */
+/*                    Aligned offset of the section.                     */
+/*                 U4 sec:                                               */
+/*                    FSM_SNAPSHOT_SEC_xxx.                              */
+/*                 U8 length:                                            */
+/*                    Section bytes.                                     */
+/*  Return:        U8 aligned offset of the next section                 */
+/*************************************************************************/
+static U8 u8_fsm_snapshotAdd(FSMSnapshotHeader* header, U8 offset, U4 sec, U8 length)
+{
+  header->section[sec] = offset;
+
+  return (FSM_SNAPSHOT_ROUND(offset + length));
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotSameLayout                             */
+/*  Purpose:       Compare the build fields and sections of two headers. */
+/*  Arguments:     const FSMSnapshotHeader* header:                      */
+/*                    Header of the image.                               */
+/*                 const FSMSnapshotHeader* expect:                      */
+/*                    Header from u8_fsm_snapshotLayout().               */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+static U1 u1_fsm_snapshotSameLayout(const FSMSnapshotHeader* header, const FSMSnapshotHeader* expect)
+{
+  U4 u4_t_sec;
+  U1 u1_t_same;
+
+  u1_t_same = ((header->numInstances == expect->numInstances) && (header->numStates == expect->numStates) &&
+               (header->numEvents == expect->numEvents) && (header->features == expect->features) &&
+               (header->stateSize == expect->stateSize) && (header->instSize == expect->instSize) &&
+               (header->itemSize == expect->itemSize) && (header->deferLength == expect->deferLength) &&
+               (header->payloadCount == expect->payloadCount) && (header->payloadSize == expect->payloadSize)) ?
+              FSM_TRUE : FSM_FALSE;
+
+  for(u4_t_sec = 0; u4_t_sec < FSM_SNAPSHOT_SECTIONS; u4_t_sec++)
+  {
+    u1_t_same = (header->section[u4_t_sec] == expect->section[u4_t_sec]) ? u1_t_same : FSM_FALSE;
+  }
+
+  return (u1_t_same);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotCheckItems                             */
+/*  Purpose:       Check queued and deferred events and timers of an     */
+/*                 image. With FSM_CFG_PAYLOAD, mark the buffers they    */
+/*                 hold, each may be held once.                          */
+/*  Arguments:     const void* image:                                    */
+/*                    Image, header already checked.                     */
+/*                 const FSMSnapshotHeader* header:                      */
+/*                    Its header.                                        */
+/*                 U1* payloadSet:                                       */
+/*                    FSM_PAYLOAD_SET_LENGTH bytes, cleared. Unused      */
+/*                    without FSM_CFG_PAYLOAD.                           */
+/*  Return:        U1 FSM_TRUE if valid    OR                            */
+/*                    FSM_FALSE                                          */
+/*************************************************************************/
+static U1 u1_fsm_snapshotCheckItems(const void* image, const FSMSnapshotHeader* header, U1* payloadSet)
+{
+  const FSM_QUEUE_ITEM* evt_t_item;
+  const U4* u4_t_queueCount;
+  FSM_INST inst_t_inst;
+  U8 u8_t_total;
+  U4 u4_t_idx;
+  U1 u1_t_valid;
+#ifdef FSM_CFG_DEFER
+  const FSM_QUEUE_ITEM* evt_t_defer;
+  const U1* u1_t_deferCount;
+#endif
+#ifdef FSM_CFG_TIMER
+  const U4* u4_t_timer;
+#endif
+
+  (void)payloadSet;
+
+  u4_t_queueCount = FSM_SNAPSHOT_SEC(image, header, FSM_SNAPSHOT_SEC_QUEUE_COUNT, const U4);
+  evt_t_item      = FSM_SNAPSHOT_SEC(image, header, FSM_SNAPSHOT_SEC_QUEUE_ITEM, const FSM_QUEUE_ITEM);
+  u8_t_total      = 0;
+  u1_t_valid      = FSM_TRUE;
+
+  for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+  {
+    u8_t_total += (U8)(unsigned int)u4_t_queueCount[inst_t_inst];
+  }
+
+  if(u8_t_total != (U8)(unsigned int)header->numQueued)
+  {
+    u1_t_valid = FSM_FALSE;
+  }
+  else
+  {
+
+  }
+
+  for(u4_t_idx = 0; (u1_t_valid == FSM_TRUE) && (u4_t_idx < header->numQueued); u4_t_idx++)
+  {
+    u1_t_valid = ((unsigned int)FSM_QUEUE_ITEM_EVT(evt_t_item[u4_t_idx]) < FSM_NUM_EVENTS) ? FSM_TRUE : FSM_FALSE;
+#ifdef FSM_CFG_PAYLOAD
+    u1_t_valid = (u1_t_valid == FSM_TRUE) ? u1_fsm_snapshotMarkPayload(evt_t_item[u4_t_idx], payloadSet) :
+                 FSM_FALSE;
+#endif
+  }
+
+#ifdef FSM_CFG_DEFER
+  u1_t_deferCount = FSM_SNAPSHOT_SEC(image, header, FSM_SNAPSHOT_SEC_DEFER_COUNT, const U1);
+  evt_t_defer     = FSM_SNAPSHOT_SEC(image, header, FSM_SNAPSHOT_SEC_DEFER_ITEM, const FSM_QUEUE_ITEM);
+
+  /* Events are checked by u1_fsm_snapshotLoadPool(), only payloads here. */
+  for(inst_t_inst = 0; (u1_t_valid == FSM_TRUE) && (inst_t_inst < FSM_NUM_INSTANCES); inst_t_inst++)
+  {
+    u1_t_valid = (u1_t_deferCount[inst_t_inst] <= FSM_DEFER_LENGTH) ? FSM_TRUE : FSM_FALSE;
+
+#ifdef FSM_CFG_PAYLOAD
+    for(u4_t_idx = 0; (u1_t_valid == FSM_TRUE) && (u4_t_idx < u1_t_deferCount[inst_t_inst]); u4_t_idx++)
+    {
+      u1_t_valid = u1_fsm_snapshotMarkPayload(evt_t_defer[(inst_t_inst * FSM_DEFER_LENGTH) + u4_t_idx], payloadSet);
+    }
+#endif
+  }
+
+  (void)evt_t_defer;
+#endif
+
+#ifdef FSM_CFG_TIMER
+  u4_t_timer = FSM_SNAPSHOT_SEC(image, header, FSM_SNAPSHOT_SEC_TIMER, const U4);
+
+  for(inst_t_inst = 0; (u1_t_valid == FSM_TRUE) && (inst_t_inst < FSM_NUM_INSTANCES); inst_t_inst++)
+  {
+    u1_t_valid = ((u4_t_timer[inst_t_inst] == FSM_TIMER_NOT_ARMED) || (u4_t_timer[inst_t_inst] >= 0)) ? FSM_TRUE :
+                 FSM_FALSE;
+  }
+#endif
+
+  return (u1_t_valid);
+}
+
+#ifdef FSM_CFG_PAYLOAD
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotMarkPayload                            */
+/*  Purpose:       Mark the buffer held by an event.                     */
+/*  Arguments:     FSM_QUEUE_ITEM item:                                  */
+/*                    Queued or deferred event.                          */
+/*                 U1* payloadSet:                                       */
+/*                    Buffers marked so far.                             */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE if out of range or already held          */
+/*************************************************************************/
+static U1 u1_fsm_snapshotMarkPayload(FSM_QUEUE_ITEM item, U1* payloadSet)
+{
+  FSM_PAYLOAD pld_t_payload;
+  U1 u1_t_valid;
+
+  pld_t_payload = FSM_QUEUE_ITEM_PAYLOAD(item);
+
+  if(pld_t_payload == FSM_PAYLOAD_NONE)
+  {
+    u1_t_valid = FSM_TRUE;
+  }
+  else if((pld_t_payload < FSM_PAYLOAD_COUNT) &&
+          ((payloadSet[FSM_PAYLOAD_SET_BYTE(pld_t_payload)] & FSM_PAYLOAD_SET_BIT(pld_t_payload)) == 0))
+  {
+    payloadSet[FSM_PAYLOAD_SET_BYTE(pld_t_payload)] |= (U1)FSM_PAYLOAD_SET_BIT(pld_t_payload);
+    u1_t_valid = FSM_TRUE;
+  }
+  else
+  {
+    u1_t_valid = FSM_FALSE;
+  }
+
+  return (u1_t_valid);
+}
+#endif
+
+#ifdef FSM_CFG_ASYNC
+/*************************************************************************/
+/*  Function Name: u1_fsm_snapshotAsyncIdle                              */
+/*  Purpose:       Check that no instance waits for an asynchronous      */
+/*                 action. An image cannot hold a running action or its  */
+/*                 completion.                                           */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U1 FSM_TRUE    OR                                     */
+/*                    FSM_FALSE if an action runs or a completion waits  */
+/*************************************************************************/
+static U1 u1_fsm_snapshotAsyncIdle(void)
+{
+  FSM_INST inst_t_inst;
+  U1 u1_t_idle;
+
+  u1_t_idle = FSM_TRUE;
+
+  for(inst_t_inst = 0; (inst_t_inst < FSM_NUM_INSTANCES) && (u1_t_idle == FSM_TRUE); inst_t_inst++)
+  {
+    if((u1_fsm_asyncPending(inst_t_inst) == FSM_TRUE) || (u1_fsm_asyncReady(inst_t_inst) == FSM_TRUE))
+    {
+      u1_t_idle = FSM_FALSE;
+    }
+    else
+    {
+
+    }
+  }
+
+  return (u1_t_idle);
+}
+#endif
+
+#endif
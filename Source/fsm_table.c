@@ -0,0 +1,113 @@
+/*************************************************************************/
+/*  File Name: fsm_table.c                                               */
+/*  Purpose: Auto-generated state table, do not modify.                  */
+/*           Generated by Tools/fsm_gen.py from                          */
+/*           fsm_example.fsm.                                            */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include "fsm.h"
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+const FSMTable fsm_sas_fsmTable =
+{
+  {
+    /* FSM_STATE_0 */
+    {
+      FSM_STATE_IDX_INACTIVE, FSM_STATE_1
+    },
+    /* FSM_STATE_1 */
+    {
+      FSM_STATE_0, FSM_STATE_IDX_INACTIVE
+    }
+  },
+#ifdef FSM_CFG_HIERARCHY
+  /* Chain */
+  {
+    {
+      0, 0
+    },
+    {
+      1, 0
+    }
+  },
+#endif
+  /* Marked states */
+  {
+    0x01
+  },
+#ifdef FSM_CFG_FILTER
+  /* Accepted events per state */
+  {
+    /* FSM_STATE_0 */
+    {
+      0x02
+    },
+    /* FSM_STATE_1 */
+    {
+      0x01
+    }
+  },
+  /* Events accepted by any state */
+  {
+    0x03
+  }
+#endif
+};
+
+#ifdef FSM_CFG_TIMER
+/* Timeout per state in ticks and the event it registers, 0 for none. */
+const FSMTimeout fsm_sas_fsmTimeout[FSM_STATE_COUNT] =
+{
+  {0, FSM_EVT_NULL}, {100, FSM_EVT_0}
+};
+#endif
+
+#ifdef FSM_CFG_PRIORITY
+/* Queue priority per event, higher is served first. */
+const U1 fsm_sa_evtPriority[FSM_EVT_COUNT] =
+{
+  0, 0
+};
+#endif
+
+#ifdef FSM_CFG_COALESCE
+/* Coalescing policy per event. */
+const U1 fsm_sa_evtCoalesce[FSM_EVT_COUNT] =
+{
+  FSM_COALESCE_NONE, FSM_COALESCE_NONE
+};
+#endif
+
+#ifdef FSM_CFG_DEFER
+/* Events parked per state until the next state change, one bit per
+   event. */
+const U1 fsm_sa_fsmDeferSet[FSM_STATE_COUNT][FSM_EVT_SET_LENGTH] =
+{
+  /* FSM_STATE_0 */
+  {
+    0x00
+  },
+  /* FSM_STATE_1 */
+  {
+    0x00
+  }
+};
+#endif
+
+#ifdef FSM_CFG_HIERARCHY
+/* States exited then entered by each transition, see FSMChain. */
+const FSM_STATE_IDX fsm_sa_fsmChainState[FSM_CHAIN_LENGTH] =
+{
+  FSM_STATE_0, FSM_STATE_1, FSM_STATE_1, FSM_STATE_0
+};
+
+const FSMChain fsm_sas_fsmChain[FSM_CHAIN_COUNT] =
+{
+  {0, 1, 1, 0x00000000u}, {2, 1, 1, 0x00000000u}
+};
+#endif
@@ -0,0 +1,423 @@
+/*************************************************************************/
+/*  File Name: fsm_timer.c                                               */
+/*  Purpose: Optional state timeouts for the FSM module, compiled in     */
+/*           with FSM_CFG_TIMER.                                         */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include "fsm.h"
+#include "fsm_exec.h"
+#include "fsm_wait.h"
+#include "fsm_timer.h"
+
+#ifdef FSM_CFG_TIMER
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Timer nodes are the instances followed by one list head per wheel slot,
+   all linked by index into circular doubly linked lists. An instance
+   timer is unlinked from its slot in O(1) without knowing the slot. */
+#define FSM_TIMER_NODES                  (FSM_NUM_INSTANCES + (FSM_TIMER_LEVELS * FSM_TIMER_SLOTS))
+#define FSM_TIMER_HEAD(level, slot)      (FSM_NUM_INSTANCES + ((level) * FSM_TIMER_SLOTS) + (slot))
+#define FSM_TIMER_UNLINKED               FSM_INST_INVALID
+
+/* Ticks covered by the whole wheel. */
+#define FSM_TIMER_RANGE                  (1u << (FSM_TIMER_LEVELS * FSM_TIMER_SLOT_BITS))
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static FSM_INST     inst_sa_timerNext[FSM_TIMER_NODES];
+static FSM_INST     inst_sa_timerPrev[FSM_TIMER_NODES];
+static unsigned int u4_sa_timerExpiry[FSM_NUM_INSTANCES];
+static FSM_EVT      evt_sa_timerEvt[FSM_NUM_INSTANCES];
+static unsigned int u4_s_timerNow;
+
+/* Instances expired by the current tick, notified once the lock is
+   released. Only used by the tick source. */
+static FSM_INST     inst_sa_timerDue[FSM_NUM_INSTANCES];
+
+static atomic_flag  fsm_s_timerLock = ATOMIC_FLAG_INIT;
+
+/* Set by the tick source when a timer expires, cleared when the timeout
+   is taken or its state is left. */
+atomic_uchar u1_sa_timerExpired[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static void vd_fsm_timerLink(FSM_INST inst);
+static void vd_fsm_timerUnlink(FSM_INST inst);
+static void vd_fsm_timerCascade(FSM_INST head);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerInit                                      */
+/*  Purpose:       Cancel all timers and reset the wheel to tick 0.      */
+/*                 Called by vd_fsm_init().                              */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerInit(void)
+{
+  FSM_INST inst_t_node;
+
+  fsm_timerEnterCritical();
+
+  for(inst_t_node = 0; inst_t_node < FSM_NUM_INSTANCES; inst_t_node++)
+  {
+    inst_sa_timerNext[inst_t_node] = FSM_TIMER_UNLINKED;
+    atomic_store_explicit(&u1_sa_timerExpired[inst_t_node], FSM_FALSE, memory_order_relaxed);
+  }
+
+  for(inst_t_node = FSM_NUM_INSTANCES; inst_t_node < FSM_TIMER_NODES; inst_t_node++)
+  {
+    inst_sa_timerNext[inst_t_node] = inst_t_node;
+    inst_sa_timerPrev[inst_t_node] = inst_t_node;
+  }
+
+  u4_s_timerNow = 0;
+
+  fsm_timerExitCritical();
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerArm                                       */
+/*  Purpose:       Cancel the timer of an instance and arm it again for  */
+/*                 the timeout of a state, if it has one. Called by      */
+/*                 fsm.c on state entry.                                 */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 FSM_STATE_IDX state:                                  */
+/*                    State entered.                                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerArm(FSM_INST inst, FSM_STATE_IDX state)
+{
+  fsm_timerEnterCritical();
+
+  if(inst_sa_timerNext[inst] != FSM_TIMER_UNLINKED)
+  {
+    vd_fsm_timerUnlink(inst);
+  }
+  else
+  {
+
+  }
+
+  /* A timeout of the state left is no longer due. */
+  atomic_store_explicit(&u1_sa_timerExpired[inst], FSM_FALSE, memory_order_relaxed);
+
+  if(fsm_sas_fsmTimeout[state].ticks != 0)
+  {
+    u4_sa_timerExpiry[inst] = u4_s_timerNow + (unsigned int)fsm_sas_fsmTimeout[state].ticks;
+    evt_sa_timerEvt[inst]   = fsm_sas_fsmTimeout[state].evt;
+
+    vd_fsm_timerLink(inst);
+  }
+  else
+  {
+
+  }
+
+  fsm_timerExitCritical();
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerArmTicks                                  */
+/*  Purpose:       Cancel the timer of an instance and arm it again to   */
+/*                 expire with evt in ticks ticks, for a restored        */
+/*                 snapshot.                                             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 ticks:                                             */
+/*                    Ticks from now, 0 for a timeout that has expired   */
+/*                    and waits to be served.                            */
+/*                 FSM_EVT evt:                                          */
+/*                    Timeout event.                                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerArmTicks(FSM_INST inst, U4 ticks, FSM_EVT evt)
+{
+  fsm_timerEnterCritical();
+
+  if(inst_sa_timerNext[inst] != FSM_TIMER_UNLINKED)
+  {
+    vd_fsm_timerUnlink(inst);
+  }
+  else
+  {
+
+  }
+
+  evt_sa_timerEvt[inst] = evt;
+
+  if(ticks > 0)
+  {
+    atomic_store_explicit(&u1_sa_timerExpired[inst], FSM_FALSE, memory_order_relaxed);
+    u4_sa_timerExpiry[inst] = u4_s_timerNow + (unsigned int)ticks;
+    vd_fsm_timerLink(inst);
+  }
+  else
+  {
+    atomic_store_explicit(&u1_sa_timerExpired[inst], FSM_TRUE, memory_order_release);
+  }
+
+  fsm_timerExitCritical();
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerCancel                                    */
+/*  Purpose:       Cancel the timer of an instance, if armed, and drop   */
+/*                 its timeout if it expired and was not served yet.     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerCancel(FSM_INST inst)
+{
+  fsm_timerEnterCritical();
+
+  if(inst_sa_timerNext[inst] != FSM_TIMER_UNLINKED)
+  {
+    vd_fsm_timerUnlink(inst);
+  }
+  else
+  {
+
+  }
+
+  atomic_store_explicit(&u1_sa_timerExpired[inst], FSM_FALSE, memory_order_relaxed);
+
+  fsm_timerExitCritical();
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerTick                                      */
+/*  Purpose:       Advance the wheel by one tick and expire every timer  */
+/*                 due. Call from a single tick source.                  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_timerTick(void)
+{
+  FSM_INST inst_t_head;
+  FSM_INST inst_t_inst;
+  U4 u4_t_level;
+  U4 u4_t_slot;
+  U4 u4_t_numDue;
+  U4 u4_t_idx;
+  U1 u1_t_cascadeFlag;
+
+  u4_t_numDue = 0;
+
+  fsm_timerEnterCritical();
+
+  u4_s_timerNow++;
+
+  /* Each time a level wraps, move the timers of the next slot one level
+     up down into finer slots. */
+  u4_t_level       = 1;
+  u1_t_cascadeFlag = ((u4_s_timerNow & FSM_TIMER_SLOT_MASK) == 0) ? FSM_TRUE : FSM_FALSE;
+
+  while((u1_t_cascadeFlag == FSM_TRUE) && (u4_t_level < FSM_TIMER_LEVELS))
+  {
+    u4_t_slot = (U4)((u4_s_timerNow >> (u4_t_level * FSM_TIMER_SLOT_BITS)) & FSM_TIMER_SLOT_MASK);
+
+    vd_fsm_timerCascade(FSM_TIMER_HEAD(u4_t_level, u4_t_slot));
+
+    u1_t_cascadeFlag = (u4_t_slot == 0) ? FSM_TRUE : FSM_FALSE;
+    u4_t_level++;
+  }
+
+  /* Everything in the current level 0 slot expires now. The timeout is
+     not queued, so leaving the state can still take it back. */
+  inst_t_head = FSM_TIMER_HEAD(0, u4_s_timerNow & FSM_TIMER_SLOT_MASK);
+
+  while(inst_sa_timerNext[inst_t_head] != inst_t_head)
+  {
+    inst_t_inst = inst_sa_timerNext[inst_t_head];
+
+    vd_fsm_timerUnlink(inst_t_inst);
+    atomic_store_explicit(&u1_sa_timerExpired[inst_t_inst], FSM_TRUE, memory_order_release);
+
+    inst_sa_timerDue[u4_t_numDue] = inst_t_inst;
+    u4_t_numDue++;
+  }
+
+  fsm_timerExitCritical();
+
+  /* The hook may block, e.g. on the executor mutex, so it runs without
+     the spin lock. A state left meanwhile only costs a spurious wakeup. */
+  for(u4_t_idx = 0; u4_t_idx < u4_t_numDue; u4_t_idx++)
+  {
+    vd_fsm_timerNotify(inst_sa_timerDue[u4_t_idx]);
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_timerRemaining                                 */
+/*  Purpose:       Return ticks until the timer of an instance expires.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 ticks, 0 if expired and not served yet    OR       */
+/*                    FSM_TIMER_NOT_ARMED                                */
+/*************************************************************************/
+U4 u4_fsm_timerRemaining(FSM_INST inst)
+{
+  U4 u4_t_rtn;
+
+  fsm_timerEnterCritical();
+
+  if(inst_sa_timerNext[inst] != FSM_TIMER_UNLINKED)
+  {
+    u4_t_rtn = (U4)(u4_sa_timerExpiry[inst] - u4_s_timerNow);
+  }
+  else if(atomic_load_explicit(&u1_sa_timerExpired[inst], memory_order_relaxed) == FSM_TRUE)
+  {
+    u4_t_rtn = 0;
+  }
+  else
+  {
+    u4_t_rtn = FSM_TIMER_NOT_ARMED;
+  }
+
+  fsm_timerExitCritical();
+
+  return (u4_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: evt_fsm_timerTakeSlot                                 */
+/*  Purpose:       Empty the expired timeout slot of an instance.        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        FSM_QUEUE_ITEM timeout event    OR                    */
+/*                 FSM_QUEUE_ITEM_NULL if cancelled meanwhile            */
+/*************************************************************************/
+FSM_QUEUE_ITEM evt_fsm_timerTakeSlot(FSM_INST inst)
+{
+  FSM_QUEUE_ITEM evt_t_item;
+
+  fsm_timerEnterCritical();
+
+  if(atomic_load_explicit(&u1_sa_timerExpired[inst], memory_order_relaxed) == FSM_TRUE)
+  {
+    atomic_store_explicit(&u1_sa_timerExpired[inst], FSM_FALSE, memory_order_relaxed);
+    evt_t_item = FSM_QUEUE_ITEM_MAKE(evt_sa_timerEvt[inst], FSM_PAYLOAD_NONE);
+  }
+  else
+  {
+    evt_t_item = FSM_QUEUE_ITEM_NULL;
+  }
+
+  fsm_timerExitCritical();
+
+  return (evt_t_item);
+}
+
+void vd_fsm_timerSpinLock(void)
+{
+  while(atomic_flag_test_and_set_explicit(&fsm_s_timerLock, memory_order_acquire))
+  {
+
+  }
+}
+
+void vd_fsm_timerSpinUnlock(void)
+{
+  atomic_flag_clear_explicit(&fsm_s_timerLock, memory_order_release);
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerLink                                      */
+/*  Purpose:       Put an instance timer in the wheel slot for its       */
+/*                 expiry tick. Timers less than 2^(6n) ticks away go    */
+/*                 into level n-1.                                       */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle, timer unlinked.                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_timerLink(FSM_INST inst)
+{
+  FSM_INST inst_t_head;
+  unsigned int u4_t_slotTick;
+  unsigned int u4_t_delta;
+  U4 u4_t_level;
+
+  u4_t_slotTick = u4_sa_timerExpiry[inst];
+  u4_t_delta    = u4_t_slotTick - u4_s_timerNow;
+
+  /* Past the wheel, park in the last slot and re-sort when it turns. */
+  if(u4_t_delta >= FSM_TIMER_RANGE)
+  {
+    u4_t_slotTick = u4_s_timerNow + FSM_TIMER_RANGE - 1;
+    u4_t_delta    = FSM_TIMER_RANGE - 1;
+  }
+  else
+  {
+
+  }
+
+  u4_t_level = 0;
+
+  while((u4_t_level < (FSM_TIMER_LEVELS - 1)) &&
+        (u4_t_delta >= (1u << ((u4_t_level + 1) * FSM_TIMER_SLOT_BITS))))
+  {
+    u4_t_level++;
+  }
+
+  inst_t_head = FSM_TIMER_HEAD(u4_t_level,
+                               (u4_t_slotTick >> (u4_t_level * FSM_TIMER_SLOT_BITS)) & FSM_TIMER_SLOT_MASK);
+
+  /* Append before the head. */
+  inst_sa_timerPrev[inst]                           = inst_sa_timerPrev[inst_t_head];
+  inst_sa_timerNext[inst]                           = inst_t_head;
+  inst_sa_timerNext[inst_sa_timerPrev[inst_t_head]] = inst;
+  inst_sa_timerPrev[inst_t_head]                    = inst;
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerUnlink                                    */
+/*  Purpose:       Remove an instance timer from its slot.               */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle, timer linked.                     */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_timerUnlink(FSM_INST inst)
+{
+  inst_sa_timerNext[inst_sa_timerPrev[inst]] = inst_sa_timerNext[inst];
+  inst_sa_timerPrev[inst_sa_timerNext[inst]] = inst_sa_timerPrev[inst];
+  inst_sa_timerNext[inst]                    = FSM_TIMER_UNLINKED;
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_timerCascade                                   */
+/*  Purpose:       Re-sort all timers of a slot relative to the current  */
+/*                 tick, which moves them to lower levels.               */
+/*  Arguments:     FSM_INST head:                                        */
+/*                    List head of the slot.                             */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_timerCascade(FSM_INST head)
+{
+  FSM_INST inst_t_inst;
+
+  while(inst_sa_timerNext[head] != head)
+  {
+    inst_t_inst = inst_sa_timerNext[head];
+
+    vd_fsm_timerUnlink(inst_t_inst);
+    vd_fsm_timerLink(inst_t_inst);
+  }
+}
+
+#endif
@@ -0,0 +1,384 @@
+/*************************************************************************/
+/*  File Name: fsm_trace.c                                               */
+/*  Purpose: Optional transition trace for the FSM module, compiled in   */
+/*           with FSM_CFG_TRACE. Needs POSIX mmap.                       */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "fsm.h"
+#include "fsm_trace.h"
+
+#ifdef FSM_CFG_TRACE
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+_Static_assert(sizeof(FSMTraceRecord) == 16, "FSMTraceRecord must be 16 bytes");
+_Static_assert(sizeof(FSMTraceHeader) == 64, "FSMTraceHeader must be 64 bytes");
+_Static_assert(FSM_STATE_COUNT < FSM_TRACE_STATE_NONE, "FSM_CFG_TRACE keeps states in 16 bits");
+_Static_assert(FSM_EVT_COUNT < FSM_TRACE_EVT_RESET, "FSM_CFG_TRACE keeps events in 16 bits");
+_Static_assert((FSM_TRACE_RING_LENGTH & (FSM_TRACE_RING_LENGTH - 1)) == 0,
+               "FSM_TRACE_RING_LENGTH must be a power of 2");
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+FSMTraceRing         fsm_sas_traceRing[FSM_TRACE_MAX_THREADS];
+_Thread_local U4     u4_tp_traceRing;
+atomic_uchar         u1_s_traceActive;
+atomic_ullong        u8_s_traceDropped;
+
+/* Bumped by every ring release. A thread that found no free ring stores
+   FSM_TRACE_MAX_THREADS + 1 in u4_tp_traceRing and the count it saw, and
+   scans again only once the count moved. */
+atomic_uint                u4_s_traceRingReleases;
+_Thread_local unsigned int u4_tp_traceRingReleases;
+
+/* Set while a live thread owns the ring. The thread specific key gives
+   the ring back when its thread exits. */
+static atomic_uchar   u1_sa_traceRingOwned[FSM_TRACE_MAX_THREADS];
+static pthread_key_t  fsm_s_traceRingKey;
+static pthread_once_t fsm_s_traceRingOnce = PTHREAD_ONCE_INIT;
+
+/* Owned by whoever holds fsm_s_traceLock. */
+static atomic_flag     fsm_s_traceLock = ATOMIC_FLAG_INIT;
+static FSMTraceHeader* fsm_sp_traceFile;
+static int             s4_s_traceFd = -1;
+static unsigned int    u4_sa_traceLastTicks[FSM_TRACE_MAX_THREADS];
+static U8              u8_sa_traceDroppedBase[FSM_TRACE_MAX_THREADS];
+static U8              u8_s_traceDroppedBase;
+static U8              u8_s_traceFileDropped;
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static U4 u4_fsm_traceDrain(void);
+static void vd_fsm_traceLock(void);
+static void vd_fsm_traceUnlock(void);
+static void vd_fsm_traceMakeKey(void);
+static void vd_fsm_traceReleaseRing(void* ring);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_traceOpen                                      */
+/*  Purpose:       Create a trace file, map it and start recording.      */
+/*                 Records still in the rings are discarded.             */
+/*  Arguments:     const char* path:                                     */
+/*                    File to create, truncated if it exists.            */
+/*                 U8 capacity:                                          */
+/*                    Max records in the file, later ones are dropped.   */
+/*  Return:        U1 FSM_TRACE_OPENED    OR                             */
+/*                    FSM_TRACE_OPEN_FAILED                              */
+/*************************************************************************/
+U1 u1_fsm_traceOpen(const char* path, U8 capacity)
+{
+  void* pv_t_map;
+  size_t u8_t_size;
+  U4 u4_t_ring;
+  U1 u1_t_rtn;
+
+  u1_t_rtn  = FSM_TRACE_OPEN_FAILED;
+  u8_t_size = sizeof(FSMTraceHeader) + ((size_t)capacity * sizeof(FSMTraceRecord));
+
+  vd_fsm_traceLock();
+
+  if(fsm_sp_traceFile == NULL)
+  {
+    s4_s_traceFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if((s4_s_traceFd >= 0) && (ftruncate(s4_s_traceFd, (off_t)u8_t_size) == 0) &&
+       ((pv_t_map = mmap(NULL, u8_t_size, PROT_READ | PROT_WRITE, MAP_SHARED, s4_s_traceFd, 0)) != MAP_FAILED))
+    {
+      fsm_sp_traceFile               = pv_t_map;
+      fsm_sp_traceFile->magic        = FSM_TRACE_MAGIC;
+      fsm_sp_traceFile->version      = FSM_TRACE_VERSION;
+      fsm_sp_traceFile->recordSize   = (U2)sizeof(FSMTraceRecord);
+      fsm_sp_traceFile->numStates    = FSM_NUM_STATES;
+      fsm_sp_traceFile->numEvents    = FSM_NUM_EVENTS;
+      fsm_sp_traceFile->fingerprint  = u8_fsm_tableFingerprint();
+      fsm_sp_traceFile->startTicks   = u4_fsm_getTicks();
+      fsm_sp_traceFile->numThreads   = FSM_TRACE_MAX_THREADS;
+      fsm_sp_traceFile->capacity     = capacity;
+      fsm_sp_traceFile->numRecords   = 0;
+      fsm_sp_traceFile->dropped      = 0;
+      fsm_sp_traceFile->numInstances = FSM_NUM_INSTANCES;
+      fsm_sp_traceFile->reserved     = 0;
+
+      /* Start every ring empty, counting from now. */
+      for(u4_t_ring = 0; u4_t_ring < FSM_TRACE_MAX_THREADS; u4_t_ring++)
+      {
+        atomic_store_explicit(&fsm_sas_traceRing[u4_t_ring].tail,
+                              atomic_load_explicit(&fsm_sas_traceRing[u4_t_ring].head, memory_order_acquire),
+                              memory_order_release);
+
+        u4_sa_traceLastTicks[u4_t_ring]   = (unsigned int)fsm_sp_traceFile->startTicks;
+        u8_sa_traceDroppedBase[u4_t_ring] = atomic_load_explicit(&fsm_sas_traceRing[u4_t_ring].dropped,
+                                                                 memory_order_relaxed);
+      }
+
+      u8_s_traceDroppedBase = atomic_load_explicit(&u8_s_traceDropped, memory_order_relaxed);
+      u8_s_traceFileDropped = 0;
+
+      atomic_store_explicit(&u1_s_traceActive, FSM_TRUE, memory_order_release);
+
+      u1_t_rtn = FSM_TRACE_OPENED;
+    }
+    else if(s4_s_traceFd >= 0)
+    {
+      (void)close(s4_s_traceFd);
+      s4_s_traceFd = -1;
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+
+  vd_fsm_traceUnlock();
+
+  return (u1_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_traceFlush                                     */
+/*  Purpose:       Copy the records of all rings into the trace file and */
+/*                 update its header. Safe from any thread, concurrent   */
+/*                 flushes are serialized.                               */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U4 records written                                    */
+/*************************************************************************/
+U4 u4_fsm_traceFlush(void)
+{
+  U4 u4_t_rtn;
+
+  vd_fsm_traceLock();
+
+  u4_t_rtn = u4_fsm_traceDrain();
+
+  vd_fsm_traceUnlock();
+
+  return (u4_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_traceClose                                     */
+/*  Purpose:       Stop recording, flush, and cut the file to the        */
+/*                 records written.                                      */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_traceClose(void)
+{
+  size_t u8_t_mapSize;
+  size_t u8_t_fileSize;
+
+  atomic_store_explicit(&u1_s_traceActive, FSM_FALSE, memory_order_relaxed);
+
+  vd_fsm_traceLock();
+
+  if(fsm_sp_traceFile != NULL)
+  {
+    (void)u4_fsm_traceDrain();
+
+    u8_t_mapSize  = sizeof(FSMTraceHeader) + ((size_t)fsm_sp_traceFile->capacity * sizeof(FSMTraceRecord));
+    u8_t_fileSize = sizeof(FSMTraceHeader) + ((size_t)fsm_sp_traceFile->numRecords * sizeof(FSMTraceRecord));
+
+    (void)munmap(fsm_sp_traceFile, u8_t_mapSize);
+    (void)ftruncate(s4_s_traceFd, (off_t)u8_t_fileSize);
+    (void)close(s4_s_traceFd);
+
+    fsm_sp_traceFile = NULL;
+    s4_s_traceFd     = -1;
+  }
+  else
+  {
+
+  }
+
+  vd_fsm_traceUnlock();
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_traceClaimRing                                 */
+/*  Purpose:       Assign a free ring to the calling thread until it     */
+/*                 exits. If none is free, records are dropped without   */
+/*                 trying again until another thread releases its ring.  */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U4 ring number + 1    OR                              */
+/*                    FSM_TRACE_MAX_THREADS + 1 if none is left          */
+/*************************************************************************/
+U4 u4_fsm_traceClaimRing(void)
+{
+  U4 u4_t_idx;
+  U4 u4_t_rtn;
+
+  u4_t_rtn = FSM_TRACE_MAX_THREADS + 1;
+
+  /* Read before the scan, so a ring released during it makes the next
+     record scan again. Pairs with the increment in
+     vd_fsm_traceReleaseRing(). */
+  u4_tp_traceRingReleases = atomic_load_explicit(&u4_s_traceRingReleases, memory_order_acquire);
+  u4_tp_traceRing         = u4_t_rtn;
+
+  if(pthread_once(&fsm_s_traceRingOnce, vd_fsm_traceMakeKey) == 0)
+  {
+    for(u4_t_idx = 0; (u4_t_idx < FSM_TRACE_MAX_THREADS) && (u4_t_rtn > FSM_TRACE_MAX_THREADS); u4_t_idx++)
+    {
+      /* Exchange pairs with the release in vd_fsm_traceReleaseRing(), the
+         new owner continues at the head left by the previous one. */
+      if((atomic_load_explicit(&u1_sa_traceRingOwned[u4_t_idx], memory_order_relaxed) == FSM_FALSE) &&
+         (atomic_exchange(&u1_sa_traceRingOwned[u4_t_idx], FSM_TRUE) == FSM_FALSE))
+      {
+        if(pthread_setspecific(fsm_s_traceRingKey, &fsm_sas_traceRing[u4_t_idx]) == 0)
+        {
+          u4_t_rtn        = u4_t_idx + 1;
+          u4_tp_traceRing = u4_t_rtn;
+        }
+        else
+        {
+          atomic_store_explicit(&u1_sa_traceRingOwned[u4_t_idx], FSM_FALSE, memory_order_release);
+        }
+      }
+      else
+      {
+
+      }
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u4_t_rtn);
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u4_fsm_traceDrain                                     */
+/*  Purpose:       Move the records of all rings to the file, turning    */
+/*                 absolute ticks into deltas. Records past the capacity */
+/*                 are dropped. Caller holds the lock.                   */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U4 records written                                    */
+/*************************************************************************/
+static U4 u4_fsm_traceDrain(void)
+{
+  FSMTraceRing* fsm_t_ring;
+  FSMTraceRecord* fsm_t_file;
+  FSMTraceRecord* fsm_t_record;
+  U8 u8_t_numRecords;
+  U8 u8_t_dropped;
+  unsigned int u4_t_head;
+  unsigned int u4_t_tail;
+  unsigned int u4_t_ticks;
+  U4 u4_t_ring;
+  U4 u4_t_rtn;
+
+  u4_t_rtn = 0;
+
+  if(fsm_sp_traceFile != NULL)
+  {
+    fsm_t_file      = (FSMTraceRecord*)(fsm_sp_traceFile + 1);
+    u8_t_numRecords = fsm_sp_traceFile->numRecords;
+    u8_t_dropped    = atomic_load_explicit(&u8_s_traceDropped, memory_order_relaxed) - u8_s_traceDroppedBase;
+
+    for(u4_t_ring = 0; u4_t_ring < FSM_TRACE_MAX_THREADS; u4_t_ring++)
+    {
+      fsm_t_ring = &fsm_sas_traceRing[u4_t_ring];
+      u4_t_head  = atomic_load_explicit(&fsm_t_ring->head, memory_order_acquire);
+
+      for(u4_t_tail = atomic_load_explicit(&fsm_t_ring->tail, memory_order_relaxed); u4_t_tail != u4_t_head;
+          u4_t_tail++)
+      {
+        if(u8_t_numRecords < fsm_sp_traceFile->capacity)
+        {
+          fsm_t_record = &fsm_t_file[u8_t_numRecords];
+          *fsm_t_record = fsm_t_ring->record[u4_t_tail & (FSM_TRACE_RING_LENGTH - 1)];
+
+          u4_t_ticks                      = (unsigned int)fsm_t_record->tickDelta;
+          fsm_t_record->tickDelta         = (U4)(u4_t_ticks - u4_sa_traceLastTicks[u4_t_ring]);
+          u4_sa_traceLastTicks[u4_t_ring] = u4_t_ticks;
+
+          u8_t_numRecords++;
+          u4_t_rtn++;
+        }
+        else
+        {
+          u8_s_traceFileDropped++;
+        }
+      }
+
+      atomic_store_explicit(&fsm_t_ring->tail, u4_t_head, memory_order_release);
+
+      u8_t_dropped += atomic_load_explicit(&fsm_t_ring->dropped, memory_order_relaxed) -
+                      u8_sa_traceDroppedBase[u4_t_ring];
+    }
+
+    fsm_sp_traceFile->numRecords = u8_t_numRecords;
+    fsm_sp_traceFile->dropped    = u8_t_dropped + u8_s_traceFileDropped;
+  }
+  else
+  {
+
+  }
+
+  return (u4_t_rtn);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_traceMakeKey                                   */
+/*  Purpose:       Create the key that releases rings on thread exit.    */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_traceMakeKey(void)
+{
+  (void)pthread_key_create(&fsm_s_traceRingKey, vd_fsm_traceReleaseRing);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_traceReleaseRing                               */
+/*  Purpose:       Give the ring of an exiting thread back. Records not  */
+/*                 flushed yet stay in it.                               */
+/*  Arguments:     void* ring:                                           */
+/*                    FSMTraceRing owned by the thread.                  */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_traceReleaseRing(void* ring)
+{
+  atomic_store_explicit(&u1_sa_traceRingOwned[(FSMTraceRing*)ring - fsm_sas_traceRing], FSM_FALSE,
+                        memory_order_release);
+  (void)atomic_fetch_add_explicit(&u4_s_traceRingReleases, 1, memory_order_release);
+}
+
+static void vd_fsm_traceLock(void)
+{
+  while(atomic_flag_test_and_set_explicit(&fsm_s_traceLock, memory_order_acquire))
+  {
+
+  }
+}
+
+static void vd_fsm_traceUnlock(void)
+{
+  atomic_flag_clear_explicit(&fsm_s_traceLock, memory_order_release);
+}
+
+#endif
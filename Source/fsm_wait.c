@@ -0,0 +1,456 @@
+/*************************************************************************/
+/*  File Name: fsm_wait.c                                                */
+/*  Purpose: Optional blocking wait for the FSM module, compiled in with */
+/*           FSM_CFG_WAIT. Needs Linux eventfd.                          */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_async.h"
+#include "fsm_timer.h"
+#include "fsm_wait.h"
+
+#ifdef FSM_CFG_WAIT
+
+#include <poll.h>
+#include <sched.h>
+#include <stdint.h>
+#include <sys/eventfd.h>
+#include <time.h>
+#include <unistd.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Instance has an event to serve, with FSM_CFG_ASYNC also a completion
+   and with FSM_CFG_TIMER an expired timeout. */
+#ifdef FSM_CFG_ASYNC
+#define FSM_WAIT_EVT_WAITING(inst)       ((u4_fsm_evtQueueDepth(inst) != 0) || \
+                                          (u1_fsm_asyncReady(inst) == FSM_TRUE) || \
+                                          (u1_fsm_timerReady(inst) == FSM_TRUE))
+#else
+#define FSM_WAIT_EVT_WAITING(inst)       ((u4_fsm_evtQueueDepth(inst) != 0) || \
+                                          (u1_fsm_timerReady(inst) == FSM_TRUE))
+#endif
+
+/* Replace with the pause instruction of the target for the spin phase. */
+#ifndef fsm_waitRelax
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define fsm_waitRelax()                  __builtin_ia32_pause()
+#else
+#define fsm_waitRelax()                  sched_yield()
+#endif
+#endif
+
+/* Milliseconds per sleep when the eventfd could not be opened, the queue
+   is polled instead. */
+#define FSM_WAIT_POLL_MS                 1
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+atomic_uchar u1_sa_waitArmed[FSM_NUM_INSTANCES];
+
+/* Opened on first use, FSM_WAIT_NO_FD until then. */
+static atomic_int u4_sa_waitFd[FSM_NUM_INSTANCES];
+static U1 u1_s_waitInitDone;
+
+/* Only touched by the thread serving the instance. Owned is set while it
+   has the instance armed, drain while the eventfd may hold a signal that
+   nobody waits for. */
+static U1 u1_sa_waitOwned[FSM_NUM_INSTANCES];
+static U1 u1_sa_waitDrain[FSM_NUM_INSTANCES];
+static U4 u4_sa_waitSpin[FSM_NUM_INSTANCES];
+static U4 u4_sa_waitSpinMax[FSM_NUM_INSTANCES];
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static U4 u4_fsm_waitOpenFd(FSM_INST inst);
+static void vd_fsm_waitDisarm(FSM_INST inst);
+static U8 u8_fsm_waitNowMs(void);
+
+
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitInit                                       */
+/*  Purpose:       Reset the wait state of every instance, emptying the  */
+/*                 eventfds opened so far. Called by vd_fsm_init().      */
+/*  Arguments:     N/A                                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitInit(void)
+{
+  FSM_INST inst_t_inst;
+  uint64_t u8_t_value;
+
+  for(inst_t_inst = 0; inst_t_inst < FSM_NUM_INSTANCES; inst_t_inst++)
+  {
+    if(u1_s_waitInitDone == FSM_FALSE)
+    {
+      atomic_store(&u4_sa_waitFd[inst_t_inst], FSM_WAIT_NO_FD);
+    }
+    else if(atomic_load(&u4_sa_waitFd[inst_t_inst]) != FSM_WAIT_NO_FD)
+    {
+      (void)read(atomic_load(&u4_sa_waitFd[inst_t_inst]), &u8_t_value, sizeof(u8_t_value));
+    }
+    else
+    {
+
+    }
+
+    atomic_store(&u1_sa_waitArmed[inst_t_inst], FSM_FALSE);
+    u1_sa_waitOwned[inst_t_inst]   = FSM_FALSE;
+    u1_sa_waitDrain[inst_t_inst]   = FSM_FALSE;
+    u4_sa_waitSpin[inst_t_inst]    = 0;
+    u4_sa_waitSpinMax[inst_t_inst] = 0;
+  }
+
+  u1_s_waitInitDone = FSM_TRUE;
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitClose                                      */
+/*  Purpose:       Close the eventfd of an instance and reset its wait   */
+/*                 state. Called by vd_fsm_destroy(), no thread may wait */
+/*                 for the instance.                                     */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitClose(FSM_INST inst)
+{
+  U4 u4_t_fd;
+
+  atomic_store(&u1_sa_waitArmed[inst], FSM_FALSE);
+  u4_t_fd = atomic_exchange(&u4_sa_waitFd[inst], FSM_WAIT_NO_FD);
+
+  if(u4_t_fd != FSM_WAIT_NO_FD)
+  {
+    (void)close(u4_t_fd);
+  }
+  else
+  {
+
+  }
+
+  u1_sa_waitOwned[inst]   = FSM_FALSE;
+  u1_sa_waitDrain[inst]   = FSM_FALSE;
+  u4_sa_waitSpin[inst]    = 0;
+  u4_sa_waitSpinMax[inst] = 0;
+}
+
+/*************************************************************************/
+/*  Function Name: u4_fsm_waitFd                                         */
+/*  Purpose:       Return the eventfd of an instance, readable after a   */
+/*                 producer found the instance armed. Opened on the      */
+/*                 first call.                                           */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 file descriptor    OR                              */
+/*                    FSM_WAIT_NO_FD if it could not be opened or inst   */
+/*                    is out of range                                    */
+/*************************************************************************/
+U4 u4_fsm_waitFd(FSM_INST inst)
+{
+  return (((inst >= 0) && (inst < FSM_NUM_INSTANCES) && (u1_s_waitInitDone == FSM_TRUE)) ?
+          u4_fsm_waitOpenFd(inst) : FSM_WAIT_NO_FD);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_waitArm                                        */
+/*  Purpose:       Arm an instance before sleeping on its eventfd in an  */
+/*                 epoll or poll loop, and empty the eventfd of a signal */
+/*                 already taken. Only the thread serving the instance.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U1 FSM_TRUE if armed, the eventfd becomes readable    */
+/*                    with the next event    OR                          */
+/*                    FSM_FALSE if events are waiting, serve them first  */
+/*************************************************************************/
+U1 u1_fsm_waitArm(FSM_INST inst)
+{
+  uint64_t u8_t_value;
+  U4 u4_t_fd;
+  U1 u1_t_rtnSts;
+
+  /* Open before arming, a producer that takes the arm signals it. */
+  u4_t_fd = u4_fsm_waitOpenFd(inst);
+
+  /* Still owned but no longer armed: a producer took the arm since the
+     last call and signals, or already did. */
+  if((atomic_exchange(&u1_sa_waitArmed[inst], FSM_TRUE) == FSM_FALSE) &&
+     (u1_sa_waitOwned[inst] == FSM_TRUE))
+  {
+    u1_sa_waitDrain[inst] = FSM_TRUE;
+  }
+  else
+  {
+
+  }
+
+  u1_sa_waitOwned[inst] = FSM_TRUE;
+
+  /* A signal still on its way is drained on a later call. Draining one
+     that belongs to this arm is harmless, its event is seen below. */
+  if((u1_sa_waitDrain[inst] == FSM_TRUE) &&
+     (read(u4_t_fd, &u8_t_value, sizeof(u8_t_value)) == (ssize_t)sizeof(u8_t_value)))
+  {
+    u1_sa_waitDrain[inst] = FSM_FALSE;
+  }
+  else
+  {
+
+  }
+
+  atomic_thread_fence(memory_order_seq_cst);
+
+  if(FSM_WAIT_EVT_WAITING(inst))
+  {
+    vd_fsm_waitDisarm(inst);
+    u1_t_rtnSts = FSM_FALSE;
+  }
+  else
+  {
+    u1_t_rtnSts = FSM_TRUE;
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: u1_fsm_waitEvt                                        */
+/*  Purpose:       Block until an instance has events to serve. Spins    */
+/*                 first if vd_fsm_waitSetSpin() gave it a budget. Only  */
+/*                 the thread serving the instance.                      */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 timeoutMs:                                         */
+/*                    Max milliseconds to block, or FSM_WAIT_FOREVER.    */
+/*  Return:        U1 FSM_WAIT_EVT_READY    OR                           */
+/*                    FSM_WAIT_TIMEOUT                                   */
+/*************************************************************************/
+U1 u1_fsm_waitEvt(FSM_INST inst, U4 timeoutMs)
+{
+  struct pollfd fsm_t_poll;
+  U8 u8_t_deadline;
+  U8 u8_t_now;
+  U4 u4_t_spin;
+  U4 u4_t_sleepMs;
+  U4 u4_t_fd;
+  U1 u1_t_rtnSts;
+  U1 u1_t_waitFlag;
+
+  u1_t_rtnSts = FSM_WAIT_TIMEOUT;
+
+  for(u4_t_spin = 0; (u4_t_spin < u4_sa_waitSpin[inst]) && !FSM_WAIT_EVT_WAITING(inst); u4_t_spin++)
+  {
+    fsm_waitRelax();
+  }
+
+  if(FSM_WAIT_EVT_WAITING(inst))
+  {
+    /* Spinning paid off, spin longer next time, at most the max. The
+       test is spin * 2 + 1 >= max without the overflow. */
+    u4_sa_waitSpin[inst] = (u4_sa_waitSpin[inst] >= u4_sa_waitSpinMax[inst] / 2) ?
+                           u4_sa_waitSpinMax[inst] : (u4_sa_waitSpin[inst] * 2 + 1);
+    u1_t_rtnSts          = FSM_WAIT_EVT_READY;
+  }
+  else
+  {
+    u4_sa_waitSpin[inst] /= 2;
+    u8_t_deadline         = (timeoutMs >= 0) ? (u8_fsm_waitNowMs() + (U8)timeoutMs) : 0;
+    u1_t_waitFlag         = FSM_TRUE;
+
+    while(u1_t_waitFlag == FSM_TRUE)
+    {
+      if(u1_fsm_waitArm(inst) == FSM_FALSE)
+      {
+        u1_t_rtnSts   = FSM_WAIT_EVT_READY;
+        u1_t_waitFlag = FSM_FALSE;
+      }
+      else
+      {
+        u8_t_now     = (timeoutMs >= 0) ? u8_fsm_waitNowMs() : 0;
+        u4_t_sleepMs = (timeoutMs < 0)              ? FSM_WAIT_FOREVER :
+                       (u8_t_now >= u8_t_deadline) ? 0 : (U4)(u8_t_deadline - u8_t_now);
+
+        u4_t_fd = u4_fsm_waitOpenFd(inst);
+
+        if((u4_t_fd == FSM_WAIT_NO_FD) &&
+           ((u4_t_sleepMs < 0) || (u4_t_sleepMs > FSM_WAIT_POLL_MS)))
+        {
+          u4_t_sleepMs = FSM_WAIT_POLL_MS;
+        }
+        else
+        {
+
+        }
+
+        fsm_t_poll.fd      = u4_t_fd;
+        fsm_t_poll.events  = POLLIN;
+        fsm_t_poll.revents = 0;
+
+        /* Interrupted or woken by a stale signal, checked below. */
+        (void)poll(&fsm_t_poll, 1, u4_t_sleepMs);
+
+        vd_fsm_waitDisarm(inst);
+
+        if(FSM_WAIT_EVT_WAITING(inst))
+        {
+          u1_t_rtnSts   = FSM_WAIT_EVT_READY;
+          u1_t_waitFlag = FSM_FALSE;
+        }
+        else if((timeoutMs >= 0) && (u8_fsm_waitNowMs() >= u8_t_deadline))
+        {
+          u1_t_waitFlag = FSM_FALSE;
+        }
+        else
+        {
+
+        }
+      }
+    }
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitSetSpin                                    */
+/*  Purpose:       Let u1_fsm_waitEvt() poll the queue of an instance up */
+/*                 to maxSpins times before it blocks. The budget adapts */
+/*                 between 0 and maxSpins: it doubles when events arrive */
+/*                 while spinning and halves when the wait blocks.       */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*                 U4 maxSpins:                                          */
+/*                    0 to always block at once, the default.            */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitSetSpin(FSM_INST inst, U4 maxSpins)
+{
+  if((inst >= 0) && (inst < FSM_NUM_INSTANCES) && (maxSpins >= 0))
+  {
+    u4_sa_waitSpin[inst]    = maxSpins;
+    u4_sa_waitSpinMax[inst] = maxSpins;
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitSignal                                     */
+/*  Purpose:       Make the eventfd of an instance readable.             */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+void vd_fsm_waitSignal(FSM_INST inst)
+{
+  uint64_t u8_t_value;
+  U4 u4_t_fd;
+
+  u8_t_value = 1;
+  u4_t_fd    = atomic_load_explicit(&u4_sa_waitFd[inst], memory_order_relaxed);
+
+  /* Opened before the instance was armed. */
+  if(u4_t_fd != FSM_WAIT_NO_FD)
+  {
+    (void)write(u4_t_fd, &u8_t_value, sizeof(u8_t_value));
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/*************************************************************************/
+/*  Function Name: u4_fsm_waitOpenFd                                     */
+/*  Purpose:       Return the eventfd of an instance, opening it if this */
+/*                 is the first use. Two threads opening it at once keep */
+/*                 the first one.                                        */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        U4 file descriptor    OR                              */
+/*                    FSM_WAIT_NO_FD if it could not be opened           */
+/*************************************************************************/
+static U4 u4_fsm_waitOpenFd(FSM_INST inst)
+{
+  int s4_t_expected;
+  U4 u4_t_fd;
+
+  u4_t_fd = atomic_load_explicit(&u4_sa_waitFd[inst], memory_order_acquire);
+
+  if(u4_t_fd == FSM_WAIT_NO_FD)
+  {
+    u4_t_fd       = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    s4_t_expected = FSM_WAIT_NO_FD;
+
+    if((u4_t_fd != FSM_WAIT_NO_FD) &&
+       (atomic_compare_exchange_strong(&u4_sa_waitFd[inst], &s4_t_expected, u4_t_fd) == 0))
+    {
+      (void)close(u4_t_fd);
+      u4_t_fd = s4_t_expected;
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u4_t_fd);
+}
+
+/*************************************************************************/
+/*  Function Name: vd_fsm_waitDisarm                                     */
+/*  Purpose:       Stop producers from signalling an instance, noting a  */
+/*                 signal to drain if one of them already took the arm.  */
+/*  Arguments:     FSM_INST inst:                                        */
+/*                    Instance handle.                                   */
+/*  Return:        N/A                                                   */
+/*************************************************************************/
+static void vd_fsm_waitDisarm(FSM_INST inst)
+{
+  if(atomic_exchange(&u1_sa_waitArmed[inst], FSM_FALSE) == FSM_FALSE)
+  {
+    u1_sa_waitDrain[inst] = FSM_TRUE;
+  }
+  else
+  {
+
+  }
+
+  u1_sa_waitOwned[inst] = FSM_FALSE;
+}
+
+/*************************************************************************/
+/*  Function Name: u8_fsm_waitNowMs                                      */
+/*  Purpose:       Return a monotonic time for timeouts.                 */
+/*  Arguments:     N/A                                                   */
+/*  Return:        U8 milliseconds                                       */
+/*************************************************************************/
+static U8 u8_fsm_waitNowMs(void)
+{
+  struct timespec fsm_t_now;
+
+  (void)clock_gettime(CLOCK_MONOTONIC, &fsm_t_now);
+
+  return ((U8)fsm_t_now.tv_sec * 1000u + (U8)fsm_t_now.tv_nsec / 1000000u);
+}
+
+#endif
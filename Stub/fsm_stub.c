@@ -1,72 +1,389 @@
-/*************************************************************************/
-/*  File Name: fsm_stub.c                                                */
-/*  Purpose: Basic queue implementation. These files can be removed from */
-/*           project when integrating a different event queue.           */
-/*************************************************************************/
-
-/*************************************************************************/
-/*  Includes                                                             */
-/*************************************************************************/
-#include "fsm.h"
-#include "fsm_stub.h"
-
-/*************************************************************************/
-/*  Definitions                                                          */
-/*************************************************************************/
-#define FSM_QUEUE_ROLLOVER_MASK   (0xFFFFFFFF >> (32 - 3))
-
-/*************************************************************************/
-/*  Private Data Types                                                   */
-/*************************************************************************/
-
-
-/*************************************************************************/
-/*  Static Global Variables, Constants                                   */
-/*************************************************************************/
-static U4 u4_s_queuePutIndex = 0;
-static U4 u4_s_queueGetIndex = 0;
-
-static FSM_EVT evt_sa_eventQueue[FSM_EVT_QUEUE_LENGTH];
-
-/*************************************************************************/
-/*************************************************************************/
-U1 u1_fsm_evtQueuePutStub(FSM_EVT evt)
-{
-  U1 u1_t_rtnSts;
-  U4 u4_t_nextIndex;
-
-  u4_t_nextIndex = (u4_s_queuePutIndex + 1) & FSM_QUEUE_ROLLOVER_MASK;
-
-  if(u4_t_nextIndex == u4_s_queueGetIndex)
-  {
-    u1_t_rtnSts = 1;
-  }
-  else
-  {
-    evt_sa_eventQueue[u4_s_queuePutIndex] = evt;
-    u4_s_queuePutIndex = u4_t_nextIndex;
-
-    u1_t_rtnSts = 0;
-  }
-
-  return (u1_t_rtnSts);
-}
-
-
-FSM_EVT evt_fsm_evtQueueGetStub(void)
-{
-  U1 u1_t_rtn;
-
-  if(u4_s_queuePutIndex == u4_s_queueGetIndex)
-  {
-    u1_t_rtn = FSM_EVT_NULL;
-  }
-  else
-  {
-    u1_t_rtn = evt_sa_eventQueue[u4_s_queueGetIndex];
-
-    u4_s_queueGetIndex = (u4_s_queueGetIndex + 1) & FSM_QUEUE_ROLLOVER_MASK;
-  }
-
-  return (u1_t_rtn);
-}
+/*************************************************************************/
+/*  File Name: fsm_stub.c                                                */
+/*  Purpose: Lock-free event queue implementation, one queue per FSM     */
+/*           instance. These files can be removed from project when      */
+/*           integrating a different event queue.                        */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#include <stdatomic.h>
+#include "fsm.h"
+#include "fsm_stub.h"
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define FSM_QUEUE_ROLLOVER_MASK   (FSM_EVT_QUEUE_LENGTH - 1)
+
+_Static_assert((FSM_EVT_QUEUE_LENGTH & FSM_QUEUE_ROLLOVER_MASK) == 0,
+               "FSM_EVT_QUEUE_LENGTH must be a power of two");
+
+/* With FSM_CFG_PRIORITY each instance has one ring per priority level and
+   a mask of levels that may hold events. The highest level is found with
+   one count of leading zeros. */
+#ifdef FSM_CFG_PRIORITY
+#define FSM_QUEUE_LEVELS          FSM_EVT_PRIORITY_COUNT
+
+_Static_assert(FSM_EVT_PRIORITY_COUNT <= 32, "FSM_EVT_PRIORITY_COUNT must be at most 32");
+
+/* Replace with the count leading zeros instruction of the target,
+   argument is never 0. */
+#ifndef fsm_clz
+#define fsm_clz(mask)             __builtin_clz(mask)
+#endif
+#else
+#define FSM_QUEUE_LEVELS          1
+#endif
+
+/*************************************************************************/
+/*  Private Data Types                                                   */
+/*************************************************************************/
+#if (FSM_QUEUE_MODE == FSM_QUEUE_SPSC)
+/* Lamport ring. Each side keeps a cached copy of the other side's index
+   so the shared line is only read when the ring looks full/empty. */
+typedef struct FSMEvtQueue
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint    putIndex;
+  unsigned int                                 getIndexCache;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint    getIndex;
+  unsigned int                                 putIndexCache;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) FSM_QUEUE_ITEM eventList[FSM_EVT_QUEUE_LENGTH];
+}
+FSMEvtQueue;
+#else
+/* Bounded ring with a sequence number per slot. Producers claim a slot
+   with a CAS on putIndex, the sequence number publishes the event. */
+typedef struct FSMEvtSlot
+{
+  atomic_uint    sequence;
+  FSM_QUEUE_ITEM evt;
+}
+FSMEvtSlot;
+
+typedef struct FSMEvtQueue
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint putIndex;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint getIndex;
+
+  _Alignas(FSM_CACHE_LINE_SIZE) FSMEvtSlot  slotList[FSM_EVT_QUEUE_LENGTH];
+}
+FSMEvtQueue;
+#endif
+
+#ifdef FSM_CFG_PRIORITY
+/* Bit p set while level p may hold events, written by producers and the
+   consumer alike. */
+typedef struct FSMEvtReady
+{
+  _Alignas(FSM_CACHE_LINE_SIZE) atomic_uint levelMask;
+}
+FSMEvtReady;
+#endif
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static FSMEvtQueue fsm_sas_evtQueue[FSM_NUM_INSTANCES][FSM_QUEUE_LEVELS];
+
+#ifdef FSM_CFG_PRIORITY
+static FSMEvtReady fsm_sas_evtReady[FSM_NUM_INSTANCES];
+#endif
+
+/*************************************************************************/
+/*  Private Function Prototypes                                          */
+/*************************************************************************/
+static U1 u1_fsm_ringPut(FSMEvtQueue* fsm_t_queue, FSM_QUEUE_ITEM evt);
+static FSM_QUEUE_ITEM evt_fsm_ringGet(FSMEvtQueue* fsm_t_queue);
+static void vd_fsm_ringReset(FSMEvtQueue* fsm_t_queue);
+static U4 u4_fsm_ringDepth(FSMEvtQueue* fsm_t_queue);
+
+/*************************************************************************/
+/*************************************************************************/
+U1 u1_fsm_evtQueuePutStub(FSM_INST inst, FSM_QUEUE_ITEM evt)
+{
+  U1 u1_t_rtnSts;
+#ifdef FSM_CFG_PRIORITY
+  U4 u4_t_level;
+
+  u4_t_level  = fsm_sa_evtPriority[FSM_QUEUE_ITEM_EVT(evt)];
+  u1_t_rtnSts = u1_fsm_ringPut(&fsm_sas_evtQueue[inst][u4_t_level], evt);
+
+  /* Publish the level after the event, see evt_fsm_evtQueueGetStub(). */
+  if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+  {
+    atomic_fetch_or_explicit(&fsm_sas_evtReady[inst].levelMask, 1u << u4_t_level, memory_order_release);
+  }
+  else
+  {
+
+  }
+#else
+  u1_t_rtnSts = u1_fsm_ringPut(&fsm_sas_evtQueue[inst][0], evt);
+#endif
+
+  return (u1_t_rtnSts);
+}
+
+
+FSM_QUEUE_ITEM evt_fsm_evtQueueGetStub(FSM_INST inst)
+{
+  FSM_QUEUE_ITEM evt_t_rtn;
+#ifdef FSM_CFG_PRIORITY
+  unsigned int u4_t_levelMask;
+  U4 u4_t_level;
+
+  evt_t_rtn      = FSM_QUEUE_ITEM_NULL;
+  u4_t_levelMask = atomic_load_explicit(&fsm_sas_evtReady[inst].levelMask, memory_order_acquire);
+
+  while((u4_t_levelMask != 0) && (FSM_QUEUE_ITEM_EVT(evt_t_rtn) == FSM_EVT_NULL))
+  {
+    u4_t_level = 31 - fsm_clz(u4_t_levelMask);
+    evt_t_rtn  = evt_fsm_ringGet(&fsm_sas_evtQueue[inst][u4_t_level]);
+
+    /* Level drained. Clear its bit, then look again: a producer that set
+       the bit before the clear has published its event by then. */
+    if(FSM_QUEUE_ITEM_EVT(evt_t_rtn) == FSM_EVT_NULL)
+    {
+      atomic_fetch_and_explicit(&fsm_sas_evtReady[inst].levelMask, ~(1u << u4_t_level), memory_order_acq_rel);
+
+      evt_t_rtn = evt_fsm_ringGet(&fsm_sas_evtQueue[inst][u4_t_level]);
+
+      if(FSM_QUEUE_ITEM_EVT(evt_t_rtn) != FSM_EVT_NULL)
+      {
+        atomic_fetch_or_explicit(&fsm_sas_evtReady[inst].levelMask, 1u << u4_t_level, memory_order_relaxed);
+      }
+      else
+      {
+
+      }
+
+      u4_t_levelMask = atomic_load_explicit(&fsm_sas_evtReady[inst].levelMask, memory_order_acquire);
+    }
+    else
+    {
+
+    }
+  }
+#else
+  evt_t_rtn = evt_fsm_ringGet(&fsm_sas_evtQueue[inst][0]);
+#endif
+
+  return (evt_t_rtn);
+}
+
+
+void vd_fsm_evtQueueResetStub(FSM_INST inst)
+{
+  U4 u4_t_level;
+
+  for(u4_t_level = 0; u4_t_level < FSM_QUEUE_LEVELS; u4_t_level++)
+  {
+    vd_fsm_ringReset(&fsm_sas_evtQueue[inst][u4_t_level]);
+  }
+
+#ifdef FSM_CFG_PRIORITY
+  atomic_store_explicit(&fsm_sas_evtReady[inst].levelMask, 0, memory_order_release);
+#endif
+}
+
+
+U4 u4_fsm_evtQueueDepthStub(FSM_INST inst)
+{
+  U4 u4_t_level;
+  U4 u4_t_depth;
+
+  u4_t_depth = 0;
+
+  for(u4_t_level = 0; u4_t_level < FSM_QUEUE_LEVELS; u4_t_level++)
+  {
+    u4_t_depth += u4_fsm_ringDepth(&fsm_sas_evtQueue[inst][u4_t_level]);
+  }
+
+  return (u4_t_depth);
+}
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+/* Approximate while producers run, putIndex counts claimed slots.       */
+static U4 u4_fsm_ringDepth(FSMEvtQueue* fsm_t_queue)
+{
+  unsigned int u4_t_putIndex;
+  unsigned int u4_t_getIndex;
+
+  u4_t_getIndex = atomic_load_explicit(&fsm_t_queue->getIndex, memory_order_relaxed);
+  u4_t_putIndex = atomic_load_explicit(&fsm_t_queue->putIndex, memory_order_relaxed);
+
+  return ((U4)(u4_t_putIndex - u4_t_getIndex));
+}
+
+
+#if (FSM_QUEUE_MODE == FSM_QUEUE_SPSC)
+static U1 u1_fsm_ringPut(FSMEvtQueue* fsm_t_queue, FSM_QUEUE_ITEM evt)
+{
+  unsigned int u4_t_putIndex;
+  U1 u1_t_rtnSts;
+
+  u4_t_putIndex = atomic_load_explicit(&fsm_t_queue->putIndex, memory_order_relaxed);
+
+  /* Refresh the consumer index only when the ring looks full. */
+  if((u4_t_putIndex - fsm_t_queue->getIndexCache) == FSM_EVT_QUEUE_LENGTH)
+  {
+    fsm_t_queue->getIndexCache = atomic_load_explicit(&fsm_t_queue->getIndex, memory_order_acquire);
+  }
+  else
+  {
+
+  }
+
+  if((u4_t_putIndex - fsm_t_queue->getIndexCache) == FSM_EVT_QUEUE_LENGTH)
+  {
+    u1_t_rtnSts = FSM_EVT_NOT_REGISTERED;
+  }
+  else
+  {
+    fsm_t_queue->eventList[u4_t_putIndex & FSM_QUEUE_ROLLOVER_MASK] = evt;
+    atomic_store_explicit(&fsm_t_queue->putIndex, u4_t_putIndex + 1, memory_order_release);
+
+    u1_t_rtnSts = FSM_EVT_REGISTERED;
+  }
+
+  return (u1_t_rtnSts);
+}
+
+
+static FSM_QUEUE_ITEM evt_fsm_ringGet(FSMEvtQueue* fsm_t_queue)
+{
+  unsigned int u4_t_getIndex;
+  FSM_QUEUE_ITEM evt_t_rtn;
+
+  u4_t_getIndex = atomic_load_explicit(&fsm_t_queue->getIndex, memory_order_relaxed);
+
+  /* Refresh the producer index only when the ring looks empty. */
+  if(u4_t_getIndex == fsm_t_queue->putIndexCache)
+  {
+    fsm_t_queue->putIndexCache = atomic_load_explicit(&fsm_t_queue->putIndex, memory_order_acquire);
+  }
+  else
+  {
+
+  }
+
+  if(u4_t_getIndex == fsm_t_queue->putIndexCache)
+  {
+    evt_t_rtn = FSM_QUEUE_ITEM_NULL;
+  }
+  else
+  {
+    evt_t_rtn = fsm_t_queue->eventList[u4_t_getIndex & FSM_QUEUE_ROLLOVER_MASK];
+    atomic_store_explicit(&fsm_t_queue->getIndex, u4_t_getIndex + 1, memory_order_release);
+  }
+
+  return (evt_t_rtn);
+}
+
+
+static void vd_fsm_ringReset(FSMEvtQueue* fsm_t_queue)
+{
+  atomic_store_explicit(&fsm_t_queue->putIndex, 0, memory_order_relaxed);
+  atomic_store_explicit(&fsm_t_queue->getIndex, 0, memory_order_relaxed);
+  fsm_t_queue->getIndexCache = 0;
+  fsm_t_queue->putIndexCache = 0;
+}
+#else
+static U1 u1_fsm_ringPut(FSMEvtQueue* fsm_t_queue, FSM_QUEUE_ITEM evt)
+{
+  FSMEvtSlot* fsm_t_slot;
+  unsigned int u4_t_putIndex;
+  int s4_t_diff;
+  U1 u1_t_rtnSts;
+  U1 u1_t_claimFlag;
+
+  u4_t_putIndex  = atomic_load_explicit(&fsm_t_queue->putIndex, memory_order_relaxed);
+  u1_t_rtnSts    = FSM_EVT_REGISTERED;
+  u1_t_claimFlag = FSM_TRUE;
+
+  while(u1_t_claimFlag == FSM_TRUE)
+  {
+    fsm_t_slot = &fsm_t_queue->slotList[u4_t_putIndex & FSM_QUEUE_ROLLOVER_MASK];
+    s4_t_diff  = (int)(atomic_load_explicit(&fsm_t_slot->sequence, memory_order_acquire) - u4_t_putIndex);
+
+    /* Slot free for this lap, try to claim it. On failure putIndex is
+       reloaded by the CAS. */
+    if(s4_t_diff == 0)
+    {
+      u1_t_claimFlag = !atomic_compare_exchange_weak_explicit(&fsm_t_queue->putIndex, &u4_t_putIndex,
+                                                              u4_t_putIndex + 1, memory_order_relaxed,
+                                                              memory_order_relaxed);
+    }
+    /* Slot still holds an event from the previous lap, queue is full. */
+    else if(s4_t_diff < 0)
+    {
+      u1_t_rtnSts    = FSM_EVT_NOT_REGISTERED;
+      u1_t_claimFlag = FSM_FALSE;
+    }
+    /* Another producer claimed it first. */
+    else
+    {
+      u4_t_putIndex = atomic_load_explicit(&fsm_t_queue->putIndex, memory_order_relaxed);
+    }
+  }
+
+  if(u1_t_rtnSts == FSM_EVT_REGISTERED)
+  {
+    fsm_t_slot->evt = evt;
+    atomic_store_explicit(&fsm_t_slot->sequence, u4_t_putIndex + 1, memory_order_release);
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+
+static FSM_QUEUE_ITEM evt_fsm_ringGet(FSMEvtQueue* fsm_t_queue)
+{
+  FSMEvtSlot* fsm_t_slot;
+  unsigned int u4_t_getIndex;
+  FSM_QUEUE_ITEM evt_t_rtn;
+
+  u4_t_getIndex = atomic_load_explicit(&fsm_t_queue->getIndex, memory_order_relaxed);
+  fsm_t_slot    = &fsm_t_queue->slotList[u4_t_getIndex & FSM_QUEUE_ROLLOVER_MASK];
+
+  if(atomic_load_explicit(&fsm_t_slot->sequence, memory_order_acquire) != (u4_t_getIndex + 1))
+  {
+    evt_t_rtn = FSM_QUEUE_ITEM_NULL;
+  }
+  else
+  {
+    evt_t_rtn = fsm_t_slot->evt;
+
+    /* Hand the slot back to producers for the next lap. */
+    atomic_store_explicit(&fsm_t_slot->sequence, u4_t_getIndex + FSM_EVT_QUEUE_LENGTH, memory_order_release);
+    atomic_store_explicit(&fsm_t_queue->getIndex, u4_t_getIndex + 1, memory_order_relaxed);
+  }
+
+  return (evt_t_rtn);
+}
+
+
+static void vd_fsm_ringReset(FSMEvtQueue* fsm_t_queue)
+{
+  unsigned int u4_t_idx;
+
+  for(u4_t_idx = 0; u4_t_idx < FSM_EVT_QUEUE_LENGTH; u4_t_idx++)
+  {
+    atomic_store_explicit(&fsm_t_queue->slotList[u4_t_idx].sequence, u4_t_idx, memory_order_relaxed);
+  }
+
+  atomic_store_explicit(&fsm_t_queue->putIndex, 0, memory_order_relaxed);
+  atomic_store_explicit(&fsm_t_queue->getIndex, 0, memory_order_release);
+}
+#endif
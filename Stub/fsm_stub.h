@@ -1,29 +1,49 @@
-/*************************************************************************/
-/*  File Name: fsm_stub.h                                                */
-/*  Purpose: Basic queue implementation. These files can be removed from */
-/*           project when integrating a different event queue.           */
-/*************************************************************************/
-
-#ifndef fsm_stub_h
-#define fsm_stub_h
-
-#include <stdio.h>
-#include <stdlib.h>
-
-/*************************************************************************/
-/*  Definitions                                                          */
-/*************************************************************************/
-#define FSM_EVT_QUEUE_LENGTH         8
-
-/*************************************************************************/
-/*  Public Data Types                                                    */
-/*************************************************************************/
-
-
-/*************************************************************************/
-/*  Public Functions                                                     */
-/*************************************************************************/
-U1 u1_fsm_evtQueuePutStub(FSM_EVT evt);
-FSM_EVT evt_fsm_evtQueueGetStub(void);
-
-#endif
+/*************************************************************************/
+/*  File Name: fsm_stub.h                                                */
+/*  Purpose: Lock-free event queue implementation, one queue per FSM     */
+/*           instance. These files can be removed from project when      */
+/*           integrating a different event queue.                        */
+/*************************************************************************/
+
+#ifndef fsm_stub_h
+#define fsm_stub_h
+
+#include <stdio.h>
+#include <stdlib.h>
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+/* Queue capacity per instance, must be a power of two. With
+   FSM_CFG_PRIORITY this is the capacity of each priority level. */
+#ifndef FSM_EVT_QUEUE_LENGTH
+#define FSM_EVT_QUEUE_LENGTH         8
+#endif
+
+/* FSM_QUEUE_SPSC: one producer thread per instance.
+   FSM_QUEUE_MPSC: any number of producer threads per instance.
+   Both modes allow one consumer thread per instance and take no lock. */
+#define FSM_QUEUE_SPSC               0
+#define FSM_QUEUE_MPSC               1
+
+#ifndef FSM_QUEUE_MODE
+#define FSM_QUEUE_MODE               FSM_QUEUE_MPSC
+#endif
+
+/* Queue does not rely on fsm_enterCritical()/fsm_exitCritical(). */
+#define FSM_QUEUE_LOCK_FREE
+
+/*************************************************************************/
+/*  Public Data Types                                                    */
+/*************************************************************************/
+
+
+/*************************************************************************/
+/*  Public Functions                                                     */
+/*************************************************************************/
+U1 u1_fsm_evtQueuePutStub(FSM_INST inst, FSM_QUEUE_ITEM evt);
+FSM_QUEUE_ITEM evt_fsm_evtQueueGetStub(FSM_INST inst);
+void vd_fsm_evtQueueResetStub(FSM_INST inst);
+U4 u4_fsm_evtQueueDepthStub(FSM_INST inst);
+
+#endif
@@ -0,0 +1,367 @@
+/*************************************************************************/
+/*  File Name: fsm_test.c                                                */
+/*  Purpose: Behavior tests for the FSM module. Built by                 */
+/*           Test/fsm_test.py against the table generated from           */
+/*           Test/fsm_test.fsm and Test/fsm_test.coalesce, with          */
+/*           FSM_CFG_PAYLOAD, FSM_CFG_COALESCE and FSM_CFG_SNAPSHOT.     */
+/*                                                                       */
+/*           fsm_test <snapshot file>                                    */
+/*           Prints every failed check, exits with 1 if any failed.      */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include "fsm.h"
+#include "fsm_stub.h"
+#include "fsm_payload.h"
+#include "fsm_coalesce.h"
+#include "fsm_snapshot.h"
+
+#if !defined(FSM_CFG_PAYLOAD) || !defined(FSM_CFG_COALESCE) || !defined(FSM_CFG_SNAPSHOT)
+#error "fsm_test needs FSM_CFG_PAYLOAD, FSM_CFG_COALESCE and FSM_CFG_SNAPSHOT"
+#endif
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define TEST_CHECK(cond)       vd_test_check((cond) ? FSM_TRUE : FSM_FALSE, #cond, __LINE__)
+
+#define TEST_NO_PAYLOAD        (-1)
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+static U4 u4_s_numChecks;
+static U4 u4_s_numFailed;
+
+/* Seen by the entry callback since the last vd_test_clear(). */
+static U4  u4_s_entries;
+static U4  u4_s_count;
+static int s4_s_payloadValue;
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+static void vd_test_check(U1 passed, const char* cond, int line)
+{
+  u4_s_numChecks++;
+
+  if(passed == FSM_FALSE)
+  {
+    u4_s_numFailed++;
+    printf("fsm_test.c:%d: check failed: %s\n", line, cond);
+  }
+  else
+  {
+
+  }
+}
+
+/* Entry callback installed for every state, records what the event being
+   served stands for. */
+static void vd_test_entry(FSM_INST inst, U1 reentrySts, void* payload)
+{
+  (void)reentrySts;
+
+  u4_s_entries++;
+  u4_s_count += u4_fsm_coalesceCount(inst);
+
+  if(payload != NULL)
+  {
+    s4_s_payloadValue = *(int*)payload;
+  }
+  else
+  {
+
+  }
+}
+
+static void vd_test_clear(void)
+{
+  u4_s_entries      = 0;
+  u4_s_count        = 0;
+  s4_s_payloadValue = TEST_NO_PAYLOAD;
+}
+
+static void vd_test_reset(void)
+{
+  vd_fsm_init();
+  (void)u1_fsm_setStateFp(FSM_STATE_IDLE, FSM_STATE_SET_ENTRY_FUNC, (void*)vd_test_entry);
+  (void)u1_fsm_setStateFp(FSM_STATE_BUSY, FSM_STATE_SET_ENTRY_FUNC, (void*)vd_test_entry);
+  vd_test_clear();
+}
+
+/* Register an event carrying an int, the payload goes back to the pool if
+   the event is not registered. */
+static U1 u1_test_registerValue(FSM_INST inst, FSM_EVT evt, int value)
+{
+  FSM_PAYLOAD pld_t_payload;
+  U1 u1_t_rtnSts;
+
+  pld_t_payload = pld_fsm_payloadAlloc();
+  u1_t_rtnSts   = FSM_EVT_NOT_REGISTERED;
+
+  if(pld_t_payload != FSM_PAYLOAD_NONE)
+  {
+    memcpy(pv_fsm_payloadGet(pld_t_payload), &value, sizeof(value));
+    u1_t_rtnSts = u1_fsm_instRegisterEvtPayload(inst, evt, pld_t_payload);
+
+    if(u1_t_rtnSts != FSM_EVT_REGISTERED)
+    {
+      vd_fsm_payloadFree(pld_t_payload);
+    }
+    else
+    {
+
+    }
+  }
+  else
+  {
+
+  }
+
+  return (u1_t_rtnSts);
+}
+
+/* Number of free payload buffers, the pool is left as found. */
+static U4 u4_test_freePayloads(void)
+{
+  FSM_PAYLOAD pld_ta_taken[FSM_PAYLOAD_COUNT];
+  U4 u4_t_numFree;
+  U4 u4_t_idx;
+
+  u4_t_numFree = 0;
+
+  while((u4_t_numFree < FSM_PAYLOAD_COUNT) && ((pld_ta_taken[u4_t_numFree] = pld_fsm_payloadAlloc()) != FSM_PAYLOAD_NONE))
+  {
+    u4_t_numFree++;
+  }
+
+  for(u4_t_idx = 0; u4_t_idx < u4_t_numFree; u4_t_idx++)
+  {
+    vd_fsm_payloadFree(pld_ta_taken[u4_t_idx]);
+  }
+
+  return (u4_t_numFree);
+}
+
+static void vd_test_collapse(void)
+{
+  U4 u4_t_idx;
+  U4 u4_t_numRegistered;
+
+  vd_test_reset();
+  u4_t_numRegistered = 0;
+
+  for(u4_t_idx = 0; u4_t_idx < 100; u4_t_idx++)
+  {
+    u4_t_numRegistered += (u1_fsm_registerEvt(FSM_EVT_COL) == FSM_EVT_REGISTERED) ? 1 : 0;
+  }
+
+  /* Every collapsed event counts as registered but takes no slot. */
+  TEST_CHECK(u4_t_numRegistered == 100);
+  TEST_CHECK(u4_fsm_evtQueueDepth(FSM_INST_DEFAULT) == 1);
+
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_entries == 1);
+  TEST_CHECK(u4_s_count == 1);
+
+  /* Once served, the next one is queued again. */
+  vd_test_clear();
+  (void)u1_fsm_registerEvt(FSM_EVT_COL);
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_entries == 1);
+}
+
+static void vd_test_latest(void)
+{
+  int s4_t_value;
+  U4 u4_t_numRegistered;
+
+  vd_test_reset();
+  u4_t_numRegistered = 0;
+
+  /* More events than buffers, superseded payloads go back at once. */
+  for(s4_t_value = 1; s4_t_value <= (2 * FSM_PAYLOAD_COUNT); s4_t_value++)
+  {
+    u4_t_numRegistered += (u1_test_registerValue(FSM_INST_DEFAULT, FSM_EVT_LAT, s4_t_value) == FSM_EVT_REGISTERED) ? 1 : 0;
+  }
+
+  TEST_CHECK(u4_t_numRegistered == (2 * FSM_PAYLOAD_COUNT));
+  TEST_CHECK(u4_fsm_evtQueueDepth(FSM_INST_DEFAULT) == 1);
+  TEST_CHECK(u4_test_freePayloads() == (FSM_PAYLOAD_COUNT - 1));
+
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_entries == 1);
+  TEST_CHECK(s4_s_payloadValue == (2 * FSM_PAYLOAD_COUNT));
+  TEST_CHECK(u4_test_freePayloads() == FSM_PAYLOAD_COUNT);
+}
+
+static void vd_test_count(void)
+{
+  U4 u4_t_idx;
+
+  vd_test_reset();
+
+  for(u4_t_idx = 0; u4_t_idx < 100; u4_t_idx++)
+  {
+    (void)u1_fsm_registerEvt(FSM_EVT_CNT);
+  }
+
+  TEST_CHECK(u4_fsm_evtQueueDepth(FSM_INST_DEFAULT) == 1);
+
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_entries == 1);
+  TEST_CHECK(u4_s_count == 100);
+
+  /* Events after a plain one still merge into the first counted one, the
+     plain event counts 1. */
+  vd_test_clear();
+
+  for(u4_t_idx = 0; u4_t_idx < 5; u4_t_idx++)
+  {
+    (void)u1_fsm_registerEvt(FSM_EVT_CNT);
+  }
+
+  (void)u1_fsm_registerEvt(FSM_EVT_PLAIN);
+
+  for(u4_t_idx = 0; u4_t_idx < 3; u4_t_idx++)
+  {
+    (void)u1_fsm_registerEvt(FSM_EVT_CNT);
+  }
+
+  TEST_CHECK(u4_fsm_evtQueueDepth(FSM_INST_DEFAULT) == 2);
+
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_entries == 2);
+  TEST_CHECK(u4_s_count == 9);
+
+  /* The count starts over once served. */
+  vd_test_clear();
+  (void)u1_fsm_registerEvt(FSM_EVT_CNT);
+  (void)u1_fsm_serveEvtQueue();
+  TEST_CHECK(u4_s_count == 1);
+}
+
+static void vd_test_snapshot(const char* path)
+{
+  FSM_INST inst_t_first;
+  FSM_INST inst_t_second;
+
+  vd_test_reset();
+
+  inst_t_first  = inst_fsm_create();
+  inst_t_second = inst_fsm_create();
+
+  (void)u1_fsm_instRegisterEvt(inst_t_first, FSM_EVT_GO);
+  (void)u1_fsm_instServeEvtQueue(inst_t_first);
+
+  /* Left queued: plain events, a latest event whose first payload was
+     replaced and counted events. */
+  (void)u1_fsm_instRegisterEvt(FSM_INST_DEFAULT, FSM_EVT_GO);
+  (void)u1_fsm_instRegisterEvt(FSM_INST_DEFAULT, FSM_EVT_DONE);
+  (void)u1_fsm_instRegisterEvt(inst_t_first, FSM_EVT_DONE);
+  (void)u1_test_registerValue(inst_t_second, FSM_EVT_LAT, 7);
+  (void)u1_test_registerValue(inst_t_second, FSM_EVT_LAT, 9);
+  (void)u1_fsm_instRegisterEvt(inst_t_second, FSM_EVT_CNT);
+  (void)u1_fsm_instRegisterEvt(inst_t_second, FSM_EVT_CNT);
+
+  TEST_CHECK(u1_fsm_snapshotSave(path) == FSM_SNAPSHOT_OK);
+
+  /* Start from scratch and restore. */
+  vd_test_reset();
+
+  TEST_CHECK(u1_fsm_snapshotRestore(path) == FSM_SNAPSHOT_OK);
+  TEST_CHECK(u4_s_entries == 0);
+  TEST_CHECK(state_fsm_instGetCurrentState(FSM_INST_DEFAULT) == FSM_STATE_IDLE);
+  TEST_CHECK(state_fsm_instGetCurrentState(inst_t_first) == FSM_STATE_BUSY);
+  TEST_CHECK(state_fsm_instGetCurrentState(inst_t_second) == FSM_STATE_IDLE);
+  TEST_CHECK(u4_fsm_evtQueueDepth(FSM_INST_DEFAULT) == 2);
+  TEST_CHECK(u4_fsm_evtQueueDepth(inst_t_first) == 1);
+  TEST_CHECK(u4_fsm_evtQueueDepth(inst_t_second) == 2);
+
+  /* The instance pool comes back too. */
+  TEST_CHECK(inst_fsm_create() == (inst_t_second + 1));
+  vd_fsm_destroy(inst_t_second + 1);
+
+  (void)u1_fsm_instServeEvtQueue(FSM_INST_DEFAULT);
+  TEST_CHECK(u4_s_entries == 2);
+  TEST_CHECK(state_fsm_instGetCurrentState(FSM_INST_DEFAULT) == FSM_STATE_IDLE);
+
+  (void)u1_fsm_instServeEvtQueue(inst_t_first);
+  TEST_CHECK(state_fsm_instGetCurrentState(inst_t_first) == FSM_STATE_IDLE);
+
+  /* Latest comes back with the newest payload, counted with a count of 1. */
+  vd_test_clear();
+  (void)u1_fsm_instServeEvtQueue(inst_t_second);
+  TEST_CHECK(u4_s_entries == 2);
+  TEST_CHECK(s4_s_payloadValue == 9);
+  TEST_CHECK(u4_s_count == 2);
+  TEST_CHECK(u4_test_freePayloads() == FSM_PAYLOAD_COUNT);
+
+  /* Image for vd_test_snapshotReject(), taken with nothing queued. */
+  (void)u1_fsm_instRegisterEvt(inst_t_first, FSM_EVT_GO);
+  (void)u1_fsm_instServeEvtQueue(inst_t_first);
+  TEST_CHECK(u1_fsm_snapshotSave(path) == FSM_SNAPSHOT_OK);
+}
+
+static void vd_test_snapshotReject(const char* path)
+{
+  FILE* fp_t_file;
+  U1 u1_t_byte;
+
+  /* An image of another table is rejected and changes nothing. Flip a
+     byte of the table fingerprint at offset 8 and queue an event that a
+     restore would drop. */
+  (void)u1_fsm_instRegisterEvt(1, FSM_EVT_DONE);
+
+  fp_t_file = fopen(path, "r+b");
+  TEST_CHECK(fp_t_file != NULL);
+
+  if(fp_t_file != NULL)
+  {
+    (void)fseek(fp_t_file, 8, SEEK_SET);
+    u1_t_byte = (U1)fgetc(fp_t_file);
+    (void)fseek(fp_t_file, 8, SEEK_SET);
+    (void)fputc(u1_t_byte ^ 0xFFu, fp_t_file);
+    (void)fclose(fp_t_file);
+
+    TEST_CHECK(u1_fsm_snapshotRestore(path) == FSM_SNAPSHOT_TABLE_MISMATCH);
+    TEST_CHECK(state_fsm_instGetCurrentState(1) == FSM_STATE_BUSY);
+    TEST_CHECK(u4_fsm_evtQueueDepth(1) == 1);
+  }
+  else
+  {
+
+  }
+}
+
+/*************************************************************************/
+/*  Main                                                                 */
+/*************************************************************************/
+int main(int argc, char** argv)
+{
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s <snapshot file>\n", argv[0]);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  vd_test_collapse();
+  vd_test_latest();
+  vd_test_count();
+  vd_test_snapshot(argv[1]);
+  vd_test_snapshotReject(argv[1]);
+
+  printf("fsm_test: %d checks, %d failed\n", u4_s_numChecks, u4_s_numFailed);
+
+  return ((u4_s_numFailed == 0) ? 0 : 1);
+}
@@ -0,0 +1,79 @@
+#!/usr/bin/env python3
+"""Test driver for the FSM module.
+
+For every table format this script runs Tools/fsm_gen.py on
+Test/fsm_test.fsm with the policies in Test/fsm_test.coalesce, builds the
+module with FSM_CFG_PAYLOAD, FSM_CFG_COALESCE and FSM_CFG_SNAPSHOT together
+with Test/fsm_test.c in a scratch directory and runs the result. Exits with
+1 if any build fails a check.
+
+Example::
+
+    python3 Test/fsm_test.py --formats dense,sparse,switch
+"""
+
+import argparse
+import glob
+import os
+import shutil
+import subprocess
+import sys
+import tempfile
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+CONFIG = ["-DFSM_CFG_PAYLOAD", "-DFSM_CFG_COALESCE", "-DFSM_CFG_SNAPSHOT", "-DFSM_NUM_INSTANCES=4"]
+
+
+def csv_list(kind):
+    return lambda text: [kind(x) for x in text.split(",") if x]
+
+
+def build(workdir, fmt, cc, cflags):
+    """Generate the table and compile the test, return binary path."""
+    for path in glob.glob(os.path.join(ROOT, "Header", "*.h")) + glob.glob(os.path.join(ROOT, "Stub", "*")):
+        if os.path.basename(path) != "fsm_table.h":
+            shutil.copy(path, workdir)
+    subprocess.check_call([sys.executable, os.path.join(ROOT, "Tools", "fsm_gen.py"),
+                           os.path.join(ROOT, "Test", "fsm_test.fsm"), "--format", fmt,
+                           "--coalesce", os.path.join(ROOT, "Test", "fsm_test.coalesce"),
+                           "--header", os.path.join(workdir, "fsm_table.h"),
+                           "--source", os.path.join(workdir, "fsm_table.c")],
+                          stdout=subprocess.DEVNULL)
+    sources = [os.path.join(ROOT, "Source", f) for f in ("fsm.c", "fsm_payload.c", "fsm_coalesce.c",
+                                                         "fsm_snapshot.c")]
+    binary = os.path.join(workdir, "fsm_test")
+    cmd = [cc] + cflags + ["-std=c11", "-pthread", "-I" + workdir] + CONFIG + ["-o", binary] + sources + \
+        [os.path.join(workdir, "fsm_table.c"), os.path.join(workdir, "fsm_stub.c"),
+         os.path.join(ROOT, "Test", "fsm_test.c")]
+    subprocess.check_call(cmd)
+    return binary
+
+
+def main(argv=None):
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("--formats", type=csv_list(str), default=["dense", "sparse", "switch"])
+    ap.add_argument("--cc", default=os.environ.get("CC", "cc"))
+    ap.add_argument("--cflags", default="-O2", help="compiler flags, space separated")
+    args = ap.parse_args(argv)
+
+    failed = []
+    workroot = tempfile.mkdtemp(prefix="fsm_test_")
+    try:
+        for fmt in args.formats:
+            workdir = tempfile.mkdtemp(dir=workroot)
+            binary = build(workdir, fmt, args.cc, args.cflags.split())
+            sys.stdout.write("%s: " % fmt)
+            sys.stdout.flush()
+            if subprocess.call([binary, os.path.join(workdir, "fsm_test.snapshot")]) != 0:
+                failed.append(fmt)
+    finally:
+        shutil.rmtree(workroot, ignore_errors=True)
+
+    if failed:
+        sys.stderr.write("fsm_test: failed for %s\n" % ", ".join(failed))
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,766 @@
+#!/usr/bin/env python3
+"""State table generator for the FSM module.
+
+Reads a deterministic automaton in the UMDES/DESUMA ``.fsm`` text format and
+writes the auto-generated files used by ``Source/fsm.c``:
+
+* ``Header/fsm_table.h``: ``FSM_EVT``/``FSM_STATE`` enums, table dimensions,
+  initial state and the selected ``FSM_TABLE_FORMAT``.
+* ``Source/fsm_table.c``: ``fsm_sas_fsmTable``, the per-state timeouts
+  ``fsm_sas_fsmTimeout`` (used with ``FSM_CFG_TIMER``), the exit/entry
+  chains ``fsm_sas_fsmChain`` (used with ``FSM_CFG_HIERARCHY``), the event
+  priorities ``fsm_sa_evtPriority`` (used with ``FSM_CFG_PRIORITY``), the
+  per-state defer sets ``fsm_sa_fsmDeferSet`` (used with ``FSM_CFG_DEFER``),
+  the event coalescing policies ``fsm_sa_evtCoalesce`` (used with
+  ``FSM_CFG_COALESCE``), the accepted event bitsets of every state (used
+  with ``FSM_CFG_FILTER``) and, for
+  ``FSM_TABLE_SWITCH``, the ``state_fsm_tableDispatch()`` function.
+
+Input format (first state listed is the initial state)::
+
+    <number of states>
+
+    <state> <marked 0/1> <number of transitions>
+    <event> <target state> [c|uc] [o|uo]
+    ...
+
+Columns after the target state (controllability, observability) are
+accepted and ignored. Lines starting with ``#`` are comments.
+
+State timeouts are read from a separate file given with ``--timeouts``, one
+``<state> <ticks> <event>`` line per state that has one. The event is
+registered for an instance that stays ``<ticks>`` ticks in the state.
+
+Event priorities are read from a file given with ``--priorities``, one
+``<event> <priority>`` line per event, 0 (the default) to 31. Events with a
+higher priority are served first.
+
+Deferred events are read from a file given with ``--defer``, one
+``<state> <event> [<event> ...]`` line per state. An event that the state
+has no transition for and defers is parked and replayed after the next
+state change.
+
+Event coalescing is read from a file given with ``--coalesce``, one
+``<event> collapse|latest|count`` line per event. An event registered while
+the same event is still queued for the instance is merged into it:
+``collapse`` drops the new one, ``latest`` keeps the queued one with the
+newest payload and ``count`` keeps the queued one and counts the merged
+events.
+
+Nested states are read from a separate file given with ``--hierarchy``, one
+``<state> <parent>`` line per nested state. The first child listed is the
+initial child of its parent. A state inherits every transition of its
+ancestors that it does not define itself, and all events they defer, and a
+transition into a parent
+enters its initial child, down to a leaf. A leaf without a timeout of its
+own takes the timeout of its nearest ancestor that has one; it restarts on
+each leaf entered. Only leaves are ever current;
+parent rows are left empty and parents exist for their entry/exit
+callbacks. The hierarchy is flattened here: every transition gets the list
+of states it exits (from the leaf up to the least common ancestor of the
+state defining the transition and its target) and the list it enters
+(down to the target leaf), so serving walks a precomputed list. A
+transition between a state and one of its ancestors exits and re-enters
+the ancestor. ``--hierarchy`` implies ``--no-minimize``.
+
+Before emitting, unreachable states are dropped and equivalent states are
+merged (same marking, timeout and defer set and, per event, transitions into
+the same class).
+Merged states keep their enumerator as an alias of the state they were
+merged into. Use ``--no-minimize`` when states carry different entry/exit
+callbacks that must stay distinct.
+"""
+
+import argparse
+import os
+import re
+import sys
+from collections import deque
+
+FORMAT_DENSE = "dense"
+FORMAT_SPARSE = "sparse"
+FORMAT_SWITCH = "switch"
+
+FORMAT_MACRO = {
+    FORMAT_DENSE: "FSM_TABLE_DENSE",
+    FORMAT_SPARSE: "FSM_TABLE_SPARSE",
+    FORMAT_SWITCH: "FSM_TABLE_SWITCH",
+}
+
+RULE = "/" + "*" * 73 + "/"
+
+# Deepest nesting, entries of a chain are flagged in a 32-bit mask.
+MAX_DEPTH = 32
+
+# Priority levels, the queue keeps one ready bit per level in 32 bits.
+MAX_PRIORITIES = 32
+
+# Coalescing policies, in FSM_COALESCE_* order.
+COALESCE_POLICIES = ["none", "collapse", "latest", "count"]
+COALESCE_MACRO = ["FSM_COALESCE_NONE", "FSM_COALESCE_COLLAPSE", "FSM_COALESCE_LATEST", "FSM_COALESCE_COUNT"]
+
+
+class FsmGenError(Exception):
+    """Raised for malformed or unsupported automata."""
+
+
+class Automaton(object):
+    """Deterministic automaton, states and events referenced by index."""
+
+    def __init__(self, states, events, marked, trans):
+        self.states = states      # state names, index 0 is initial
+        self.events = events      # event names
+        self.marked = marked      # list of bool per state
+        self.trans = trans        # list of {event index: target index}
+        self.aliases = {}         # merged state name -> representative name
+        self.removed = []         # unreachable state names
+        self.timeouts = [None] * len(states)  # (ticks, event index) per state
+        self.priority = [0] * len(events)     # queue priority per event
+        self.coalesce = [0] * len(events)     # coalescing policy per event
+        self.defer = [frozenset() for _ in states]  # deferred event indices
+        self.parent = [None] * len(states)    # parent index per state
+        self.children = [[] for _ in states]  # child indices, initial first
+        self.via = [{} for _ in states]       # event -> (declaring state, target)
+        self.chains = []                      # (exits, entries) per chain
+        self.chain = [{} for _ in states]     # event -> chain index per state
+
+    @property
+    def nnz(self):
+        return sum(len(row) for row in self.trans)
+
+    @property
+    def density(self):
+        cells = len(self.states) * len(self.events)
+        return float(self.nnz) / cells if cells else 0.0
+
+
+def natural_key(name):
+    """Sort key ordering embedded numbers numerically (E2 before E10)."""
+    return [int(p) if p.isdigit() else p for p in re.split(r"(\d+)", name)]
+
+
+def c_name(prefix, name):
+    ident = re.sub(r"\W", "_", name).upper()
+    return prefix + ident
+
+
+def parse_fsm(path):
+    """Parse a UMDES .fsm file into an Automaton."""
+    with open(path) as f:
+        lines = [ln.split("#", 1)[0].split() for ln in f]
+    lines = [ln for ln in lines if ln]
+    if not lines:
+        raise FsmGenError("%s: empty file" % path)
+
+    pos = 0
+    num_states = int(lines[pos][0])
+    pos += 1
+    blocks = []
+    for _ in range(num_states):
+        if pos >= len(lines) or len(lines[pos]) < 3:
+            raise FsmGenError("%s: expected '<state> <marked> <count>'" % path)
+        name, marked, count = lines[pos][0], lines[pos][1], int(lines[pos][2])
+        pos += 1
+        edges = []
+        for _ in range(count):
+            if pos >= len(lines) or len(lines[pos]) < 2:
+                raise FsmGenError("%s: state %s: expected '<event> <target>'" % (path, name))
+            edges.append((lines[pos][0], lines[pos][1]))
+            pos += 1
+        blocks.append((name, marked == "1", edges))
+
+    states = [b[0] for b in blocks]
+    index = {}
+    for i, name in enumerate(states):
+        if name in index:
+            raise FsmGenError("%s: state %s listed twice" % (path, name))
+        index[name] = i
+
+    events = sorted({e for b in blocks for e, _ in b[2]}, key=natural_key)
+    evt_index = {e: i for i, e in enumerate(events)}
+
+    trans = []
+    for name, _, edges in blocks:
+        row = {}
+        for evt, target in edges:
+            if target not in index:
+                raise FsmGenError("%s: state %s: unknown target %s" % (path, name, target))
+            if evt_index[evt] in row and row[evt_index[evt]] != index[target]:
+                raise FsmGenError("%s: state %s: event %s is nondeterministic" % (path, name, evt))
+            row[evt_index[evt]] = index[target]
+        trans.append(row)
+
+    return Automaton(states, events, [b[1] for b in blocks], trans)
+
+
+def parse_timeouts(path, fsm):
+    """Read ``<state> <ticks> <event>`` lines into fsm.timeouts."""
+    index = {name: i for i, name in enumerate(fsm.states)}
+    evt_index = {e: i for i, e in enumerate(fsm.events)}
+    with open(path) as f:
+        for num, ln in enumerate(f, 1):
+            fields = ln.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 3:
+                raise FsmGenError("%s:%d: expected '<state> <ticks> <event>'" % (path, num))
+            state, ticks, evt = fields[0], int(fields[1]), fields[2]
+            if state not in index:
+                raise FsmGenError("%s:%d: unknown state %s" % (path, num, state))
+            if evt not in evt_index:
+                raise FsmGenError("%s:%d: unknown event %s" % (path, num, evt))
+            if ticks <= 0 or ticks > 0x7FFFFFFF:
+                raise FsmGenError("%s:%d: ticks must be 1..2^31-1" % (path, num))
+            fsm.timeouts[index[state]] = (ticks, evt_index[evt])
+
+
+def parse_priorities(path, fsm):
+    """Read ``<event> <priority>`` lines into fsm.priority."""
+    evt_index = {e: i for i, e in enumerate(fsm.events)}
+    with open(path) as f:
+        for num, ln in enumerate(f, 1):
+            fields = ln.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 2:
+                raise FsmGenError("%s:%d: expected '<event> <priority>'" % (path, num))
+            if fields[0] not in evt_index:
+                raise FsmGenError("%s:%d: unknown event %s" % (path, num, fields[0]))
+            prio = int(fields[1])
+            if prio < 0 or prio >= MAX_PRIORITIES:
+                raise FsmGenError("%s:%d: priority must be 0..%d" % (path, num, MAX_PRIORITIES - 1))
+            fsm.priority[evt_index[fields[0]]] = prio
+
+
+def parse_coalesce(path, fsm):
+    """Read ``<event> <policy>`` lines into fsm.coalesce."""
+    evt_index = {e: i for i, e in enumerate(fsm.events)}
+    with open(path) as f:
+        for num, ln in enumerate(f, 1):
+            fields = ln.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 2:
+                raise FsmGenError("%s:%d: expected '<event> collapse|latest|count'" % (path, num))
+            if fields[0] not in evt_index:
+                raise FsmGenError("%s:%d: unknown event %s" % (path, num, fields[0]))
+            if fields[1] not in COALESCE_POLICIES:
+                raise FsmGenError("%s:%d: policy must be one of %s" % (path, num, ", ".join(COALESCE_POLICIES)))
+            fsm.coalesce[evt_index[fields[0]]] = COALESCE_POLICIES.index(fields[1])
+
+
+def parse_defer(path, fsm):
+    """Read ``<state> <event> [<event> ...]`` lines into fsm.defer."""
+    index = {name: i for i, name in enumerate(fsm.states)}
+    evt_index = {e: i for i, e in enumerate(fsm.events)}
+    with open(path) as f:
+        for num, ln in enumerate(f, 1):
+            fields = ln.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) < 2:
+                raise FsmGenError("%s:%d: expected '<state> <event> [<event> ...]'" % (path, num))
+            if fields[0] not in index:
+                raise FsmGenError("%s:%d: unknown state %s" % (path, num, fields[0]))
+            for evt in fields[1:]:
+                if evt not in evt_index:
+                    raise FsmGenError("%s:%d: unknown event %s" % (path, num, evt))
+            s = index[fields[0]]
+            fsm.defer[s] = fsm.defer[s] | frozenset(evt_index[e] for e in fields[1:])
+
+
+def parse_hierarchy(path, fsm):
+    """Read ``<state> <parent>`` lines into fsm.parent/fsm.children."""
+    index = {name: i for i, name in enumerate(fsm.states)}
+    with open(path) as f:
+        for num, ln in enumerate(f, 1):
+            fields = ln.split("#", 1)[0].split()
+            if not fields:
+                continue
+            if len(fields) != 2:
+                raise FsmGenError("%s:%d: expected '<state> <parent>'" % (path, num))
+            for name in fields:
+                if name not in index:
+                    raise FsmGenError("%s:%d: unknown state %s" % (path, num, name))
+            child, parent = index[fields[0]], index[fields[1]]
+            if fsm.parent[child] is not None:
+                raise FsmGenError("%s:%d: state %s has two parents" % (path, num, fields[0]))
+            fsm.parent[child] = parent
+            fsm.children[parent].append(child)
+    for s in range(len(fsm.states)):
+        if len(ancestors(fsm, s)) > MAX_DEPTH:
+            raise FsmGenError("%s: state %s nested deeper than %d or in a cycle"
+                              % (path, fsm.states[s], MAX_DEPTH))
+
+
+def ancestors(fsm, s):
+    """s and its ancestors, innermost first. Stops on cycles."""
+    out = [s]
+    while fsm.parent[out[-1]] is not None and len(out) <= MAX_DEPTH:
+        out.append(fsm.parent[out[-1]])
+    return out
+
+
+def initial_leaf(fsm, s):
+    while fsm.children[s]:
+        s = fsm.children[s][0]
+    return s
+
+
+def flatten(fsm):
+    """Give every leaf the transitions, defer set and timeout it inherits,
+    targets resolved to leaves. Parent rows are emptied."""
+    trans = []
+    defer = []
+    timeouts = []
+    for s in range(len(fsm.states)):
+        row = {}
+        deferred = frozenset()
+        timeout = None
+        if not fsm.children[s]:
+            for a in reversed(ancestors(fsm, s)):
+                for e, t in fsm.trans[a].items():
+                    row[e] = initial_leaf(fsm, t)
+                    fsm.via[s][e] = (a, t)
+                deferred |= fsm.defer[a]
+                timeout = fsm.timeouts[a] or timeout
+        trans.append(row)
+        defer.append(deferred)
+        timeouts.append(timeout)
+    fsm.trans = trans
+    fsm.defer = defer
+    fsm.timeouts = timeouts
+
+
+def build_chains(fsm):
+    """Precompute the exit/entry chain of every transition."""
+    index = {}
+    for s in range(len(fsm.states)):
+        for e in sorted(fsm.trans[s]):
+            target = fsm.trans[s][e]
+            src, decl = fsm.via[s].get(e, (s, target))
+            up_src, up_decl = ancestors(fsm, src), ancestors(fsm, decl)
+            if decl in up_src:
+                lca = fsm.parent[decl]
+            elif src in up_decl:
+                lca = fsm.parent[src]
+            else:
+                lca = next((a for a in up_src if a in up_decl), None)
+            exits = []
+            for a in ancestors(fsm, s):
+                if a == lca:
+                    break
+                exits.append(a)
+            entries = []
+            for a in ancestors(fsm, target):
+                if a == lca:
+                    break
+                entries.insert(0, a)
+            key = (tuple(exits), tuple(entries))
+            if key not in index:
+                index[key] = len(fsm.chains)
+                fsm.chains.append(key)
+            fsm.chain[s][e] = index[key]
+
+
+def minimize(fsm):
+    """Drop unreachable states and merge equivalent ones (Moore refinement).
+
+    The result is renumbered in breadth-first order from the initial state
+    so the initial state stays at index 0.
+    """
+    order = []
+    seen = {0}
+    todo = deque([0])
+    while todo:
+        s = todo.popleft()
+        order.append(s)
+        for e in sorted(fsm.trans[s]):
+            t = fsm.trans[s][e]
+            if t not in seen:
+                seen.add(t)
+                todo.append(t)
+    removed = [fsm.states[s] for s in range(len(fsm.states)) if s not in seen]
+
+    # Partition refinement over reachable states.
+    initial = {}
+    block = {s: initial.setdefault((fsm.marked[s], fsm.timeouts[s], fsm.defer[s]),
+                                              len(initial)) for s in order}
+    while True:
+        sigs = {}
+        new_block = {}
+        for s in order:
+            row = fsm.trans[s]
+            sig = (block[s],) + tuple(block[row[e]] if e in row else -1
+                                      for e in range(len(fsm.events)))
+            new_block[s] = sigs.setdefault(sig, len(sigs))
+        stable = len(sigs) == len(set(block.values()))
+        block = new_block
+        if stable:
+            break
+
+    # Representative of each block is its first state in BFS order.
+    rep_of_block = {}
+    for s in order:
+        rep_of_block.setdefault(block[s], s)
+    reps = [s for s in order if rep_of_block[block[s]] == s]
+    new_index = {s: i for i, s in enumerate(reps)}
+
+    states = [fsm.states[s] for s in reps]
+    marked = [fsm.marked[s] for s in reps]
+    trans = []
+    for s in reps:
+        row = fsm.trans[s]
+        trans.append({e: new_index[rep_of_block[block[t]]] for e, t in row.items()})
+
+    out = Automaton(states, fsm.events, marked, trans)
+    out.timeouts = [fsm.timeouts[s] for s in reps]
+    out.priority = fsm.priority
+    out.coalesce = fsm.coalesce
+    out.defer = [fsm.defer[s] for s in reps]
+    out.removed = removed
+    for s in order:
+        r = rep_of_block[block[s]]
+        if r != s:
+            out.aliases[fsm.states[s]] = fsm.states[r]
+    return out
+
+
+def choose_format(fsm, requested, dense_threshold, switch_limit):
+    if requested != "auto":
+        return requested
+    if fsm.density >= dense_threshold:
+        return FORMAT_DENSE
+    if fsm.nnz <= switch_limit:
+        return FORMAT_SWITCH
+    return FORMAT_SPARSE
+
+
+def box(lines):
+    """Comment box in the style of the FSM sources, 75 columns wide."""
+    out = [RULE]
+    for ln in lines:
+        out.append(("/*  " + ln).ljust(73) + "*/")
+    out.append(RULE)
+    return out
+
+
+def emit_header(fsm, fmt, src_name):
+    state_names = [c_name("FSM_STATE_", s) for s in fsm.states]
+    evt_names = [c_name("FSM_EVT_", e) for e in fsm.events]
+
+    out = box(["File Name: fsm_table.h",
+               "Purpose: Auto-generated state table, do not modify.",
+               "         Generated by Tools/fsm_gen.py from",
+               "         " + src_name + "."])
+    out += ["",
+            "#ifndef fsm_table_h",
+            "#define fsm_table_h",
+            "",
+            "/* State table dimensions, must match the enums below. FSM_TABLE_NNZ is",
+            "   the number of transitions that are not FSM_EVT_INACTIVE. */",
+            "#define FSM_STATE_COUNT                  %d" % len(state_names),
+            "#define FSM_EVT_COUNT                    %d" % len(evt_names),
+            "#define FSM_TABLE_NNZ                    %d" % fsm.nnz,
+            "",
+            "/* Exit/entry chains of all transitions, FSM_CHAIN_LENGTH states in",
+            "   total. */",
+            "#define FSM_CHAIN_COUNT                  %d" % max(len(fsm.chains), 1),
+            "#define FSM_CHAIN_LENGTH                 %d" % max(chain_length(fsm), 1),
+            "",
+            "/* Event priority levels, 0 is served last. */",
+            "#define FSM_EVT_PRIORITY_COUNT           %d" % (max(fsm.priority or [0]) + 1),
+            "",
+            "/* Events coalesced as latest or count, one slot each per instance. */",
+            "#define FSM_COALESCE_SLOT_COUNT          %d" % sum(1 for c in fsm.coalesce if c >= 2),
+            "",
+            "/* Density %.3f */" % fsm.density,
+            "#define FSM_TABLE_FORMAT                 %s" % FORMAT_MACRO[fmt],
+            "",
+            "typedef enum FSM_EVT",
+            "{"]
+    for i, name in enumerate(evt_names):
+        out.append("  %s%s," % (name, " = 0" if i == 0 else ""))
+    out += ["",
+            "  FSM_NUM_EVENTS,",
+            "  FSM_EVT_INACTIVE,",
+            "  FSM_EVT_NULL",
+            "}",
+            "FSM_EVT;",
+            "",
+            "typedef enum FSM_STATE",
+            "{"]
+    for i, name in enumerate(state_names):
+        out.append("  %s%s," % (name, " = 0" if i == 0 else ""))
+    out += ["",
+            "  FSM_NUM_STATES",
+            "}",
+            "FSM_STATE;",
+            "",
+            "#define FSM_STATE_INITIAL                %s" % state_names[initial_leaf(fsm, 0)]]
+    parents = [fsm.states[s] for s in range(len(fsm.states)) if fsm.children[s]]
+    if parents:
+        out += ["", "/* Parent states, never current: %s */" % ", ".join(parents)]
+    if fsm.aliases:
+        out += ["", "/* Equivalent states merged by minimization. */"]
+        for name in sorted(fsm.aliases, key=natural_key):
+            out.append("#define %s %s" % (c_name("FSM_STATE_", name).ljust(32),
+                                          c_name("FSM_STATE_", fsm.aliases[name])))
+    if fsm.removed:
+        out += ["", "/* Unreachable states removed: %s */" % ", ".join(fsm.removed)]
+    out += ["", "#endif", ""]
+    return out
+
+
+def chain_length(fsm):
+    return sum(len(x) + len(n) for x, n in fsm.chains)
+
+
+def emit_marked(fsm):
+    return emit_bitset(len(fsm.states), [s for s, m in enumerate(fsm.marked) if m])
+
+
+def emit_bitset(length, members, indent="    "):
+    data = [0] * ((length + 7) // 8)
+    for i in members:
+        data[i >> 3] |= 1 << (i & 7)
+    return wrap_list(["0x%02X" % b for b in data], indent=indent)
+
+
+def wrap_list(items, indent="    ", width=72):
+    lines = []
+    cur = ""
+    for i, item in enumerate(items):
+        tok = item + ("," if i + 1 < len(items) else "")
+        if cur and len(indent) + len(cur) + 1 + len(tok) > width:
+            lines.append(indent + cur)
+            cur = tok
+        else:
+            cur = (cur + " " + tok) if cur else tok
+    if cur:
+        lines.append(indent + cur)
+    return lines
+
+
+def emit_source(fsm, fmt, src_name):
+    state_names = [c_name("FSM_STATE_", s) for s in fsm.states]
+    evt_names = [c_name("FSM_EVT_", e) for e in fsm.events]
+    inactive = "FSM_STATE_IDX_INACTIVE"
+
+    out = box(["File Name: fsm_table.c",
+               "Purpose: Auto-generated state table, do not modify.",
+               "         Generated by Tools/fsm_gen.py from",
+               "         " + src_name + "."])
+    out += ["",
+            RULE,
+            "/*  Includes                                                             */",
+            RULE,
+            '#include "fsm.h"',
+            "",
+            RULE,
+            "/*  Static Global Variables, Constants                                   */",
+            RULE,
+            "const FSMTable fsm_sas_fsmTable =",
+            "{"]
+
+    if fmt == FORMAT_DENSE:
+        out.append("  {")
+        for s, name in enumerate(state_names):
+            row = [state_names[fsm.trans[s][e]] if e in fsm.trans[s] else inactive
+                   for e in range(len(evt_names))]
+            out.append("    /* %s */" % name)
+            out.append("    {")
+            out += wrap_list(row, indent="      ")
+            out.append("    }" + ("," if s + 1 < len(state_names) else ""))
+        out.append("  },")
+        out += ["#ifdef FSM_CFG_HIERARCHY", "  /* Chain */", "  {"]
+        for s, name in enumerate(state_names):
+            row = [str(fsm.chain[s].get(e, 0)) for e in range(len(evt_names))]
+            out.append("    {")
+            out += wrap_list(row, indent="      ")
+            out.append("    }" + ("," if s + 1 < len(state_names) else ""))
+        out += ["  },", "#endif"]
+    elif fmt == FORMAT_SPARSE:
+        row_start = [0]
+        evts = []
+        nexts = []
+        chains = []
+        for s in range(len(state_names)):
+            for e in sorted(fsm.trans[s]):
+                evts.append(evt_names[e])
+                nexts.append(state_names[fsm.trans[s][e]])
+                chains.append(str(fsm.chain[s][e]))
+            row_start.append(len(evts))
+        out += ["  /* Row start */", "  {"] + wrap_list([str(r) for r in row_start]) + ["  },"]
+        out += ["  /* Event */", "  {"] + wrap_list(evts or ["0"]) + ["  },"]
+        out += ["  /* Next state */", "  {"] + wrap_list(nexts or ["0"]) + ["  },"]
+        out += ["#ifdef FSM_CFG_HIERARCHY", "  /* Chain */", "  {"] + wrap_list(chains or ["0"]) + \
+            ["  },", "#endif"]
+
+    out += ["  /* Marked states */", "  {"] + emit_marked(fsm) + ["  },"]
+    out += ["#ifdef FSM_CFG_FILTER", "  /* Accepted events per state */", "  {"]
+    for s, name in enumerate(state_names):
+        out.append("    /* %s */" % name)
+        out.append("    {")
+        out += emit_bitset(len(evt_names), sorted(fsm.trans[s]), indent="      ")
+        out.append("    }" + ("," if s + 1 < len(state_names) else ""))
+    out += ["  },", "  /* Events accepted by any state */", "  {"]
+    out += emit_bitset(len(evt_names), sorted(set(e for row in fsm.trans for e in row)))
+    out += ["  }", "#endif", "};"]
+
+    timeouts = ["{%d, %s}" % (t[0], evt_names[t[1]]) if t else "{0, FSM_EVT_NULL}"
+                for t in fsm.timeouts]
+    out += ["",
+            "#ifdef FSM_CFG_TIMER",
+            "/* Timeout per state in ticks and the event it registers, 0 for none. */",
+            "const FSMTimeout fsm_sas_fsmTimeout[FSM_STATE_COUNT] =",
+            "{"] + wrap_list(timeouts, indent="  ") + ["};", "#endif"]
+
+    out += ["",
+            "#ifdef FSM_CFG_PRIORITY",
+            "/* Queue priority per event, higher is served first. */",
+            "const U1 fsm_sa_evtPriority[FSM_EVT_COUNT] =",
+            "{"] + wrap_list([str(p) for p in fsm.priority], indent="  ") + ["};", "#endif"]
+
+    out += ["",
+            "#ifdef FSM_CFG_COALESCE",
+            "/* Coalescing policy per event. */",
+            "const U1 fsm_sa_evtCoalesce[FSM_EVT_COUNT] =",
+            "{"] + wrap_list([COALESCE_MACRO[c] for c in fsm.coalesce], indent="  ") + ["};", "#endif"]
+
+    out += ["",
+            "#ifdef FSM_CFG_DEFER",
+            "/* Events parked per state until the next state change, one bit per",
+            "   event. */",
+            "const U1 fsm_sa_fsmDeferSet[FSM_STATE_COUNT][FSM_EVT_SET_LENGTH] =",
+            "{"]
+    for s, name in enumerate(state_names):
+        out.append("  /* %s */" % name)
+        out.append("  {")
+        out += emit_bitset(len(evt_names), sorted(fsm.defer[s]))
+        out.append("  }" + ("," if s + 1 < len(state_names) else ""))
+    out += ["};", "#endif"]
+
+    chain_states = []
+    chain_recs = []
+    for exits, entries in fsm.chains:
+        mask = sum(1 << i for i, a in enumerate(entries) if a in exits)
+        chain_recs.append("{%d, %d, %d, 0x%08Xu}" % (len(chain_states), len(exits), len(entries), mask))
+        chain_states += [state_names[a] for a in exits + entries]
+    out += ["",
+            "#ifdef FSM_CFG_HIERARCHY",
+            "/* States exited then entered by each transition, see FSMChain. */",
+            "const FSM_STATE_IDX fsm_sa_fsmChainState[FSM_CHAIN_LENGTH] =",
+            "{"] + wrap_list(chain_states or ["0"], indent="  ") + ["};",
+            "",
+            "const FSMChain fsm_sas_fsmChain[FSM_CHAIN_COUNT] =",
+            "{"] + wrap_list(chain_recs or ["{0, 0, 0, 0x00000000u}"], indent="  ") + ["};",
+            "#endif"]
+
+    if fmt == FORMAT_SWITCH:
+        out += ["",
+                RULE,
+                "/*  Function Name: state_fsm_tableDispatch                               */",
+                "/*  Purpose:       Direct-dispatch lookup of the next state, and of the  */",
+                "/*                 chain with FSM_CFG_HIERARCHY.                         */",
+                "/*  Arguments:     FSM_STATE_IDX state:                                  */",
+                "/*                    Current state.                                     */",
+                "/*                 FSM_EVT evt:                                          */",
+                "/*                    Event, must be below FSM_NUM_EVENTS.               */",
+                "/*                 FSM_CHAIN_IDX* chain:                                 */",
+                "/*                    Chain of the transition, FSM_CFG_HIERARCHY only.   */",
+                "/*  Return:        FSM_STATE_IDX next state    OR                        */",
+                "/*                 FSM_STATE_IDX_INACTIVE                                */",
+                RULE,
+                "FSM_STATE_IDX state_fsm_tableDispatch(FSM_STATE_IDX state, FSM_EVT evt FSM_CHAIN_PARAM)",
+                "{",
+                "  FSM_STATE_IDX state_t_nextState;",
+                "",
+                "  state_t_nextState = FSM_STATE_IDX_INACTIVE;",
+                "",
+                "  switch(state)",
+                "  {"]
+        for s, name in enumerate(state_names):
+            row = fsm.trans[s]
+            if not row:
+                continue
+            out += ["    case %s:" % name,
+                    "      switch(evt)",
+                    "      {"]
+            for e in sorted(row):
+                out += ["        case %s:" % evt_names[e],
+                        "          state_t_nextState = %s;" % state_names[row[e]],
+                        "          FSM_CHAIN_SET(%d);" % fsm.chain[s][e],
+                        "          break;"]
+            out += ["        default:",
+                    "          break;",
+                    "      }",
+                    "      break;"]
+        out += ["    default:",
+                "      break;",
+                "  }",
+                "",
+                "  return (state_t_nextState);",
+                "}"]
+    out.append("")
+    return out
+
+
+def write_lines(path, lines):
+    # Sources in this repository use CRLF line endings.
+    with open(path, "w", newline="\r\n") as f:
+        f.write("\n".join(lines))
+
+
+def main(argv=None):
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+    ap = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    ap.add_argument("input", help="automaton in UMDES .fsm format")
+    ap.add_argument("--header", default=os.path.join(root, "Header", "fsm_table.h"))
+    ap.add_argument("--source", default=os.path.join(root, "Source", "fsm_table.c"))
+    ap.add_argument("--format", default="auto",
+                    choices=["auto", FORMAT_DENSE, FORMAT_SPARSE, FORMAT_SWITCH])
+    ap.add_argument("--dense-threshold", type=float, default=0.25,
+                    help="auto: use dense table at or above this density")
+    ap.add_argument("--switch-limit", type=int, default=256,
+                    help="auto: below dense threshold, use switch dispatch up to this many transitions")
+    ap.add_argument("--no-minimize", action="store_true",
+                    help="keep unreachable and equivalent states")
+    ap.add_argument("--timeouts", help="state timeouts, '<state> <ticks> <event>' per line")
+    ap.add_argument("--hierarchy", help="nested states, '<state> <parent>' per line")
+    ap.add_argument("--priorities", help="event priorities, '<event> <priority>' per line")
+    ap.add_argument("--coalesce", help="event coalescing, '<event> collapse|latest|count' per line")
+    ap.add_argument("--defer", help="deferred events, '<state> <event> [<event> ...]' per line")
+    args = ap.parse_args(argv)
+
+    try:
+        fsm = parse_fsm(args.input)
+        if args.timeouts:
+            parse_timeouts(args.timeouts, fsm)
+        if args.priorities:
+            parse_priorities(args.priorities, fsm)
+        if args.coalesce:
+            parse_coalesce(args.coalesce, fsm)
+        if args.defer:
+            parse_defer(args.defer, fsm)
+        if args.hierarchy:
+            parse_hierarchy(args.hierarchy, fsm)
+            flatten(fsm)
+        elif not args.no_minimize:
+            fsm = minimize(fsm)
+        build_chains(fsm)
+    except (FsmGenError, ValueError, IOError) as err:
+        sys.stderr.write("fsm_gen: %s\n" % err)
+        return 1
+
+    fmt = choose_format(fsm, args.format, args.dense_threshold, args.switch_limit)
+    src_name = os.path.basename(args.input)
+    write_lines(args.header, emit_header(fsm, fmt, src_name))
+    write_lines(args.source, emit_source(fsm, fmt, src_name))
+    sys.stdout.write("fsm_gen: %d states, %d events, %d transitions, %s\n"
+                     % (len(fsm.states), len(fsm.events), fsm.nnz, FORMAT_MACRO[fmt]))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
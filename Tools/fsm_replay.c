@@ -0,0 +1,312 @@
+/*************************************************************************/
+/*  File Name: fsm_replay.c                                              */
+/*  Purpose: Offline check of a trace file written with FSM_CFG_TRACE.   */
+/*           Streams the records through the state table of this build   */
+/*           and reports every record whose transition differs           */
+/*           (divergence) and every instance whose record does not start */
+/*           in the state the previous one left it in (discontinuity,    */
+/*           from dropped records or an instance served by several       */
+/*           threads). Build against the same fsm_table.c as the         */
+/*           recording, or a newer one for a regression check:           */
+/*                                                                       */
+/*           cc -O2 -std=c11 -IHeader -IStub Tools/fsm_replay.c          */
+/*              Source/fsm.c Source/fsm_table.c Stub/fsm_stub.c          */
+/*                                                                       */
+/*           fsm_replay <trace file> [max reports]                       */
+/*           Exit status 0 if every transition matches, 1 on a           */
+/*           divergence, 2 if the file cannot be used.                   */
+/*************************************************************************/
+
+/*************************************************************************/
+/*  Includes                                                             */
+/*************************************************************************/
+#define _POSIX_C_SOURCE 200809L
+#ifndef FSM_CFG_TRACE
+#define FSM_CFG_TRACE
+#endif
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#include "fsm.h"
+#include "fsm_trace.h"
+
+/*************************************************************************/
+/*  Definitions                                                          */
+/*************************************************************************/
+#define REPLAY_STATE_UNKNOWN   0xFFFFFFFFu
+#define REPLAY_DEFAULT_REPORTS 20
+
+/*************************************************************************/
+/*  Static Global Variables, Constants                                   */
+/*************************************************************************/
+/* Next state per (state, event) as stored in records.                   */
+static U2 u2_sa_replayTable[FSM_NUM_STATES * FSM_NUM_EVENTS];
+
+/* Last state seen per instance. */
+static unsigned int* u4_sp_replayState;
+
+/*************************************************************************/
+/*  Private Functions                                                    */
+/*************************************************************************/
+static double f8_replay_nowSec(void)
+{
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+
+  return ((double)ts.tv_sec + ((double)ts.tv_nsec * 1e-9));
+}
+
+static int s4_replay_check(const FSMTraceHeader* header, const char* path)
+{
+  int s4_t_rtn;
+
+  s4_t_rtn = 0;
+
+  if((header->magic != FSM_TRACE_MAGIC) || (header->version != FSM_TRACE_VERSION) ||
+     (header->recordSize != sizeof(FSMTraceRecord)))
+  {
+    fprintf(stderr, "fsm_replay: %s is not a version %d trace file\n", path, FSM_TRACE_VERSION);
+    s4_t_rtn = 2;
+  }
+  else if((header->numStates != FSM_NUM_STATES) || (header->numEvents != FSM_NUM_EVENTS))
+  {
+    fprintf(stderr, "fsm_replay: trace has %d states and %d events, table has %d and %d\n",
+            header->numStates, header->numEvents, FSM_NUM_STATES, FSM_NUM_EVENTS);
+    s4_t_rtn = 2;
+  }
+  else if(header->numInstances <= 0)
+  {
+    fprintf(stderr, "fsm_replay: trace has %d instances\n", header->numInstances);
+    s4_t_rtn = 2;
+  }
+  else if(header->fingerprint != u8_fsm_tableFingerprint())
+  {
+    fprintf(stderr, "fsm_replay: table differs from the recording, divergences are expected\n");
+  }
+  else
+  {
+
+  }
+
+  return (s4_t_rtn);
+}
+
+/*************************************************************************/
+/*************************************************************************/
+int main(int argc, char** argv)
+{
+  const FSMTraceHeader* fsm_t_header;
+  const FSMTraceRecord* fsm_t_record;
+  struct stat st_t_stat;
+  void* pv_t_map;
+  unsigned int* u4_t_instState;
+  unsigned int* u4_t_threadTicks;
+  unsigned long u8_t_numRecords;
+  unsigned long u8_t_idx;
+  unsigned long u8_t_divergences;
+  unsigned long u8_t_discontinuities;
+  unsigned long u8_t_maxReports;
+  unsigned long u8_t_reports;
+  double f8_t_start;
+  double f8_t_elapsed;
+  U4 u4_t_state;
+  U4 u4_t_evt;
+  U4 u4_t_expected;
+  U4 u4_t_thread;
+  U4 u4_t_inst;
+  int s4_t_fd;
+  int s4_t_rtn;
+
+  if(argc < 2)
+  {
+    fprintf(stderr, "usage: %s <trace file> [max reports]\n", argv[0]);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  u8_t_maxReports = (argc > 2) ? strtoul(argv[2], NULL, 10) : REPLAY_DEFAULT_REPORTS;
+  s4_t_fd         = open(argv[1], O_RDONLY);
+
+  if((s4_t_fd < 0) || (fstat(s4_t_fd, &st_t_stat) != 0) || ((size_t)st_t_stat.st_size < sizeof(FSMTraceHeader)) ||
+     ((pv_t_map = mmap(NULL, (size_t)st_t_stat.st_size, PROT_READ, MAP_PRIVATE, s4_t_fd, 0)) == MAP_FAILED))
+  {
+    fprintf(stderr, "fsm_replay: cannot map %s\n", argv[1]);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  fsm_t_header = pv_t_map;
+  s4_t_rtn     = s4_replay_check(fsm_t_header, argv[1]);
+
+  if(s4_t_rtn != 0)
+  {
+    return (s4_t_rtn);
+  }
+  else
+  {
+
+  }
+
+  /* A file not closed by vd_fsm_traceClose() is still at full capacity,
+     trust the header only as far as the file goes. */
+  u8_t_numRecords = ((size_t)st_t_stat.st_size - sizeof(FSMTraceHeader)) / sizeof(FSMTraceRecord);
+  if(fsm_t_header->numRecords < u8_t_numRecords)
+  {
+    u8_t_numRecords = fsm_t_header->numRecords;
+  }
+  else
+  {
+
+  }
+
+  for(u4_t_state = 0; u4_t_state < FSM_NUM_STATES; u4_t_state++)
+  {
+    for(u4_t_evt = 0; u4_t_evt < FSM_NUM_EVENTS; u4_t_evt++)
+    {
+      u4_t_expected = u4_fsm_getTransition(u4_t_state, (FSM_EVT)u4_t_evt);
+      u2_sa_replayTable[(u4_t_state * FSM_NUM_EVENTS) + u4_t_evt] =
+        (u4_t_expected == FSM_STATE_INACTIVE) ? FSM_TRACE_STATE_NONE : (U2)u4_t_expected;
+    }
+  }
+
+  u4_t_threadTicks  = malloc(((size_t)fsm_t_header->numThreads + 1) * sizeof(unsigned int));
+  u4_sp_replayState = malloc(((size_t)(unsigned int)fsm_t_header->numInstances + 1) * sizeof(unsigned int));
+
+  if((u4_t_threadTicks == NULL) || (u4_sp_replayState == NULL))
+  {
+    fprintf(stderr, "fsm_replay: out of memory for %d threads and %d instances\n",
+            fsm_t_header->numThreads, fsm_t_header->numInstances);
+    return (2);
+  }
+  else
+  {
+
+  }
+
+  for(u8_t_idx = 0; u8_t_idx <= (unsigned long)(unsigned int)fsm_t_header->numInstances; u8_t_idx++)
+  {
+    u4_sp_replayState[u8_t_idx] = REPLAY_STATE_UNKNOWN;
+  }
+
+  for(u8_t_idx = 0; u8_t_idx <= (unsigned long)(unsigned int)fsm_t_header->numThreads; u8_t_idx++)
+  {
+    u4_t_threadTicks[u8_t_idx] = (unsigned int)fsm_t_header->startTicks;
+  }
+
+  fsm_t_record         = (const FSMTraceRecord*)(fsm_t_header + 1);
+  u8_t_divergences     = 0;
+  u8_t_discontinuities = 0;
+  u8_t_reports         = 0;
+  f8_t_start           = f8_replay_nowSec();
+
+  for(u8_t_idx = 0; u8_t_idx < u8_t_numRecords; u8_t_idx++, fsm_t_record++)
+  {
+    /* Absolute ticks per thread, the last slot collects unknown ones. */
+    u4_t_thread = (fsm_t_record->thread < fsm_t_header->numThreads) ? fsm_t_record->thread :
+                  fsm_t_header->numThreads;
+    u4_t_threadTicks[u4_t_thread] += (unsigned int)fsm_t_record->tickDelta;
+
+    /* Instances out of range share the last slot, their record is a
+       divergence. */
+    u4_t_inst      = ((fsm_t_record->inst >= 0) && (fsm_t_record->inst < fsm_t_header->numInstances)) ?
+                     fsm_t_record->inst : fsm_t_header->numInstances;
+    u4_t_instState = &u4_sp_replayState[u4_t_inst];
+
+    if(u4_t_inst == fsm_t_header->numInstances)
+    {
+      u8_t_divergences++;
+
+      if(u8_t_reports < u8_t_maxReports)
+      {
+        printf("divergence at record %lu: thread %d tick %u inst %d out of range, trace has %d instances\n",
+               u8_t_idx, fsm_t_record->thread, u4_t_threadTicks[u4_t_thread], fsm_t_record->inst,
+               fsm_t_header->numInstances);
+        u8_t_reports++;
+      }
+      else
+      {
+
+      }
+    }
+    else if(fsm_t_record->evt == FSM_TRACE_EVT_RESET)
+    {
+      *u4_t_instState = fsm_t_record->toState;
+    }
+    else if((fsm_t_record->evt >= FSM_NUM_EVENTS) || (fsm_t_record->fromState >= FSM_NUM_STATES) ||
+            (u2_sa_replayTable[(fsm_t_record->fromState * FSM_NUM_EVENTS) + fsm_t_record->evt] !=
+             fsm_t_record->toState))
+    {
+      u8_t_divergences++;
+
+      if(u8_t_reports < u8_t_maxReports)
+      {
+        printf("divergence at record %lu: thread %d tick %u inst %d state %d evt %d went to %d, table gives %d\n",
+               u8_t_idx, fsm_t_record->thread, u4_t_threadTicks[u4_t_thread],
+               fsm_t_record->inst, fsm_t_record->fromState, fsm_t_record->evt,
+               (fsm_t_record->toState == FSM_TRACE_STATE_NONE) ? FSM_STATE_INACTIVE : (U4)fsm_t_record->toState,
+               ((fsm_t_record->evt < FSM_NUM_EVENTS) && (fsm_t_record->fromState < FSM_NUM_STATES)) ?
+               u4_fsm_getTransition(fsm_t_record->fromState, (FSM_EVT)fsm_t_record->evt) : FSM_STATE_INACTIVE);
+        u8_t_reports++;
+      }
+      else
+      {
+
+      }
+    }
+    else
+    {
+
+    }
+
+    if((u4_t_inst != fsm_t_header->numInstances) && (fsm_t_record->evt != FSM_TRACE_EVT_RESET))
+    {
+      if((*u4_t_instState != REPLAY_STATE_UNKNOWN) && (*u4_t_instState != fsm_t_record->fromState))
+      {
+        u8_t_discontinuities++;
+
+        if(u8_t_reports < u8_t_maxReports)
+        {
+          printf("discontinuity at record %lu: inst %d left in state %u, next record starts in %d\n",
+                 u8_t_idx, fsm_t_record->inst, *u4_t_instState, fsm_t_record->fromState);
+          u8_t_reports++;
+        }
+        else
+        {
+
+        }
+      }
+      else
+      {
+
+      }
+
+      /* The recorded outcome, so one divergence is reported once. */
+      *u4_t_instState = (fsm_t_record->toState == FSM_TRACE_STATE_NONE) ? fsm_t_record->fromState :
+                        fsm_t_record->toState;
+    }
+    else
+    {
+
+    }
+  }
+
+  f8_t_elapsed = f8_replay_nowSec() - f8_t_start;
+
+  printf("{\"records\": %lu, \"divergences\": %lu, \"discontinuities\": %lu, \"dropped\": %llu, "
+         "\"seconds\": %.6f, \"bytes_per_sec\": %.0f}\n",
+         u8_t_numRecords, u8_t_divergences, u8_t_discontinuities, fsm_t_header->dropped, f8_t_elapsed,
+         (double)(u8_t_numRecords * sizeof(FSMTraceRecord)) / ((f8_t_elapsed > 0.0) ? f8_t_elapsed : 1e-9));
+
+  return ((u8_t_divergences == 0) ? 0 : 1);
+}